@@ -233,6 +233,9 @@ void *gensio_get_user_data(struct gensio *io);
 GENSIO_DLL_PUBLIC
 void gensio_set_user_data(struct gensio *io, void *user_data);
 
+GENSIO_DLL_PUBLIC
+struct gensio_os_funcs *gensio_get_os_funcs(struct gensio *io);
+
 GENSIO_DLL_PUBLIC
 int gensio_write(struct gensio *io, gensiods *count,
 		 const void *buf, gensiods buflen,
@@ -243,6 +246,11 @@ int gensio_write_sg(struct gensio *io, gensiods *count,
 		    const struct gensio_sg *sg, gensiods sglen,
 		    const char *const *auxdata);
 
+GENSIO_DLL_PUBLIC
+int gensio_write_zerocopy(struct gensio *io, gensiods *count,
+			  const struct gensio_sg *sg, gensiods sglen,
+			  gensio_done_err done, void *done_data);
+
 /* DEPRECATED - Do not use this function. */
 GENSIO_DLL_PUBLIC
 int gensio_raddr_to_str(struct gensio *io, gensiods *pos,
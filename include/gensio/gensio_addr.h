@@ -42,6 +42,8 @@ struct gensio_addr_funcs {
     int (*addr_get_port)(const struct gensio_addr *addr);
     void (*addr_get_data)(const struct gensio_addr *addr,
 			  void *oaddr, gensiods *rlen);
+    uint32_t (*addr_hash)(const struct gensio_addr *addr,
+			  bool hash_ports, bool hash_all);
 };
 
 /*
@@ -180,6 +182,24 @@ bool gensio_addr_equal(const struct gensio_addr *a1,
 		       const struct gensio_addr *a2,
 		       bool compare_ports, bool compare_all);
 
+/*
+ * Return a hash of the address.  Addresses that gensio_addr_equal()
+ * says are equal with the same compare_ports and compare_all values
+ * have the same hash, so this can be used to look addresses up in a
+ * hash table.  The hash is stable, it only depends on the address
+ * contents.
+ */
+GENSIOOSH_DLL_PUBLIC
+uint32_t gensio_addr_hash(const struct gensio_addr *addr,
+			  bool compare_ports, bool compare_all);
+
+/*
+ * For address implementations, add len bytes of data into a hash
+ * value.  Start with a hash of 0.
+ */
+GENSIOOSH_DLL_PUBLIC
+uint32_t gensio_addr_hash_add(uint32_t hash, const void *data, gensiods len);
+
 /*
  * Create a new address structure with the same addresses.
  */
@@ -69,6 +69,16 @@ struct gensio_filter_cb_control_data {
  */
 #define GENSIO_FILTER_CB_INPUT_READY	6
 
+/*
+ * Like GENSIO_FILTER_CB_START_TIMER, but the timer may go off up to
+ * slack late, see gensio_os_funcs_start_timer_slack().
+ */
+struct gensio_filter_cb_timer_slack_data {
+    gensio_time *timeout;
+    gensio_time *slack;
+};
+#define GENSIO_FILTER_CB_START_TIMER_SLACK	7
+
 typedef int (*gensio_filter_cb)(void *cb_data, int func, void *data);
 
 
@@ -153,6 +163,12 @@ int gensio_filter_try_disconnect(struct gensio_filter *filter,
  * (buf is NULL) then this will just attempt to write any pending
  * data out of the bottom of the filter into the handler.
  *
+ * The sg buffers belong to the caller and are only valid during the
+ * call.  A filter that passes data through unchanged should hand the
+ * sg to the handler as is and return what it took.  A filter that
+ * has to keep data after the call (it framed or escaped it and the
+ * handler took only part, or it may have to resend it) must copy it.
+ *
  * handler => func
  * cb_data => data
  * rcount => count
@@ -419,6 +435,57 @@ GENSIO_DLL_PUBLIC
 int gensio_ll_acontrol(struct gensio_ll *ll, bool get, int option,
 		       struct gensio_func_acontrol *data);
 
+/*
+ * A relay moves data between lls without going through the gensio
+ * callbacks.  While a relay hook is set, the ll stops handling its
+ * own I/O and calls read_ready() and write_ready() when the iod is
+ * ready, and the relay is responsible for enabling and disabling the
+ * iod's read and write handlers.  These are called with the ll's lock
+ * held, so the relay must not call back into the ll from them.
+ *
+ * If the ll is closed while the relay is set, closed() is called
+ * (again with the ll's lock held) and the relay must not use the iod
+ * after that.
+ */
+struct gensio_ll_relay_hook {
+    void (*read_ready)(struct gensio_ll_relay_hook *hook);
+    void (*write_ready)(struct gensio_ll_relay_hook *hook);
+    void (*closed)(struct gensio_ll_relay_hook *hook);
+
+    /* Set by the ll when the hook is installed. */
+    struct gensio_iod *iod;
+};
+
+/*
+ * Install a relay hook, or remove it if hook is NULL.  Removing the
+ * hook gives I/O back to the ll with the read and write callback
+ * enables the user has set.  The ll must be open and not have any
+ * read data pending, GE_INUSE is returned if it does.
+ *
+ * hook => buf
+ */
+#define GENSIO_LL_FUNC_SET_RELAY		14
+GENSIO_DLL_PUBLIC
+int gensio_ll_set_relay(struct gensio_ll *ll,
+			struct gensio_ll_relay_hook *hook);
+
+/*
+ * Write the data without copying it, see gensio_write_zerocopy().
+ * The ll calls zc->done once it is done with the data of each write
+ * that returned a non-zero count.  Returns GE_NOTSUP if the ll can't
+ * do it.
+ *
+ * rcount => count
+ * sg => cbuf
+ * sglen => buflen
+ * zc => buf
+ */
+#define GENSIO_LL_FUNC_WRITE_ZEROCOPY		15
+GENSIO_DLL_PUBLIC
+int gensio_ll_write_zerocopy(struct gensio_ll *ll, gensiods *rcount,
+			     const struct gensio_sg *sg, gensiods sglen,
+			     struct gensio_func_write_zerocopy *zc);
+
 typedef int (*gensio_ll_func)(struct gensio_ll *ll, int op,
 			      gensiods *count,
 			      void *buf, const void *cbuf,
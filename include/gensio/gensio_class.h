@@ -112,6 +112,31 @@ struct gensio_func_acontrol {
 };
 #define GENSIO_FUNC_ACONTROL		15
 
+/*
+ * Get the low-level ll for a gensio that passes data directly to and
+ * from its ll, with no filter in between.  Returns GE_NOTSUP if the
+ * gensio has a filter or no ll.
+ *
+ * ll (struct gensio_ll **) => buf
+ */
+#define GENSIO_FUNC_GET_LL		16
+
+/*
+ * Write without copying the data, see gensio_write_zerocopy().
+ * Returns GE_NOTSUP if the gensio can't do it.
+ *
+ * count => count
+ * sg => cbuf
+ * sglen => buflen
+ * Following struct in buf
+ */
+struct gensio_func_write_zerocopy {
+    gensio_done_err done;
+    void *done_data;
+    struct gensio *io; /* The gensio to pass to done. */
+};
+#define GENSIO_FUNC_WRITE_ZEROCOPY	17
+
 typedef int (*gensio_func)(struct gensio *io, int func, gensiods *count,
 			   const void *cbuf, gensiods buflen, void *buf,
 			   const char *const *auxdata);
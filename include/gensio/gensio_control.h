@@ -58,6 +58,8 @@
 #define GENSIO_CONTROL_SER_SEND_BREAK		48u
 #define GENSIO_CONTROL_SER_LINESTATE		49u
 
+#define GENSIO_CONTROL_MEM_USAGE		50u
+
 /* Keep the async control number in a different range, just to be safe. */
 #define GENSIO_ACONTROL_SER_BAUD		1000u
 #define GENSIO_ACONTROL_SER_DATASIZE		1001u
@@ -58,6 +58,7 @@ struct gensio_os_funcs;
 #define GE_NAME_SERVER_FAILURE	40
 #define GE_NAME_INVALID		41
 #define GE_NAME_NET_NOT_UP	42
+#define GE_MEMLIMIT		43
 
 /*
  * Gensio mux has the ability to return an arbitrary error from the
@@ -25,6 +25,7 @@ extern "C" {
 
 #include <gensio/gensio_types.h>
 #include <gensio/gensioosh_dllvisibility.h>
+#include <gensio/gensio_list.h>
 
 /* Avoid having to include SCTP headers. */
 struct sctp_sndrcvinfo;
@@ -114,9 +115,27 @@ struct gensio_opensocks
 #define GENSIO_SET_OPENSOCK_KEEPALIVE	(1 << 3)
 #define GENSIO_OPENSOCK_NODELAY		(1 << 4)
 #define GENSIO_SET_OPENSOCK_NODELAY	(1 << 5)
+/*
+ * SO_REUSEPORT, lets multiple listening sockets bind the same address
+ * and port so the kernel spreads connections across them.  Returns
+ * GE_NOTSUP if the platform or address family does not support it.
+ */
+#define GENSIO_OPENSOCK_REUSEPORT	(1 << 6)
+#define GENSIO_SET_OPENSOCK_REUSEPORT	(1 << 7)
 
 /* For recv and send */
 #define GENSIO_MSG_OOB 1
+#define GENSIO_MSG_PEEK 2
+/*
+ * For send only.  Send the data without copying it, zero-copy must be
+ * enabled on the socket (see GENSIO_SOCKCTL_SET_ZEROCOPY) or this
+ * returns GE_NOTSUP.  The data must not be modified until the send is
+ * complete, see GENSIO_SOCKCTL_GET_ZEROCOPY_DONE.  Each send that
+ * takes data gets the next number, starting at zero.  Returns
+ * GE_NOMEM if the kernel can't pin any more memory right now, the
+ * data can be sent normally instead.
+ */
+#define GENSIO_MSG_ZEROCOPY 4
 
 /******************************************************************
  * For sock_control()
@@ -181,6 +200,44 @@ struct gensio_opensocks
 #define GENSIO_SOCKCTL_SET_EXTRAINFO	10
 #define GENSIO_SOCKCTL_GET_EXTRAINFO	11
 
+/*
+ * For UDP sockets, set/get the segment size for offloading.  data
+ * points to an unsigned integer, datalen should point to a gensiods
+ * with sizeof(unsigned int) in it.  0 disables it.  When set,
+ * sendto_multi sends runs of packets of exactly this size (the last
+ * may be shorter) to the same address as one GSO send, and the
+ * kernel may coalesce received packets (GRO), which recvfrom_multi
+ * reports with segsize.  Returns GE_NOTSUP if the OS can't do it.
+ */
+#define GENSIO_SOCKCTL_SET_GSO		12
+#define GENSIO_SOCKCTL_GET_GSO		13
+
+/*
+ * For TCP sockets, enable zero-copy sends with GENSIO_MSG_ZEROCOPY.
+ * data is a bool pointer to the value.  datalen should point to
+ * sizeof(bool).  The iod's handlers must be set, the completions come
+ * in on the socket's error queue, which calls the except handler (see
+ * GENSIO_IOD_CONTROL_ERRQUEUE).  Returns GE_NOTSUP if the OS can't do
+ * it.
+ */
+#define GENSIO_SOCKCTL_SET_ZEROCOPY	14
+
+/*
+ * Get the next zero-copy send completion off the socket's error
+ * queue.  data points to a struct gensio_zerocopy_done, datalen
+ * should point to a gensiods with its size in it.  The kernel is done
+ * with the data of sends first through last (the numbers
+ * GENSIO_MSG_ZEROCOPY sends get, this may wrap).  Completions may
+ * come in out of order.  Returns GE_NODATA if there are no more.
+ * Call this from the except handler until it returns GE_NODATA.
+ */
+#define GENSIO_SOCKCTL_GET_ZEROCOPY_DONE	15
+
+struct gensio_zerocopy_done {
+    uint32_t first;
+    uint32_t last;
+};
+
 /******************************************************************
  * For iod_control()
  */
@@ -279,6 +336,24 @@ struct gensio_winsize {
 /* For ptys, will cd to this directory at startup. */
 #define GENSIO_IOD_CONTROL_START_DIR 28
 
+/*
+ * Set only, a read (val is 0) or write (val is 1) on a stream iod
+ * would block or came up short.  The os handler may use this to avoid
+ * checking the iod again for readiness.  Returns GE_NOTSUP if the os
+ * handler doesn't use it.
+ */
+#define GENSIO_IOD_CONTROL_DRAINED 29
+
+/*
+ * Set only, the iod gets things on its error queue that are not
+ * errors (zero-copy send completions) and the except handler reads
+ * them, so an error report should not be treated as a hard error.
+ * val is a bool.  The handlers must be set, and this is reset when
+ * they are cleared.  Returns GE_NOTSUP if the os handler can't report
+ * the error queue.
+ */
+#define GENSIO_IOD_CONTROL_ERRQUEUE 30
+
 /*
  * These are for communication between the socket code and the iod, so
  * the socket code can store information in the IOD.  It's only for
@@ -305,6 +380,165 @@ struct gensio_winsize {
  */
 #define GENSIO_CONTROL_SET_PROC_DATA	10001
 
+/*
+ * Statistics about the event loop.  For ENABLE_STATS, data points to
+ * an int, non-zero enables collecting statistics (and clears them)
+ * and zero disables it, the default is disabled.  *datalen must be
+ * at least sizeof(int).  For GET_STATS, data
+ * points to a struct gensio_os_stats that is filled in, *datalen
+ * must be at least the size of the structure and is set to the size
+ * used.  Times are in microseconds.  Histograms are log2 based,
+ * bucket 0 counts zero values and bucket n counts values from
+ * 2^(n-1) to 2^n - 1, the last bucket counts everything larger.
+ * These return GE_NOTSUP if the os handler doesn't support them.
+ */
+#define GENSIO_CONTROL_ENABLE_STATS	10002
+#define GENSIO_CONTROL_GET_STATS	10003
+
+/*
+ * Busy polling.  If spin_usecs is non-zero, service and wait calls
+ * poll without blocking for up to that long before they block, this
+ * avoids the latency of going to sleep and waking back up.  The time
+ * spun adapts, it is cut in half each time nothing comes in while
+ * spinning (down to 1/16 of spin_usecs) and goes back to spin_usecs
+ * when something does.  If sock_usecs is non-zero, SO_BUSY_POLL is
+ * set to it on sockets created after this, if the OS supports it.
+ *
+ * SET_BUSY_POLL sets spin_usecs and sock_usecs and clears the
+ * counters, GET_BUSY_POLL gets everything.  data points to a struct
+ * gensio_os_busy_poll and *datalen must be at least its size.
+ */
+#define GENSIO_CONTROL_SET_BUSY_POLL	10004
+#define GENSIO_CONTROL_GET_BUSY_POLL	10005
+
+struct gensio_os_busy_poll {
+    unsigned int spin_usecs;
+    unsigned int sock_usecs;
+
+    /* The rest are only for GET_BUSY_POLL. */
+    unsigned int cur_spin_usecs;
+    uint64_t spins;	/* Number of times spinning was done. */
+    uint64_t hits;	/* Times something came in while spinning. */
+    uint64_t misses;	/* Times the spin ran out and it had to block. */
+};
+
+/*
+ * Get statistics from the pool allocator, see
+ * GENSIO_OS_FUNCS_FLAG_MEMPOOL.  data points to a struct
+ * gensio_os_mempool_stats and *datalen must be at least its size.
+ * Returns GE_NOTSUP if the pool is not in use.
+ */
+#define GENSIO_CONTROL_GET_MEMPOOL_STATS	10006
+
+struct gensio_os_mempool_stats {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t cache_hits;	/* Allocs satisfied from a thread's cache. */
+    uint64_t large_allocs;	/* Allocs too big for the pool. */
+    uint64_t slabs;		/* Slabs the pool has taken from malloc. */
+    uint64_t slab_bytes;
+};
+
+/*
+ * A packet to receive with recvfrom_multi.  buf and buflen are the
+ * buffer to receive into and addr must come from
+ * addr_alloc_recvfrom.  len is set to the length of the packet.  If
+ * the OS coalesced several packets from the same source into the
+ * buffer (see GENSIO_SOCKCTL_SET_GSO), segsize is set to the size of
+ * each packet, all but the last are that size.  Otherwise segsize is
+ * set to zero.
+ */
+struct gensio_recv_msg {
+    void *buf;
+    gensiods buflen;
+    gensiods len;
+    gensiods segsize;
+    struct gensio_addr *addr;
+};
+
+/*
+ * A packet to send with sendto_multi.  sg and sglen are the data to
+ * send to addr, len is set to the number of bytes sent.
+ */
+struct gensio_send_msg {
+    const struct gensio_sg *sg;
+    gensiods sglen;
+    const struct gensio_addr *addr;
+    gensiods len;
+};
+
+/*
+ * Memory budget.  Buffers that hold data in a gensio stack (read
+ * buffers and the like) are charged against the budget with
+ * gensio_os_mem_charge() when they are taken and uncharged when they
+ * are given back.  When more than soft_limit bytes are charged,
+ * gensios stop reading new data until usage drops back down (see
+ * gensio_os_mem_wait()), so backpressure goes back to the sender.
+ * Only data actually being held is charged, not buffer sizes, so
+ * idle connections cost nothing.  A charge that would go
+ * past hard_limit fails with GE_MEMLIMIT.  A limit of zero means no
+ * limit, the default.  The GENSIO_MEM_SOFT_LIMIT and
+ * GENSIO_MEM_HARD_LIMIT environment variables set the initial
+ * limits.
+ *
+ * SET_MEM_LIMITS sets soft_limit and hard_limit and clears the
+ * counters, GET_MEM_USAGE gets everything.  data points to a struct
+ * gensio_os_mem_usage and *datalen must be at least its size.  These
+ * return GE_NOTSUP if the os handler doesn't support a budget.
+ */
+#define GENSIO_CONTROL_SET_MEM_LIMITS	10007
+#define GENSIO_CONTROL_GET_MEM_USAGE	10008
+
+/*
+ * Stop using recvfrom_multi and sendto_multi on this os handler, so
+ * gensio_os_recvfrom_multi() and gensio_os_sendto_multi() use their
+ * packet at a time fallbacks.  This is mostly for testing the
+ * fallbacks.  It must be done before any gensios are allocated.
+ * data and datalen are not used.  Returns GE_NOTSUP if the os
+ * handler doesn't support it.
+ */
+#define GENSIO_CONTROL_DISABLE_MMSG	10009
+
+struct gensio_os_mem_usage {
+    gensiods soft_limit;
+    gensiods hard_limit;
+
+    /* The rest are only for GET_MEM_USAGE. */
+    gensiods in_use;		/* Bytes currently charged. */
+    gensiods peak;
+    uint64_t soft_limit_hits;	/* Times a read was held off. */
+    uint64_t hard_limit_failures; /* Charges that failed. */
+};
+
+/* See gensio_os_mem_wait(). */
+struct gensio_os_mem_waiter {
+    void (*ready)(struct gensio_os_mem_waiter *w);
+
+    /* Internal to the os funcs. */
+    struct gensio_link link;
+    bool queued;
+};
+
+#define GENSIO_OS_STATS_HIST_BUCKETS 32
+struct gensio_os_stats_hist {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[GENSIO_OS_STATS_HIST_BUCKETS];
+};
+
+struct gensio_os_stats {
+    /* Time spent working (not waiting) in each service/wait loop. */
+    struct gensio_os_stats_hist loop_time;
+    struct gensio_os_stats_hist fd_handler_time;
+    struct gensio_os_stats_hist timer_handler_time;
+    struct gensio_os_stats_hist runner_time;
+    /* How late timers were run. */
+    struct gensio_os_stats_hist timer_lateness;
+    /* The number of runners pending each time runners are run. */
+    struct gensio_os_stats_hist runner_queue_depth;
+};
+
 struct gensio_os_funcs {
     /* For use by the code doing the os function translation. */
     void *user_data;
@@ -825,8 +1059,137 @@ struct gensio_os_funcs {
      */
     int (*control)(struct gensio_os_funcs *o, int func, void *data,
 		   gensiods *datalen);
+
+    /*
+     * Like start_timer, but the timer may go off any time between
+     * timeout and timeout + slack, so the os handler can group timers
+     * together and wake up less.  This may be NULL if the os handler
+     * does not support it, use gensio_os_funcs_start_timer_slack() to
+     * fall back to start_timer in that case.
+     */
+    int (*start_timer_slack)(struct gensio_timer *timer, gensio_time *timeout,
+			     gensio_time *slack);
+
+    /*
+     * Multi-reactor support.  An os handler may be a group of
+     * reactors, each with its own timers, runners and I/O handling,
+     * and each must be serviced by its own thread(s).  get_reactor
+     * returns the os funcs for reactor idx modulo the number of
+     * reactors in f's group, or the next one round-robin if idx is
+     * GENSIO_OS_REACTOR_NEXT.  iod_set_reactor moves an iod that has
+     * no handlers set to another reactor in the same group.  These
+     * may be NULL, use gensio_os_funcs_get_reactor() and
+     * gensio_os_funcs_iod_set_reactor() to handle that.
+     */
+    struct gensio_os_funcs *(*get_reactor)(struct gensio_os_funcs *f,
+					   unsigned int idx);
+    int (*iod_set_reactor)(struct gensio_iod *iod, struct gensio_os_funcs *to);
+
+    /*
+     * Memory budget, see GENSIO_CONTROL_SET_MEM_LIMITS.  mem_charge
+     * adds size bytes to the budget and to *count (if count is not
+     * NULL), it returns GE_MEMLIMIT if that would go past the hard
+     * limit.  mem_uncharge takes them back out.  mem_over_soft_limit
+     * returns true if the soft limit is exceeded.  These may be
+     * NULL, use the gensio_os_mem_xxx() functions to handle that.
+     */
+    int (*mem_charge)(struct gensio_os_funcs *f, gensiods *count,
+		      gensiods size);
+    void (*mem_uncharge)(struct gensio_os_funcs *f, gensiods *count,
+			 gensiods size);
+    bool (*mem_over_soft_limit)(struct gensio_os_funcs *f);
+
+    /*
+     * Wait for the memory budget to go back to or under the soft
+     * limit, see gensio_os_mem_wait().  These may be NULL, use the
+     * gensio_os_mem_xxx() functions to handle that.
+     */
+    bool (*mem_wait)(struct gensio_os_funcs *f,
+		     struct gensio_os_mem_waiter *w);
+    bool (*mem_wait_cancel)(struct gensio_os_funcs *f,
+			    struct gensio_os_mem_waiter *w);
+
+    /*
+     * Receive up to nmsgs packets from a socket in one call, if the
+     * OS can do that.  *nrecv is set to the number of packets
+     * received, zero if nothing was ready.  This may be NULL, use
+     * gensio_os_recvfrom_multi() to fall back to recvfrom.
+     */
+    int (*recvfrom_multi)(struct gensio_iod *iod, struct gensio_recv_msg *msgs,
+			  unsigned int nmsgs, unsigned int *nrecv, int flags);
+
+    /*
+     * Send up to nmsgs packets on a socket in one call, if the OS
+     * can do that.  Packets are sent in order until one can't be
+     * sent, *nsent is set to the number sent.  An error is only
+     * returned if the first packet fails.  This may be NULL, use
+     * gensio_os_sendto_multi() to fall back to sendto.
+     */
+    int (*sendto_multi)(struct gensio_iod *iod, struct gensio_send_msg *msgs,
+			unsigned int nmsgs, unsigned int *nsent, int flags);
 };
 
+/*
+ * Charge and uncharge buffer memory against the os funcs' memory
+ * budget, and check if it is over the soft limit.  count is a
+ * per-object byte counter that is updated with the charge, it may be
+ * NULL.  If the os funcs doesn't have a budget only count is
+ * updated.
+ */
+GENSIOOSH_DLL_PUBLIC
+int gensio_os_mem_charge(struct gensio_os_funcs *o, gensiods *count,
+			 gensiods size);
+
+GENSIOOSH_DLL_PUBLIC
+void gensio_os_mem_uncharge(struct gensio_os_funcs *o, gensiods *count,
+			    gensiods size);
+
+GENSIOOSH_DLL_PUBLIC
+bool gensio_os_mem_over_soft_limit(struct gensio_os_funcs *o);
+
+/*
+ * Wait for the memory budget to drop back to the soft limit.  If the
+ * budget is over the soft limit, w is queued and this returns true.
+ * When enough memory is uncharged (or the limits are changed) the
+ * waiter is dequeued and w->ready is called once.  ready may be
+ * called from any thread, with locks held by whoever did the
+ * uncharge, so it should only schedule work, with a runner for
+ * instance.  It is not called with the budget's lock held.  If the
+ * budget is not over the soft limit, this returns false and w is not
+ * queued.
+ *
+ * gensio_os_mem_wait_cancel() dequeues w.  It returns true if w was
+ * queued, false if it wasn't or ready has been or is about to be
+ * called.
+ */
+GENSIOOSH_DLL_PUBLIC
+bool gensio_os_mem_wait(struct gensio_os_funcs *o,
+			struct gensio_os_mem_waiter *w);
+
+GENSIOOSH_DLL_PUBLIC
+bool gensio_os_mem_wait_cancel(struct gensio_os_funcs *o,
+			       struct gensio_os_mem_waiter *w);
+
+/*
+ * Receive multiple packets from a socket, see recvfrom_multi in the
+ * os funcs.  If the os funcs can't do that, this receives one packet
+ * with recvfrom.
+ */
+GENSIOOSH_DLL_PUBLIC
+int gensio_os_recvfrom_multi(struct gensio_iod *iod,
+			     struct gensio_recv_msg *msgs, unsigned int nmsgs,
+			     unsigned int *nrecv, int flags);
+
+/*
+ * Send multiple packets on a socket, see sendto_multi in the os
+ * funcs.  If the os funcs can't do that, this sends the packets one
+ * at a time with sendto.
+ */
+GENSIOOSH_DLL_PUBLIC
+int gensio_os_sendto_multi(struct gensio_iod *iod,
+			   struct gensio_send_msg *msgs, unsigned int nmsgs,
+			   unsigned int *nsent, int flags);
+
 /*
  * Called from os handlers, check for any handlers that may need to be
  * called.
@@ -21,6 +21,19 @@ GENSIOOSH_DLL_PUBLIC
 int gensio_default_os_hnd(int wake_sig, struct gensio_os_funcs **o);
 
 #define GENSIO_OS_FUNCS_FLAG_PRIO_INHERIT (1 << 0)
+/*
+ * Allocate memory from a pool allocator instead of directly from
+ * malloc.  This can also be turned on by setting GENSIO_MEMPOOL in
+ * the environment.  It is not used if GENSIO_MEMTRACK is set.
+ */
+#define GENSIO_OS_FUNCS_FLAG_MEMPOOL (1 << 1)
+/*
+ * Keep timers in a hashed timer wheel instead of a heap, which is
+ * cheaper with a lot of timers.  This can also be turned on by
+ * setting GENSIO_TIMER_WHEEL in the environment.  Only used if the
+ * OS handler allocates its own selector.
+ */
+#define GENSIO_OS_FUNCS_FLAG_TIMER_WHEEL (1 << 2)
 GENSIOOSH_DLL_PUBLIC
 int gensio_alloc_os_funcs(int wake_sig, struct gensio_os_funcs **o,
 			  unsigned int flags, ...);
@@ -66,6 +79,35 @@ int gensio_os_new_thread(struct gensio_os_funcs *o,
 GENSIOOSH_DLL_PUBLIC
 int gensio_os_wait_thread(struct gensio_thread *thread_id);
 
+/*
+ * Placement for a thread.  If num_cpus is not zero, the thread is
+ * only allowed to run on the num_cpus CPUs in the cpus array.  If
+ * numa_node is >= 0, memory the thread allocates is taken from that
+ * NUMA node if possible, and if no cpus are given the thread is only
+ * allowed to run on the CPUs on that node.  Set numa_node to -1 to
+ * not use NUMA.
+ */
+struct gensio_thread_attr {
+    const unsigned int *cpus;
+    unsigned int num_cpus;
+    int numa_node;
+};
+
+/*
+ * Like gensio_os_new_thread(), but place the thread according to
+ * attr.  attr may be NULL, which is the same as gensio_os_new_thread().
+ */
+GENSIOOSH_DLL_PUBLIC
+int gensio_os_new_thread_attr(struct gensio_os_funcs *o,
+			      void (*start_func)(void *data), void *data,
+			      const struct gensio_thread_attr *attr,
+			      struct gensio_thread **thread_id);
+
+/* Place the calling thread according to attr. */
+GENSIOOSH_DLL_PUBLIC
+int gensio_os_thread_set_attr(struct gensio_os_funcs *o,
+			      const struct gensio_thread_attr *attr);
+
 GENSIOOSH_DLL_PUBLIC
 void *gensio_os_funcs_zalloc(struct gensio_os_funcs *o, gensiods len);
 
@@ -111,6 +153,12 @@ int gensio_os_funcs_start_timer_abs(struct gensio_os_funcs *o,
 				    struct gensio_timer *timer,
 				    gensio_time *timeout);
 
+GENSIOOSH_DLL_PUBLIC
+int gensio_os_funcs_start_timer_slack(struct gensio_os_funcs *o,
+				      struct gensio_timer *timer,
+				      gensio_time *timeout,
+				      gensio_time *slack);
+
 GENSIOOSH_DLL_PUBLIC
 int gensio_os_funcs_stop_timer(struct gensio_os_funcs *o,
 			       struct gensio_timer *timer);
@@ -181,6 +229,23 @@ GENSIOOSH_DLL_PUBLIC
 void gensio_os_funcs_wake(struct gensio_os_funcs *o,
 			  struct gensio_waiter *waiter);
 
+/*
+ * Get a reactor from an os funcs that is a group of reactors.  If
+ * the os funcs doesn't have reactors, this returns o.
+ */
+#define GENSIO_OS_REACTOR_NEXT	((unsigned int) -1)
+GENSIOOSH_DLL_PUBLIC
+struct gensio_os_funcs *gensio_os_funcs_get_reactor(struct gensio_os_funcs *o,
+						    unsigned int idx);
+
+/*
+ * Move an iod to the given reactor.  Returns GE_NOTSUP if the iod's
+ * os funcs doesn't support reactors.
+ */
+GENSIOOSH_DLL_PUBLIC
+int gensio_os_funcs_iod_set_reactor(struct gensio_iod *iod,
+				    struct gensio_os_funcs *to);
+
 GENSIOOSH_DLL_PUBLIC
 void gensio_os_funcs_set_data(struct gensio_os_funcs *o, void *data);
 
@@ -310,6 +310,35 @@ GENSIOOSH_DLL_PUBLIC
 void gensio_i_free(struct gensio_memtrack *m, void *data,
 		   void *caller[], unsigned int caller_size);
 
+/*
+ * A pool allocator OS handlers can put under zalloc and free.  See
+ * GENSIO_OS_FUNCS_FLAG_MEMPOOL.  Memory from gensio_mempool_zalloc()
+ * must only be freed with gensio_mempool_zfree() on the same pool.
+ * Freeing the pool frees all the memory in it, the caller must make
+ * sure nothing is still using it.  If GENSIO_MEMPOOL in the
+ * environment contains "abort" when the pool is allocated, freeing
+ * the pool with memory still allocated from it aborts, for leak
+ * testing.
+ */
+struct gensio_mempool;
+struct gensio_os_mempool_stats;
+
+GENSIOOSH_DLL_PUBLIC
+struct gensio_mempool *gensio_mempool_alloc(void);
+
+GENSIOOSH_DLL_PUBLIC
+void gensio_mempool_free(struct gensio_mempool *p);
+
+GENSIOOSH_DLL_PUBLIC
+void *gensio_mempool_zalloc(struct gensio_mempool *p, gensiods size);
+
+GENSIOOSH_DLL_PUBLIC
+void gensio_mempool_zfree(struct gensio_mempool *p, void *data);
+
+GENSIOOSH_DLL_PUBLIC
+void gensio_mempool_get_stats(struct gensio_mempool *p,
+			      struct gensio_os_mempool_stats *stats);
+
 /* For testing, do not use in normal code. */
 GENSIOOSH_DLL_PUBLIC
 void gensio_osfunc_exit(int rv);
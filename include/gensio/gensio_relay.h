@@ -0,0 +1,65 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * A relay moves data in both directions between two gensios that sit
+ * directly on a file descriptor (tcp, unix, pty, serialdev) without
+ * any filters.  The data is moved with splice() through a pipe, so it
+ * is never copied into user space, and it does not go through the
+ * gensio callbacks at all.
+ */
+
+#ifndef GENSIO_RELAY_H
+#define GENSIO_RELAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <gensio/gensio.h>
+
+struct gensio_relay;
+
+/*
+ * Called when the relay stops because one side reported end of file
+ * (err is GE_REMCLOSE), was closed, or got an error.  No more data is
+ * moved after this and the gensios are handed back to their normal
+ * handling, with the read and write callback enables that were set
+ * before the relay started.  You must still call gensio_relay_free(),
+ * that may be done from this callback.
+ */
+typedef void (*gensio_relay_done)(struct gensio_relay *relay, int err,
+				  void *cb_data);
+
+/*
+ * Start relaying between io1 and io2.  Both gensios must be open and
+ * must not have any read data pending; the user should disable the
+ * read and write callbacks on both before calling this, as they are
+ * not called while the relay runs.  Returns GE_NOTSUP if either
+ * gensio is not a raw fd gensio or the platform does not support
+ * splice(), in which case the caller should fall back to moving the
+ * data itself.
+ */
+GENSIO_DLL_PUBLIC
+int gensio_relay_alloc(struct gensio *io1, struct gensio *io2,
+		       gensio_relay_done done, void *cb_data,
+		       struct gensio_relay **relay);
+
+/*
+ * Stop the relay if it is still running and free it.  When this
+ * returns, the relay no longer touches either gensio and done will
+ * not be called if it hasn't already started.  The gensios are not
+ * closed.
+ */
+GENSIO_DLL_PUBLIC
+void gensio_relay_free(struct gensio_relay *relay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENSIO_RELAY_H */
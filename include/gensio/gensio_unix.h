@@ -32,6 +32,35 @@ GENSIO_DLL_PUBLIC
 int gensio_unix_funcs_alloc(struct selector_s *sel, int wake_sig,
 			    struct gensio_os_funcs **ro);
 
+/*
+ * Like the above, but have the selector wait for fds using io_uring
+ * polls instead of epoll (see sel_use_io_uring()).  The I/O itself is
+ * still done with normal system calls.  If io_uring is not
+ * available, or a passed in selector already has fds registered, this
+ * falls back to a normal epoll selector.
+ */
+GENSIO_DLL_PUBLIC
+int gensio_uring_funcs_alloc(struct selector_s *sel, int wake_sig,
+			     struct gensio_os_funcs **ro);
+
+/*
+ * Allocate a group of count os funcs (reactors), each with its own
+ * selector, and return the first one.  Use
+ * gensio_os_funcs_get_reactor() to get the others.  Each reactor
+ * only handles the gensios, timers and runners allocated on it, so
+ * every reactor must have at least one thread servicing it.  This
+ * avoids contention between threads on a single selector.  TCP and
+ * unix accepters will spread the connections they accept across the
+ * reactors round-robin, or a tcp accepter with the reuseport option
+ * will listen on each reactor and let the kernel spread them.
+ *
+ * The group is freed when the references to all the reactors are
+ * gone.
+ */
+GENSIO_DLL_PUBLIC
+int gensio_unix_funcs_alloc_reactors(unsigned int count, int wake_sig,
+				     struct gensio_os_funcs **ro);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,6 +9,7 @@
 #define SELECTOR
 #include <sys/time.h> /* For timeval */
 #include <signal.h>
+#include <stdint.h>
 
 #if defined GENSIO_LINK_STATIC
   #define SEL_DLL_PUBLIC
@@ -69,6 +70,135 @@ int sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
 SEL_DLL_PUBLIC
 int sel_alloc_selector_nothread(struct selector_s **new_selector);
 
+/*
+ * Set the maximum number of events fetched from epoll each time a
+ * thread waits.  The default is 1, so each thread will handle one fd
+ * per wakeup and other threads will pick up the other fds.  Larger
+ * values save system calls and lock operations on busy selectors,
+ * but one thread will handle all the fds it fetches in sequence.
+ * Returns EINVAL if count is 0 or larger than SEL_MAX_EPOLL_BATCH.
+ * This has no effect if epoll is not being used.
+ */
+#define SEL_MAX_EPOLL_BATCH 256
+SEL_DLL_PUBLIC
+int sel_set_epoll_batch(struct selector_s *sel, unsigned int count);
+
+/*
+ * Register fds with epoll edge-triggered instead of one-shot.  In
+ * one-shot mode every event disarms the fd and it has to be rearmed
+ * with a system call after the handler runs.  In edge-triggered mode
+ * epoll is only changed when a handler is enabled or disabled, or
+ * when a handler that is still enabled returns without reporting
+ * sel_fd_drained(), so epoll will report it again if it is still
+ * ready.  Handlers for a single fd are still only run by one thread at
+ * a time.
+ *
+ * This is off by default.  It must be set before any fds are added to
+ * the selector, it returns EBUSY if fds are registered and ENOSYS if
+ * epoll is not being used.
+ */
+SEL_DLL_PUBLIC
+int sel_set_edge_triggered(struct selector_s *sel, int enable);
+
+/*
+ * The fd gets things on its error queue that are not errors, like
+ * zero-copy send completions on a socket, so an EPOLLERR without an
+ * EPOLLHUP is not a sticky error.  Those are passed to the except
+ * handler and the fd is left registered, so the except handler must
+ * read the error queue until it is empty.  If the except handler is
+ * not enabled, they are handled like any other error.  This is
+ * cleared when the fd's handlers are cleared or replaced.  Returns
+ * ENOSYS if epoll or io_uring is not being used (select doesn't
+ * report the error queue) and EBADF if the fd has no handlers.
+ */
+SEL_DLL_PUBLIC
+int sel_set_fd_errqueue(struct selector_s *sel, int fd, int enable);
+
+/*
+ * In edge-triggered mode, tell the selector that a read (write is
+ * false) or write on the fd would block or came up short, so it has
+ * nothing more to read or can't take more data right now.  Then the
+ * fd is not rearmed after its handlers return, the next edge will
+ * report it.  This only has an effect when called from one of the
+ * fd's handlers, on the thread running it, and it takes no locks.
+ * Only call this for stream fds, a short read from a datagram fd says
+ * nothing about whether more is queued.  This does nothing in other
+ * modes.
+ */
+SEL_DLL_PUBLIC
+void sel_fd_drained(struct selector_s *sel, int fd, int write);
+
+/*
+ * Use io_uring polls instead of epoll to wait for fds.  Each fd that
+ * has handlers enabled gets a one-shot poll on the ring, and all the
+ * polls rearmed after handling a batch of events (see
+ * sel_set_epoll_batch()) are submitted with one system call.  Only
+ * the wait uses io_uring, the handlers still read, write and accept
+ * with normal system calls.  If submitting to the ring fails, it is
+ * retried when a thread next waits.
+ *
+ * This must be called before any fds are added to the selector, it
+ * returns EBUSY if fds are registered or edge-triggered mode is set.
+ * It returns ENOSYS or some other error if io_uring is not available,
+ * the selector will continue to use epoll (or select) in that case.
+ */
+SEL_DLL_PUBLIC
+int sel_use_io_uring(struct selector_s *sel);
+
+/*
+ * Keep timers in a hierarchical timer wheel instead of a heap.
+ * Starting and stopping a timer is O(1) with the wheel instead of
+ * O(log n), which helps if there are a lot of timers.  Timers are
+ * handled on 1ms ticks with the wheel, so a timer may go off up to
+ * a millisecond late, but never early.
+ *
+ * This must be called before any timers are started, it returns
+ * EBUSY if a timer is running.
+ */
+SEL_DLL_PUBLIC
+int sel_use_timer_wheel(struct selector_s *sel);
+
+/*
+ * Statistics about the selector.  Times are in microseconds.  The
+ * histograms are log2 based, bucket 0 counts values of 0, and bucket
+ * n counts values from 2^(n-1) to 2^n - 1, the last bucket counts
+ * everything larger.
+ */
+#define SEL_STATS_HIST_BUCKETS 32
+struct sel_stats_hist {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[SEL_STATS_HIST_BUCKETS];
+};
+
+struct sel_stats {
+    /* Time spent doing work (not waiting) in each sel_select() call. */
+    struct sel_stats_hist loop_time;
+    struct sel_stats_hist fd_handler_time;
+    struct sel_stats_hist timer_handler_time;
+    struct sel_stats_hist runner_time;
+    /* How long after its timeout each timer was run. */
+    struct sel_stats_hist timer_lateness;
+    /* How many runners were pending each time runners were run. */
+    struct sel_stats_hist runner_queue_depth;
+};
+
+/*
+ * Enable or disable collecting statistics.  Enabling clears the
+ * statistics.  When disabled (the default) the only overhead is
+ * checking a flag.
+ */
+SEL_DLL_PUBLIC
+void sel_set_stats_enabled(struct selector_s *sel, int enable);
+
+/*
+ * Get the current statistics.  These are collected from multiple
+ * threads without locking, so they may be slightly inconsistent.
+ */
+SEL_DLL_PUBLIC
+void sel_get_stats(struct selector_s *sel, struct sel_stats *stats);
+
 /* Used to destroy a selector. */
 SEL_DLL_PUBLIC
 int sel_free_selector(struct selector_s *new_selector);
@@ -134,6 +264,17 @@ SEL_DLL_PUBLIC
 int sel_start_timer(sel_timer_t    *timer,
 		    struct timeval *timeout);
 
+/*
+ * Like sel_start_timer(), but the timer may go off any time between
+ * timeout and timeout + slack.  The selector uses the slack to put
+ * timers that go off at about the same time together so they are
+ * handled in one wakeup.
+ */
+SEL_DLL_PUBLIC
+int sel_start_timer_slack(sel_timer_t    *timer,
+			  struct timeval *timeout,
+			  struct timeval *slack);
+
 SEL_DLL_PUBLIC
 int sel_stop_timer(sel_timer_t *timer);
 
@@ -224,6 +365,33 @@ SEL_DLL_PUBLIC
 void sel_wake_one(struct selector_s *sel, long thread_id, sel_send_sig_cb killer,
 		  void *cb_data);
 
+/*
+ * Wake threads with eventfds instead of signals.  After this is
+ * called, pass sel_wakeup_send() as the send_sig function to
+ * sel_select() and friends and a wakeup as the cb_data.
+ *
+ * sel_get_wakeup() returns the wakeup shared by all threads that
+ * just loop servicing the selector, waking it wakes one of those
+ * threads.  A thread that needs to be woken by itself (one waiting
+ * for something specific) should allocate its own wakeup with
+ * sel_alloc_wakeup() and use that.
+ *
+ * This returns ENOSYS if epoll is not being used (including if
+ * io_uring is in use), in that case you have to use signals.
+ */
+typedef struct sel_wakeup_s sel_wakeup_t;
+SEL_DLL_PUBLIC
+int sel_use_wakeup_fds(struct selector_s *sel);
+SEL_DLL_PUBLIC
+sel_wakeup_t *sel_get_wakeup(struct selector_s *sel);
+SEL_DLL_PUBLIC
+int sel_alloc_wakeup(struct selector_s *sel, sel_wakeup_t **new_wakeup);
+SEL_DLL_PUBLIC
+void sel_free_wakeup(sel_wakeup_t *wakeup);
+/* A sel_send_sig_cb, cb_data must be a sel_wakeup_t. */
+SEL_DLL_PUBLIC
+void sel_wakeup_send(long thread_id, void *cb_data);
+
 /*
  * If you fork and expect to use the selector in the forked process,
  * you *must* call this function in the forked process or you may
@@ -573,6 +573,12 @@ gensio_get_user_data(struct gensio *io)
     return io->user_data;
 }
 
+struct gensio_os_funcs *
+gensio_get_os_funcs(struct gensio *io)
+{
+    return io->o;
+}
+
 void
 gensio_set_user_data(struct gensio *io, void *user_data)
 {
@@ -617,6 +623,25 @@ gensio_write_sg(struct gensio *io, gensiods *count,
     return io->func(io, GENSIO_FUNC_WRITE_SG, count, sg, sglen, NULL, auxdata);
 }
 
+int
+gensio_write_zerocopy(struct gensio *io, gensiods *count,
+		      const struct gensio_sg *sg, gensiods sglen,
+		      gensio_done_err done, void *done_data)
+{
+    struct gensio_func_write_zerocopy d;
+
+    if (sglen == 0) {
+	if (count)
+	    *count = 0;
+	return 0;
+    }
+    d.done = done;
+    d.done_data = done_data;
+    d.io = io;
+    return io->func(io, GENSIO_FUNC_WRITE_ZEROCOPY, count, sg, sglen, &d,
+		    NULL);
+}
+
 int
 gensio_raddr_to_str(struct gensio *io, gensiods *pos,
 		    char *buf, gensiods buflen)
@@ -28,6 +28,32 @@ gensio_addr_equal(const struct gensio_addr *a1,
     return a1->funcs->addr_equal(a1, a2, compare_ports, compare_all);
 }
 
+uint32_t
+gensio_addr_hash(const struct gensio_addr *addr,
+		 bool compare_ports, bool compare_all)
+{
+    /* Without a hash function everything hashes the same, still valid. */
+    if (!addr->funcs->addr_hash)
+	return 0;
+    return addr->funcs->addr_hash(addr, compare_ports, compare_all);
+}
+
+/* FNV-1a */
+uint32_t
+gensio_addr_hash_add(uint32_t hash, const void *data, gensiods len)
+{
+    const unsigned char *d = data;
+    gensiods i;
+
+    if (hash == 0)
+	hash = 2166136261U;
+    for (i = 0; i < len; i++) {
+	hash ^= d[i];
+	hash *= 16777619U;
+    }
+    return hash;
+}
+
 int
 gensio_addr_to_str(const struct gensio_addr *addr,
 		   char *buf, gensiods *pos, gensiods buflen)
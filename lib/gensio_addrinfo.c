@@ -418,6 +418,89 @@ sockaddr_equal(const struct sockaddr *a1, socklen_t l1,
     return true;
 }
 
+/*
+ * This must match sockaddr_equal(), so IPv4-mapped IPv6 addresses
+ * hash like the IPv4 address.
+ */
+static uint32_t
+sockaddr_hash(uint32_t hash, const struct sockaddr *a, bool hash_ports)
+{
+    int family = a->sa_family;
+
+    switch (family) {
+    case AF_INET:
+	{
+	    struct sockaddr_in *s = (struct sockaddr_in *) a;
+
+	    hash = gensio_addr_hash_add(hash, &family, sizeof(family));
+	    hash = gensio_addr_hash_add(hash, &s->sin_addr.s_addr,
+					sizeof(s->sin_addr.s_addr));
+	    if (hash_ports)
+		hash = gensio_addr_hash_add(hash, &s->sin_port,
+					    sizeof(s->sin_port));
+	}
+	break;
+
+#ifdef AF_INET6
+    case AF_INET6:
+	{
+	    struct sockaddr_in6 *s = (struct sockaddr_in6 *) a;
+
+	    if (IN6_IS_ADDR_V4MAPPED(&s->sin6_addr)) {
+		family = AF_INET;
+		hash = gensio_addr_hash_add(hash, &family, sizeof(family));
+		hash = gensio_addr_hash_add(hash,
+				((const uint32_t *) &s->sin6_addr) + 3,
+				sizeof(uint32_t));
+	    } else {
+		hash = gensio_addr_hash_add(hash, &family, sizeof(family));
+		hash = gensio_addr_hash_add(hash, s->sin6_addr.s6_addr,
+					    sizeof(s->sin6_addr.s6_addr));
+	    }
+	    if (hash_ports)
+		hash = gensio_addr_hash_add(hash, &s->sin6_port,
+					    sizeof(s->sin6_port));
+	}
+	break;
+#endif
+
+#if HAVE_UNIX
+    case AF_UNIX:
+	{
+	    struct sockaddr_un *s = (struct sockaddr_un *) a;
+
+	    hash = gensio_addr_hash_add(hash, &family, sizeof(family));
+	    hash = gensio_addr_hash_add(hash, s->sun_path,
+					strlen(s->sun_path));
+	}
+	break;
+#endif
+
+    default:
+	/* Unknown families are never equal, anything works. */
+	hash = gensio_addr_hash_add(hash, &family, sizeof(family));
+	break;
+    }
+
+    return hash;
+}
+
+static uint32_t
+gensio_addr_addrinfo_hash(const struct gensio_addr *aa,
+			  bool hash_ports, bool hash_all)
+{
+    struct gensio_addr_addrinfo *a = a_to_info(aa);
+    struct addrinfo *ai;
+    uint32_t hash = 0;
+
+    if (!hash_all)
+	return sockaddr_hash(hash, a->curr->ai_addr, hash_ports);
+
+    for (ai = a->a; ai; ai = ai->ai_next)
+	hash = sockaddr_hash(hash, ai->ai_addr, hash_ports);
+    return hash;
+}
+
 static bool
 gensio_addr_addrinfo_equal(const struct gensio_addr *aa1,
 			   const struct gensio_addr *aa2,
@@ -1217,7 +1300,8 @@ static struct gensio_addr_funcs addrinfo_funcs = {
     .addr_family_supports = gensio_addr_addrinfo_family_supports,
     .addr_getaddr = gensio_addr_addrinfo_getaddr,
     .addr_get_port = gensio_addr_addrinfo_get_port,
-    .addr_get_data = gensio_addr_addrinfo_get_data
+    .addr_get_data = gensio_addr_addrinfo_get_data,
+    .addr_hash = gensio_addr_addrinfo_hash
 };
 
 void
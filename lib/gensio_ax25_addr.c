@@ -155,6 +155,33 @@ ax25_addr_getaddr(const struct gensio_addr *addr, void *oaddr, gensiods *rlen)
     *rlen = sizeof(struct gensio_ax25_addr);
 }
 
+static uint32_t
+ax25_subaddr_hash(uint32_t hash, const struct gensio_ax25_subaddr *a)
+{
+    uint8_t ssid = a->ssid;
+
+    hash = gensio_addr_hash_add(hash, a->addr, strlen(a->addr));
+    return gensio_addr_hash_add(hash, &ssid, sizeof(ssid));
+}
+
+static uint32_t
+ax25_addr_hash(const struct gensio_addr *ia, bool hash_ports, bool hash_all)
+{
+    struct gensio_ax25_addr *a = addr_to_ax25(ia);
+    uint32_t hash = 0;
+    unsigned int i;
+
+    if (hash_ports)
+	hash = gensio_addr_hash_add(hash, &a->tnc_port, sizeof(a->tnc_port));
+    hash = ax25_subaddr_hash(hash, &a->dest);
+    hash = ax25_subaddr_hash(hash, &a->src);
+    if (hash_all) {
+	for (i = 0; i < a->nr_extra; i++)
+	    hash = ax25_subaddr_hash(hash, &a->extra[i]);
+    }
+    return hash;
+}
+
 const static struct gensio_addr_funcs ax25_addr_funcs = {
     .addr_equal = ax25_addr_equal,
     .addr_to_str = ax25_addr_to_str,
@@ -167,7 +194,8 @@ const static struct gensio_addr_funcs ax25_addr_funcs = {
     .addr_rewind = ax25_addr_rewind,
     .addr_get_nettype = ax25_addr_get_nettype,
     .addr_family_supports = ax25_addr_family_supports,
-    .addr_getaddr = ax25_addr_getaddr
+    .addr_getaddr = ax25_addr_getaddr,
+    .addr_hash = ax25_addr_hash
 };
 
 int
@@ -156,6 +156,7 @@ struct basen_data {
     struct gensio_timer *timer;
     bool timer_start_pending;
     gensio_time pending_timer;
+    gensio_time pending_slack;
 
     unsigned int refcount;
 
@@ -309,9 +310,17 @@ i_basen_deref_and_unlock(struct basen_data *ndata, int line)
 #define basen_deref_and_unlock(ndata) i_basen_deref_and_unlock((ndata), __LINE__)
 
 static void
-basen_start_timer(struct basen_data *ndata, gensio_time *timeout)
+basen_start_timer(struct basen_data *ndata, gensio_time *timeout,
+		  gensio_time *slack)
 {
-    if (ndata->o->start_timer(ndata->timer, timeout) == 0)
+    int rv;
+
+    if (slack)
+	rv = gensio_os_funcs_start_timer_slack(ndata->o, ndata->timer,
+					       timeout, slack);
+    else
+	rv = ndata->o->start_timer(ndata->timer, timeout);
+    if (rv == 0)
 	basen_ref(ndata);
 }
 
@@ -630,6 +639,24 @@ basen_write_data_handler(void *cb_data, gensiods *rcount,
     return rv;
 }
 
+static int
+basen_write_zerocopy(struct basen_data *ndata, gensiods *rcount,
+		     const struct gensio_sg *sg, gensiods sglen,
+		     struct gensio_func_write_zerocopy *zc)
+{
+    int rv;
+    gensiods i, total = 0, count = 0;
+
+    for (i = 0; i < sglen; i++)
+	total += sg[i].buflen;
+    rv = gensio_ll_write_zerocopy(ndata->ll, &count, sg, sglen, zc);
+    if (!rv && count < total)
+	ndata->ll_can_write = false;
+    if (rcount)
+	*rcount = count;
+    return rv;
+}
+
 static int
 basen_filter_ul_push(struct basen_data *ndata, bool check_open_close)
 {
@@ -659,7 +686,8 @@ write_data_pending(struct basen_data *ndata)
 static int
 basen_write(struct basen_data *ndata, gensiods *rcount,
 	    const struct gensio_sg *sg, gensiods sglen,
-	    const char *const *auxdata)
+	    const char *const *auxdata,
+	    struct gensio_func_write_zerocopy *zc)
 {
     int err = 0;
 
@@ -674,11 +702,18 @@ basen_write(struct basen_data *ndata, gensiods *rcount,
     }
     ndata->in_write_count++;
 
-    err = filter_ul_write(ndata, basen_write_data_handler, rcount, sg, sglen,
-			  auxdata);
+    if (zc)
+	err = basen_write_zerocopy(ndata, rcount, sg, sglen, zc);
+    else
+	err = filter_ul_write(ndata, basen_write_data_handler, rcount,
+			      sg, sglen, auxdata);
 
     ndata->in_write_count--;
-    if (err)
+    /*
+     * GE_NOTSUP and GE_NOMEM from a zero-copy write are not I/O
+     * errors, the user can do a normal write.
+     */
+    if (err && !(zc && (err == GE_NOTSUP || err == GE_NOMEM)))
 	handle_ioerr(ndata, err);
 
     /*
@@ -935,7 +970,8 @@ basen_finish_open(struct basen_data *ndata, int err)
 	assert(ndata->state == BASEN_IN_FILTER_OPEN || ndata->state == BASEN_OPEN);
 	basen_set_state(ndata, BASEN_OPEN);
 	if (ndata->timer_start_pending)
-	    basen_start_timer(ndata, &ndata->pending_timer);
+	    basen_start_timer(ndata, &ndata->pending_timer,
+			      &ndata->pending_slack);
     }
 
     open_done = ndata->open_done;
@@ -1103,7 +1139,7 @@ basen_filter_try_connect(struct basen_data *ndata, bool was_timeout)
 	return GE_INPROGRESS;
     basen_stop_timer(ndata);
     if (err == GE_RETRY) {
-	basen_start_timer(ndata, &timeout);
+	basen_start_timer(ndata, &timeout, NULL);
 	return GE_INPROGRESS;
     }
 
@@ -1285,7 +1321,7 @@ basen_filter_try_close(struct basen_data *ndata, bool was_timeout)
 	return;
     if (err == GE_RETRY) {
 	basen_stop_timer(ndata);
-	basen_start_timer(ndata, &timeout);
+	basen_start_timer(ndata, &timeout, NULL);
 	return;
     }
 
@@ -1508,7 +1544,13 @@ gensio_base_func(struct gensio *io, int func, gensiods *count,
 
     switch (func) {
     case GENSIO_FUNC_WRITE_SG:
-	return basen_write(ndata, count, cbuf, buflen, auxdata);
+	return basen_write(ndata, count, cbuf, buflen, auxdata, NULL);
+
+    case GENSIO_FUNC_WRITE_ZEROCOPY:
+	/* A filter may hang on to the data, so only straight to the ll. */
+	if (ndata->filter)
+	    return GE_NOTSUP;
+	return basen_write(ndata, count, cbuf, buflen, NULL, buf);
 
     case GENSIO_FUNC_OPEN:
 	return basen_open(ndata, (void *) cbuf, buf);
@@ -1558,6 +1600,12 @@ gensio_base_func(struct gensio *io, int func, gensiods *count,
 	    return rv;
 	return rv2;
 
+    case GENSIO_FUNC_GET_LL:
+	if (ndata->filter)
+	    return GE_NOTSUP;
+	*((struct gensio_ll **) buf) = ndata->ll;
+	return 0;
+
     case GENSIO_FUNC_DISABLE:
 	if (ndata->state != BASEN_CLOSED) {
 	    basen_set_state(ndata, BASEN_CLOSED);
@@ -1792,15 +1840,21 @@ basen_output_ready(void *cb_data)
 }
 
 static void
-basen_start_timer_op(void *cb_data, gensio_time *timeout)
+basen_start_timer_op(void *cb_data, gensio_time *timeout, gensio_time *slack)
 {
     struct basen_data *ndata = cb_data;
 
     if (ndata->state == BASEN_OPEN || ndata->state == BASEN_CLOSE_WAIT_DRAIN) {
-	basen_start_timer(ndata, timeout);
+	basen_start_timer(ndata, timeout, slack);
     } else {
 	ndata->timer_start_pending = true;
 	ndata->pending_timer = *timeout;
+	if (slack) {
+	    ndata->pending_slack = *slack;
+	} else {
+	    ndata->pending_slack.secs = 0;
+	    ndata->pending_slack.nsecs = 0;
+	}
     }
 }
 
@@ -1854,9 +1908,16 @@ gensio_base_filter_cb(void *cb_data, int op, void *data)
 	return 0;
 
     case GENSIO_FILTER_CB_START_TIMER:
-	basen_start_timer_op(cb_data, data);
+	basen_start_timer_op(cb_data, data, NULL);
 	return 0;
 
+    case GENSIO_FILTER_CB_START_TIMER_SLACK: {
+	struct gensio_filter_cb_timer_slack_data *tdata = data;
+
+	basen_start_timer_op(cb_data, tdata->timeout, tdata->slack);
+	return 0;
+    }
+
     case GENSIO_FILTER_CB_STOP_TIMER:
 	basen_stop_timer_op(cb_data);
 	return 0;
@@ -2254,6 +2315,15 @@ gensio_ll_write(struct gensio_ll *ll, gensiods *rcount,
 		    auxdata);
 }
 
+int
+gensio_ll_write_zerocopy(struct gensio_ll *ll, gensiods *rcount,
+			 const struct gensio_sg *sg, gensiods sglen,
+			 struct gensio_func_write_zerocopy *zc)
+{
+    return ll->func(ll, GENSIO_LL_FUNC_WRITE_ZEROCOPY, rcount, zc, sg, sglen,
+		    NULL);
+}
+
 int
 gensio_ll_open(struct gensio_ll *ll,
 	       gensio_ll_open_done done, void *open_data)
@@ -2312,6 +2382,12 @@ gensio_ll_acontrol(struct gensio_ll *ll, bool get, int option,
 		    option, NULL);
 }
 
+int
+gensio_ll_set_relay(struct gensio_ll *ll, struct gensio_ll_relay_hook *hook)
+{
+    return ll->func(ll, GENSIO_LL_FUNC_SET_RELAY, NULL, hook, NULL, 0, NULL);
+}
+
 int
 gensio_ll_do_event(struct gensio_ll *ll, int event, int err,
 		   unsigned char *buf, gensiods *buflen,
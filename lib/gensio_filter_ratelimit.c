@@ -24,13 +24,19 @@ struct ratelimit_filter {
     gensio_filter_cb filter_cb;
     void *filter_cb_data;
 
+    /* Maximum number of bytes to send at each interval. */
     gensiods xmit_buf_len;
-    unsigned char *xmit_buf;
     gensio_time delay;
 
     bool xmit_ready;
 };
 
+/*
+ * Maximum number of user buffers passed down in one write.  The user's
+ * buffers are handed to the lower layer directly, not copied.
+ */
+#define RATELIMIT_MAX_SG 16
+
 #define filter_to_ratelimit(v) ((struct ratelimit_filter *) \
 				gensio_filter_get_user_data(v))
 
@@ -114,26 +120,29 @@ ratelimit_ul_write(struct ratelimit_filter *rfilter,
 		   const struct gensio_sg *sg, gensiods sglen,
 		   const char *const *auxdata)
 {
-    gensiods i, count = 0;
-    struct gensio_sg xsg;
+    gensiods i, xsglen = 0, count = 0;
+    struct gensio_sg xsg[RATELIMIT_MAX_SG];
     int err = 0;
 
     ratelimit_lock(rfilter);
     if (!rfilter->xmit_ready)
 	goto out;
-    for (i = 0; i < sglen && count < rfilter->xmit_buf_len; i++) {
+    for (i = 0; i < sglen && count < rfilter->xmit_buf_len &&
+		xsglen < RATELIMIT_MAX_SG; i++) {
 	gensiods len = sg[i].buflen;
 
+	if (len == 0)
+	    continue;
 	if (len > rfilter->xmit_buf_len - count)
 	    len = rfilter->xmit_buf_len - count;
 
-	memcpy(rfilter->xmit_buf + count, sg[i].buf, len);
+	xsg[xsglen].buf = sg[i].buf;
+	xsg[xsglen].buflen = len;
+	xsglen++;
 	count += len;
     }
-    xsg.buf = rfilter->xmit_buf;
-    xsg.buflen = count;
     ratelimit_unlock(rfilter);
-    err = handler(cb_data, &count, &xsg, 1, auxdata);
+    err = handler(cb_data, &count, xsg, xsglen, auxdata);
     ratelimit_lock(rfilter);
     if (!err && count > 0) {
 	rfilter->xmit_ready = false;
@@ -174,8 +183,6 @@ ratelimit_free(struct ratelimit_filter *rfilter)
 
     if (rfilter->lock)
 	o->free_lock(rfilter->lock);
-    if (rfilter->xmit_buf)
-	o->free(o, rfilter->xmit_buf);
     if (rfilter->filter)
 	gensio_filter_free_data(rfilter->filter);
     o->free(o, rfilter);
@@ -269,10 +276,6 @@ gensio_ratelimit_filter_raw_alloc(struct gensio_os_funcs *o,
     rfilter->xmit_buf_len = xmit_size;
     rfilter->delay = xmit_delay;
 
-    rfilter->xmit_buf = o->zalloc(o, xmit_size);
-    if (!rfilter->xmit_buf)
-	goto out_nomem;
-
     rfilter->lock = o->alloc_lock(o);
     if (!rfilter->lock)
 	goto out_nomem;
@@ -11,6 +11,7 @@
 
 #include <gensio/gensio.h>
 #include <gensio/gensio_class.h>
+#include <gensio/gensio_time.h>
 
 #include "gensio_filter_relpkt.h"
 #if 0
@@ -310,6 +311,15 @@ struct relpkt_filter {
     unsigned int max_timeouts;
     uint8_t last_timeout_ack; /* next_acked_seq on the last timeout. */
     unsigned int timeout_ack_count; /* nr timeouts last_timeout_ack same. */
+
+    /*
+     * Bytes in received packets waiting for the user plus sent
+     * packets waiting for an ack, charged to the os funcs memory
+     * budget.  A packet is charged before it is queued.  If that
+     * fails at the hard limit, a user write fails with GE_MEMLIMIT and
+     * a received packet is dropped, the sender will resend it.
+     */
+    gensiods mem_used;
 };
 
 #define filter_to_relpkt(v) ((struct relpkt_filter *) \
@@ -457,6 +467,8 @@ handle_ack(struct relpkt_filter *rfilter, uint8_t seq)
 	    assert(rfilter->nr_waiting_xmitpkt > 0);
 	    rfilter->nr_waiting_xmitpkt--;
 	}
+	gensio_os_mem_uncharge(rfilter->o, &rfilter->mem_used,
+			       rfilter->xmitpkts[pos].len);
 	rfilter->first_xmitpkt = xmitpkt_pos(rfilter, 1);
 	rfilter->next_acked_seq++;
     }
@@ -468,8 +480,15 @@ handle_ack(struct relpkt_filter *rfilter, uint8_t seq)
 static void
 relpkt_filter_start_timer(struct relpkt_filter *rfilter)
 {
+    struct gensio_filter_cb_timer_slack_data tdata;
+    gensio_time slack;
+
+    /* Retransmits don't need to be exact, let them be a little late. */
+    gensio_usecs_to_time(&slack, gensio_time_to_usecs(&rfilter->timeout) / 8);
+    tdata.timeout = &rfilter->timeout;
+    tdata.slack = &slack;
     rfilter->filter_cb(rfilter->filter_cb_data,
-		       GENSIO_FILTER_CB_START_TIMER, &rfilter->timeout);
+		       GENSIO_FILTER_CB_START_TIMER_SLACK, &tdata);
 }
 
 static void
@@ -719,6 +738,15 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 	    if (p->len == rfilter->max_xmit_pktsize)
 		break;
 	}
+	if (writelen > 0) {
+	    err = gensio_os_mem_charge(rfilter->o, &rfilter->mem_used,
+				       p->len + 3);
+	    if (err) {
+		if (rcount)
+		    *rcount = 0;
+		goto out_unlock;
+	    }
+	}
 	if (rcount)
 	    *rcount = writelen;
 
@@ -806,6 +834,7 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 	    }
 	}
     }
+ out_unlock:
     relpkt_unlock(rfilter);
 
     return err;
@@ -944,6 +973,12 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 	    if ((uint8_t) (seq - rfilter->next_deliver_seq) > rfilter->max_pkt)
 		break; /* Ignore it */
 	    ppos = recvpkt_pos(rfilter, pos);
+	    p = &(rfilter->recvpkts[ppos]);
+	    if (!p->ready && gensio_os_mem_charge(rfilter->o,
+						  &rfilter->mem_used,
+						  buflen - 3))
+		/* Over the hard memory limit, the sender will resend it. */
+		break;
 	    if (seq == rfilter->next_expected_seq) {
 		rfilter->next_expected_seq++;
 	    } else if (!seq_inside(seq, rfilter->next_deliver_seq,
@@ -951,7 +986,6 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 		request_resend(rfilter, rfilter->next_expected_seq, seq - 1);
 		rfilter->next_expected_seq = seq + 1;
 	    }
-	    p = &(rfilter->recvpkts[ppos]);
 	    if (!p->ready) {
 		memcpy(p->data, buf + 3, buflen - 3);
 		p->len = buflen - 3;
@@ -1048,6 +1082,7 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 	if (!err) {
 	    if (count >= (uint16_t) (p->len - p->start)) {
 		p->ready = false;
+		gensio_os_mem_uncharge(rfilter->o, &rfilter->mem_used, p->len);
 		rfilter->deliver_recvpkt = recvpkt_pos(rfilter, 1);
 		rfilter->next_deliver_seq++;
 		send_ack(rfilter);
@@ -1099,6 +1134,7 @@ relpkt_filter_cleanup(struct relpkt_filter *rfilter)
 
 	p->ready = false;
     }
+    gensio_os_mem_uncharge(rfilter->o, &rfilter->mem_used, rfilter->mem_used);
 }
 
 static void
@@ -1124,6 +1160,7 @@ relpkt_free(struct relpkt_filter *rfilter)
 	}
 	o->free(o, rfilter->xmitpkts);
     }
+    gensio_os_mem_uncharge(o, &rfilter->mem_used, rfilter->mem_used);
     if (rfilter->filter)
 	gensio_filter_free_data(rfilter->filter);
     rfilter->o->free(rfilter->o, rfilter);
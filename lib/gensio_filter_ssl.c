@@ -98,17 +98,24 @@ struct ssl_filter {
     /*
      * This is data from the user waiting to be sent to SSL_write().  This
      * is required because if SSL_write() return that it needs I/O, it must
-     * be called again with exactly the same data.
+     * be called again with exactly the same data.  Data is only copied
+     * here if it can't be passed to SSL_write() directly.
      */
     unsigned char *write_data;
     gensiods max_write_size;
     gensiods write_data_len;
 
-    /* This is data from BIO_read() waiting to be sent to the lower layer. */
-    unsigned char *xmit_buf;
-    gensiods xmit_buf_pos;
+    /*
+     * Data held in read_data, write_data and the BIO pair, charged
+     * to the os funcs memory budget, see ssl_update_mem().
+     */
+    gensiods mem_used;
+
+    /*
+     * Encrypted data at the front of io_bio that is being sent to the
+     * lower layer.  It is sent straight from the BIO's buffer.
+     */
     gensiods xmit_buf_len;
-    gensiods max_xmit_buf;
 
     /*
      * SSL has asked for something.
@@ -471,6 +478,30 @@ ssl_try_disconnect(struct gensio_filter *filter, gensio_time *timeout)
     return rv;
 }
 
+/*
+ * Charge what is actually queued in the filter to the memory budget:
+ * decrypted data waiting for the user, user data waiting for
+ * SSL_write(), and encrypted data in either direction of the BIO
+ * pair.  The buffers themselves are not charged, an idle connection
+ * costs nothing.  Must be called with the lock held.
+ */
+static int
+ssl_update_mem(struct ssl_filter *sfilter)
+{
+    gensiods used = sfilter->read_data_len + sfilter->write_data_len;
+
+    if (sfilter->io_bio)
+	used += (BIO_ctrl_pending(sfilter->io_bio) +
+		 BIO_ctrl_wpending(sfilter->io_bio));
+    if (used > sfilter->mem_used)
+	return gensio_os_mem_charge(sfilter->o, &sfilter->mem_used,
+				    used - sfilter->mem_used);
+    if (used < sfilter->mem_used)
+	gensio_os_mem_uncharge(sfilter->o, &sfilter->mem_used,
+			       sfilter->mem_used - used);
+    return 0;
+}
+
 static int
 ssl_ul_write(struct gensio_filter *filter,
 	     gensio_ul_filter_data_handler handler, void *cb_data,
@@ -480,7 +511,10 @@ ssl_ul_write(struct gensio_filter *filter,
 {
     struct ssl_filter *sfilter = filter_to_ssl(filter);
     int err = 0;
-    gensiods i;
+    gensiods i, nbufs = 0;
+    const unsigned char *direct = NULL;
+    gensiods direct_len = 0;
+    char *bdata;
 
     ssl_lock(sfilter);
     if (sfilter->err) {
@@ -506,40 +540,78 @@ ssl_ul_write(struct gensio_filter *filter,
 	    *rcount = 0;
     } else {
 	for (i = 0; i < sglen; i++) {
-	    gensiods buflen = isg[i].buflen;
-
-	    if (buflen > sfilter->max_write_size - sfilter->write_data_len)
-		buflen = sfilter->max_write_size - sfilter->write_data_len;
-	    memcpy(sfilter->write_data + sfilter->write_data_len,
-		   isg[i].buf, buflen);
-	    sfilter->write_data_len += buflen;
+	    if (isg[i].buflen) {
+		nbufs++;
+		direct = isg[i].buf;
+		direct_len = isg[i].buflen;
+	    }
+	}
+	if (nbufs == 1) {
+	    /*
+	     * The data is all in one buffer, try to give it straight
+	     * to SSL_write() below and only copy it if we have to.
+	     */
+	    if (direct_len > sfilter->max_write_size)
+		direct_len = sfilter->max_write_size;
+	    if (rcount)
+		*rcount = direct_len;
+	} else {
+	    direct = NULL;
+	    for (i = 0; i < sglen; i++) {
+		gensiods buflen = isg[i].buflen;
+
+		if (buflen > sfilter->max_write_size - sfilter->write_data_len)
+		    buflen = sfilter->max_write_size - sfilter->write_data_len;
+		memcpy(sfilter->write_data + sfilter->write_data_len,
+		       isg[i].buf, buflen);
+		sfilter->write_data_len += buflen;
+	    }
+	    if (rcount)
+		*rcount = sfilter->write_data_len;
 	}
-	if (rcount)
-	    *rcount = sfilter->write_data_len;
     }
 
  restart:
     if (sfilter->xmit_buf_len) {
 	gensiods written;
-	struct gensio_sg sg = { sfilter->xmit_buf + sfilter->xmit_buf_pos,
-				sfilter->xmit_buf_len - sfilter->xmit_buf_pos };
+	struct gensio_sg sg;
 
+	/* The data is still at the front of the BIO. */
+	BIO_nread0(sfilter->io_bio, &bdata);
+	sg.buf = bdata;
+	sg.buflen = sfilter->xmit_buf_len;
 	err = handler(cb_data, &written, &sg, 1, NULL);
 	if (err) {
 	    sfilter->xmit_buf_len = 0;
 	    sfilter->write_data_len = 0;
+	    direct = NULL;
 	} else {
-	    sfilter->xmit_buf_pos += written;
-	    if (sfilter->xmit_buf_pos >= sfilter->xmit_buf_len)
-		sfilter->xmit_buf_len = 0;
+	    if (written > sfilter->xmit_buf_len)
+		written = sfilter->xmit_buf_len;
+	    BIO_nread(sfilter->io_bio, &bdata, written);
+	    sfilter->xmit_buf_len -= written;
 	}
     }
 
-    if (!err && sfilter->xmit_buf_len == 0 && sfilter->write_data_len > 0) {
+    if (direct && sfilter->xmit_buf_len) {
+	/* Can't write it now, we have to hold on to it. */
+	memcpy(sfilter->write_data, direct, direct_len);
+	sfilter->write_data_len = direct_len;
+	direct = NULL;
+    }
+
+    if (!err && sfilter->xmit_buf_len == 0 &&
+		(direct || sfilter->write_data_len > 0)) {
+	const unsigned char *wdata = sfilter->write_data;
+	gensiods wlen = sfilter->write_data_len;
+
+	if (direct) {
+	    wdata = direct;
+	    wlen = direct_len;
+	}
 	sfilter->want_read = false;
 	sfilter->want_write = false;
-	err = SSL_write(sfilter->ssl, sfilter->write_data,
-			sfilter->write_data_len);
+	err = SSL_write(sfilter->ssl, wdata, wlen);
 	if (err <= 0) {
 	    err = SSL_get_error(sfilter->ssl, err);
 	    switch (err) {
@@ -569,16 +641,21 @@ ssl_ul_write(struct gensio_filter *filter,
 		err = GE_COMMERR;
 		sfilter->write_data_len = 0;
 	    }
+	    if (direct && (sfilter->want_read || sfilter->want_write)) {
+		/* SSL_write() has to be retried with the same data. */
+		memcpy(sfilter->write_data, direct, direct_len);
+		sfilter->write_data_len = direct_len;
+	    }
 	} else {
-	    assert((gensiods) err == sfilter->write_data_len);
+	    assert((gensiods) err == wlen);
 	    sfilter->write_data_len = 0;
 	    err = 0;
 	}
+	direct = NULL;
     }
 
     if (!err && sfilter->xmit_buf_len == 0) {
-	int rdlen = BIO_read(sfilter->io_bio, sfilter->xmit_buf,
-			     sfilter->max_xmit_buf);
+	int rdlen = BIO_nread0(sfilter->io_bio, &bdata);
 
 	if (rdlen <= 0) {
 	    if (!BIO_should_retry(sfilter->io_bio)) {
@@ -587,10 +664,11 @@ ssl_ul_write(struct gensio_filter *filter,
 	    }
 	} else {
 	    sfilter->xmit_buf_len = rdlen;
-	    sfilter->xmit_buf_pos = 0;
 	    goto restart;
 	}
     }
+    if (!err)
+	err = ssl_update_mem(sfilter);
     if (err)
 	sfilter->err = err;
  out_unlock:
@@ -714,6 +792,8 @@ ssl_ll_write(struct gensio_filter *filter,
 	    }
 	}
     }
+    if (!err)
+	err = ssl_update_mem(sfilter);
     if (err && !sfilter->err)
 	sfilter->err = err;
  out_unlock:
@@ -727,16 +807,28 @@ ssl_setup(struct gensio_filter *filter, struct gensio *io)
 {
     struct ssl_filter *sfilter = filter_to_ssl(filter);
     int success;
-    gensiods bio_size = sfilter->max_read_size * 2;
+    gensiods bio_size = sfilter->max_read_size * 2, xmit_size;
 
     sfilter->ssl = SSL_new(sfilter->ctx);
     if (!sfilter->ssl)
 	return GE_NOMEM;
 
+    /*
+     * Data written to the lower layer is sent straight from the BIO,
+     * so SSL_write() may be given a different buffer on a retry.
+     */
+    SSL_set_mode(sfilter->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
     /* The BIO has to be large enough to hold a full SSL key transaction. */
     if (bio_size < 4096)
 	bio_size = 4096;
-    success = BIO_new_bio_pair(&sfilter->ssl_bio, bio_size,
+
+    /*
+     * Encrypted data waits in the BIO until the lower layer takes it,
+     * leave room for a full record on top of that.
+     */
+    xmit_size = bio_size + sfilter->max_write_size + 128;
+    success = BIO_new_bio_pair(&sfilter->ssl_bio, xmit_size,
 			       &sfilter->io_bio, bio_size);
     if (!success) {
 	SSL_free(sfilter->ssl);
@@ -777,8 +869,8 @@ ssl_cleanup(struct gensio_filter *filter)
     sfilter->read_data_len = 0;
     sfilter->read_data_pos = 0;
     sfilter->xmit_buf_len = 0;
-    sfilter->xmit_buf_pos = 0;
     sfilter->write_data_len = 0;
+    ssl_update_mem(sfilter);
     sfilter->connected = false;
     sfilter->shutdown_success = false;
 }
@@ -803,10 +895,9 @@ sfilter_free(struct ssl_filter *sfilter)
 	memset(sfilter->read_data, 0, sfilter->max_read_size);
 	sfilter->o->free(sfilter->o, sfilter->read_data);
     }
-    if (sfilter->xmit_buf)
-	sfilter->o->free(sfilter->o, sfilter->xmit_buf);
     if (sfilter->write_data)
 	sfilter->o->free(sfilter->o, sfilter->write_data);
+    gensio_os_mem_uncharge(sfilter->o, &sfilter->mem_used, sfilter->mem_used);
     if (sfilter->filter)
 	gensio_filter_free_data(sfilter->filter);
     sfilter->o->free(sfilter->o, sfilter);
@@ -1016,6 +1107,13 @@ ssl_filter_control(struct gensio_filter *filter, bool get, int op, char *data,
 			    (unsigned long) sfilter->max_write_size);
 	return 0;
 
+    case GENSIO_CONTROL_MEM_USAGE:
+	if (!get)
+	    return GE_NOTSUP;
+	*datalen = snprintf(data, *datalen, "%lu",
+			    (unsigned long) sfilter->mem_used);
+	return 0;
+
     default:
 	return GE_NOTSUP;
     }
@@ -1188,13 +1286,6 @@ gensio_ssl_filter_raw_alloc(struct gensio_os_funcs *o,
     if (!sfilter->write_data)
 	goto out_nomem;
 
-    sfilter->max_xmit_buf = sfilter->max_write_size + 128;
-    if (sfilter->max_xmit_buf < 1024)
-	sfilter->max_xmit_buf = 1024; /* Enough room for the protocol. */
-    sfilter->xmit_buf = o->zalloc(o, sfilter->max_xmit_buf);
-    if (!sfilter->xmit_buf)
-	goto out_nomem;
-
     sfilter->filter = gensio_filter_alloc_data(o, gensio_ssl_filter_func,
 					       sfilter);
     if (!sfilter->filter)
@@ -207,6 +207,22 @@ telnet_buffer_do_write(void *cb_data, void *buf, unsigned int buflen,
     return err;
 }
 
+/*
+ * User data with no IACs in it goes out unchanged and can be split
+ * anywhere, so it doesn't need to be staged in write_data.
+ */
+static bool
+telnet_sg_has_iac(const struct gensio_sg *sg, gensiods sglen)
+{
+    gensiods i;
+
+    for (i = 0; i < sglen; i++) {
+	if (memchr(sg[i].buf, TN_IAC, sg[i].buflen))
+	    return true;
+    }
+    return false;
+}
+
 static int
 telnet_ul_write(struct gensio_filter *filter,
 		gensio_ul_filter_data_handler handler, void *cb_data,
@@ -221,6 +237,18 @@ telnet_ul_write(struct gensio_filter *filter,
     if (tfilter->write_data_len) {
 	if (rcount)
 	    *rcount = 0;
+    } else if (sglen && tfilter->write_state == TELNET_NOT_WRITING &&
+	       !gensio_buffer_cursize(&tfilter->tn_data.out_telnet_cmd) &&
+	       !telnet_sg_has_iac(isg, sglen)) {
+	gensiods count = 0;
+
+	err = handler(cb_data, &count, isg, sglen, auxdata);
+	if (err)
+	    telnet_clear_write(tfilter);
+	else if (rcount)
+	    *rcount = count;
+	telnet_unlock(tfilter);
+	return err;
     } else {
 	gensiods i, writelen = 0;
 
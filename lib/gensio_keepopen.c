@@ -17,6 +17,7 @@
 #include <gensio/gensio.h>
 #include <gensio/gensio_os_funcs.h>
 #include <gensio/gensio_class.h>
+#include <gensio/gensio_time.h>
 #include <gensio/argvutils.h>
 
 /*
@@ -243,8 +244,13 @@ keepn_start_zero_timer(struct keepn_data *ndata)
 static void
 keepn_start_timer(struct keepn_data *ndata)
 {
+    gensio_time slack;
+
+    /* The retry time is not critical, let it be a bit late. */
+    gensio_usecs_to_time(&slack, gensio_time_to_usecs(&ndata->retry_time) / 4);
     keepn_ref(ndata);
-    if (ndata->o->start_timer(ndata->retry_timer, &ndata->retry_time) != 0)
+    if (gensio_os_funcs_start_timer_slack(ndata->o, ndata->retry_timer,
+					  &ndata->retry_time, &slack) != 0)
 	assert(0);
 }
 
@@ -618,6 +624,21 @@ keepn_gensio_func(struct gensio *io, int func, gensiods *count,
 	}
 	return 0;
 
+    case GENSIO_FUNC_WRITE_ZEROCOPY:
+	err = gensio_call_func(ndata->child,
+			       func, count, cbuf, buflen, buf, auxdata);
+	if (err && err != GE_NOTSUP && err != GE_NOMEM) {
+	    /*
+	     * Nothing was taken, so there will be no done call.  Have
+	     * the user wait, there's no way to discard here.
+	     */
+	    keepn_handle_io_err(ndata, err);
+	    if (count)
+		*count = 0;
+	    err = 0;
+	}
+	return err;
+
     case GENSIO_FUNC_OPEN:
 	return keepn_open(io, (void *) cbuf, buf);
 
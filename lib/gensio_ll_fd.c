@@ -8,11 +8,14 @@
 #include "config.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <gensio/gensio_os_funcs.h>
 #include <gensio/gensio_class.h>
 #include <gensio/gensio_err.h>
+#include <gensio/gensio_control.h>
 #include <gensio/gensio_ll_fd.h>
+#include <gensio/gensio_list.h>
 
 enum fd_state {
     /*
@@ -129,12 +132,28 @@ struct fd_ll {
     bool close_requested;
     bool freed;
 
+    /*
+     * If read_pool is set, read_data is only held while there is
+     * data pending, see fd_read_pool.
+     */
+    struct fd_read_pool *read_pool;
     unsigned char *read_data;
     gensiods read_data_size;
     gensiods read_data_len;
     gensiods read_data_pos;
     const char *const *auxdata;
 
+    /*
+     * Bytes charged against the os funcs memory budget.  If the
+     * budget is over its soft limit when a read buffer is needed,
+     * reading stops and mem_waiter restarts it through mem_runner
+     * when the budget goes back down.
+     */
+    gensiods mem_used;
+    struct gensio_os_mem_waiter mem_waiter;
+    struct gensio_runner *mem_runner;
+    bool mem_wait;
+
     bool in_read;
     bool in_write;
 
@@ -150,28 +169,264 @@ struct fd_ll {
     bool deferred_close;
     bool deferred_except;
 
+    /*
+     * If set, a relay owns the iod and gets the read/write ready
+     * calls, see gensio_ll_set_relay().
+     */
+    struct gensio_ll_relay_hook *relay;
+
+    /*
+     * Zero-copy writes the kernel may still be using the data of, see
+     * fd_write_zerocopy().  zc_next is the number the kernel will give
+     * the next zero-copy send.  zc_on is set once zero-copy has been
+     * enabled on the socket, zc_failed if the socket can't do it.
+     */
+    struct gensio_list zc_writes;
+    uint32_t zc_next;
+    bool zc_on;
+    bool zc_failed;
+
 #ifdef DEBUG_STATE
     struct fd_state_trace trace[STATE_TRACE_LEN];
     unsigned int trace_pos;
 #endif
 };
 
+/* A zero-copy write waiting for the kernel to be done with the data. */
+struct fd_zc_write {
+    struct gensio_link link;
+    uint32_t num;
+    struct gensio *io;
+    gensio_done_err done;
+    void *done_data;
+};
+
 #define ll_to_fd(v) ((struct fd_ll *) gensio_ll_get_user_data(v))
 
+/*
+ * Read buffers are shared by all the fd lls on the same os funcs with
+ * the same read size.  An fd ll only takes a buffer from the pool when
+ * it reads data and gives it back when the data has been delivered, so
+ * idle connections don't hold any buffer.  Up to FD_READ_POOL_MAX free
+ * buffers are kept, and the pool is freed when its last user goes
+ * away.
+ */
+#define FD_READ_POOL_MAX 64
+
+struct fd_read_buf {
+    struct fd_read_buf *next;
+};
+
+struct fd_read_pool {
+    struct gensio_link link;
+    struct gensio_os_funcs *o;
+    gensiods size;
+    unsigned int refcount;
+    struct gensio_lock *lock;
+    struct fd_read_buf *free;
+    unsigned int nfree;
+};
+
+/*
+ * The pool list is shared by all the os funcs.  Like the other
+ * global data in gensio, its lock comes from the first os funcs to
+ * use it, which is held until gensio_cleanup_mem() is called.
+ */
+static struct gensio_once fd_read_pools_initialized;
+static struct gensio_os_funcs *fd_read_pools_o;
+static struct gensio_lock *fd_read_pools_lock;
+static int fd_read_pools_init_rv;
+static struct gensio_list fd_read_pools;
+
+static void
+fd_read_pools_cleanup_mem(void)
+{
+    if (fd_read_pools_lock)
+	fd_read_pools_o->free_lock(fd_read_pools_lock);
+    fd_read_pools_lock = NULL;
+    if (fd_read_pools_o)
+	fd_read_pools_o->free_funcs(fd_read_pools_o);
+    fd_read_pools_o = NULL;
+    fd_read_pools_init_rv = 0;
+    memset(&fd_read_pools_initialized, 0, sizeof(fd_read_pools_initialized));
+}
+
+static struct gensio_class_cleanup fd_read_pools_cleanup = {
+    fd_read_pools_cleanup_mem
+};
+
+static void
+fd_read_pools_init(void *cb_data)
+{
+    struct gensio_os_funcs *o = cb_data;
+
+    gensio_list_init(&fd_read_pools);
+    fd_read_pools_lock = o->alloc_lock(o);
+    if (!fd_read_pools_lock) {
+	fd_read_pools_init_rv = GE_NOMEM;
+	return;
+    }
+    o->get_funcs(o);
+    fd_read_pools_o = o;
+    gensio_register_class_cleanup(&fd_read_pools_cleanup);
+}
+
+static void
+fd_read_pool_free(struct fd_read_pool *pool)
+{
+    struct gensio_os_funcs *o = pool->o;
+    struct fd_read_buf *b;
+
+    while (pool->free) {
+	b = pool->free;
+	pool->free = b->next;
+	o->free(o, b);
+    }
+    o->free_lock(pool->lock);
+    o->free(o, pool);
+}
+
+static struct fd_read_pool *
+fd_read_pool_get(struct gensio_os_funcs *o, gensiods size)
+{
+    struct fd_read_pool *pool;
+    struct gensio_link *l;
+
+    o->call_once(o, &fd_read_pools_initialized, fd_read_pools_init, o);
+    if (fd_read_pools_init_rv)
+	return NULL;
+
+    fd_read_pools_o->lock(fd_read_pools_lock);
+    gensio_list_for_each(&fd_read_pools, l) {
+	pool = gensio_container_of(l, struct fd_read_pool, link);
+
+	if (pool->o == o && pool->size == size) {
+	    pool->refcount++;
+	    goto out_unlock;
+	}
+    }
+
+    pool = o->zalloc(o, sizeof(*pool));
+    if (!pool)
+	goto out_unlock;
+    pool->lock = o->alloc_lock(o);
+    if (!pool->lock) {
+	o->free(o, pool);
+	pool = NULL;
+	goto out_unlock;
+    }
+    pool->o = o;
+    pool->size = size;
+    pool->refcount = 1;
+    gensio_list_add_tail(&fd_read_pools, &pool->link);
+ out_unlock:
+    fd_read_pools_o->unlock(fd_read_pools_lock);
+
+    return pool;
+}
+
+static void
+fd_read_pool_put(struct fd_read_pool *pool)
+{
+    fd_read_pools_o->lock(fd_read_pools_lock);
+    if (--pool->refcount > 0) {
+	fd_read_pools_o->unlock(fd_read_pools_lock);
+	return;
+    }
+    gensio_list_rm(&fd_read_pools, &pool->link);
+    fd_read_pools_o->unlock(fd_read_pools_lock);
+
+    fd_read_pool_free(pool);
+}
+
+static bool
+fd_read_pool_empty(struct fd_read_pool *pool)
+{
+    bool rv;
+
+    pool->o->lock(pool->lock);
+    rv = !pool->free;
+    pool->o->unlock(pool->lock);
+    return rv;
+}
+
+static unsigned char *
+fd_read_buf_alloc(struct fd_read_pool *pool)
+{
+    struct fd_read_buf *b;
+
+    pool->o->lock(pool->lock);
+    b = pool->free;
+    if (b) {
+	pool->free = b->next;
+	pool->nfree--;
+    }
+    pool->o->unlock(pool->lock);
+    if (!b)
+	b = pool->o->zalloc(pool->o, pool->size);
+    return (unsigned char *) b;
+}
+
+static void
+fd_read_buf_free(struct fd_read_pool *pool, unsigned char *data)
+{
+    struct fd_read_buf *b = (struct fd_read_buf *) data;
+
+    pool->o->lock(pool->lock);
+    if (pool->nfree < FD_READ_POOL_MAX) {
+	b->next = pool->free;
+	pool->free = b;
+	pool->nfree++;
+	b = NULL;
+    }
+    pool->o->unlock(pool->lock);
+    if (b)
+	pool->o->free(pool->o, b);
+}
+
+/* Give the read buffer back to the pool if nothing is pending in it. */
+static void
+fd_release_read_data(struct fd_ll *fdll)
+{
+    if (fdll->read_pool && fdll->read_data && !fdll->read_data_len) {
+	fd_read_buf_free(fdll->read_pool, fdll->read_data);
+	fdll->read_data = NULL;
+	gensio_os_mem_uncharge(fdll->o, &fdll->mem_used,
+			       fdll->read_data_size);
+    }
+}
+
 static void fd_handle_write_ready(struct fd_ll *fdll, struct gensio_iod *iod);
 
 static void fd_finish_free(struct fd_ll *fdll)
 {
+    struct gensio_link *l, *l2;
+
+    gensio_list_for_each_safe(&fdll->zc_writes, l, l2) {
+	gensio_list_rm(&fdll->zc_writes, l);
+	fdll->o->free(fdll->o, gensio_container_of(l, struct fd_zc_write,
+						   link));
+    }
     if (fdll->ll)
 	gensio_ll_free_data(fdll->ll);
     if (fdll->lock)
 	fdll->o->free_lock(fdll->lock);
     if (fdll->close_timer)
 	fdll->o->free_timer(fdll->close_timer);
+    if (fdll->mem_runner)
+	fdll->o->free_runner(fdll->mem_runner);
     if (fdll->deferred_op_runner)
 	fdll->o->free_runner(fdll->deferred_op_runner);
-    if (fdll->read_data)
+    if (fdll->read_pool) {
+	if (fdll->read_data) {
+	    fd_read_buf_free(fdll->read_pool, fdll->read_data);
+	    gensio_os_mem_uncharge(fdll->o, &fdll->mem_used,
+				   fdll->read_data_size);
+	}
+	fd_read_pool_put(fdll->read_pool);
+    } else if (fdll->read_data) {
 	fdll->o->free(fdll->o, fdll->read_data);
+    }
     if (fdll->ops)
 	fdll->ops->free(fdll->handler_data);
     fdll->o->free(fdll->o, fdll);
@@ -345,6 +600,138 @@ fd_write(struct gensio_ll *ll, gensiods *rcount,
     return fdll->o->write(fdll->iod, sg, sglen, rcount);
 }
 
+/*
+ * Send the data straight from the caller's buffers.  The kernel
+ * reports when it is done with the data on the socket's error queue,
+ * which comes in as an exception, so the except handler stays on
+ * while any of these are outstanding.  The kernel numbers zero-copy
+ * sends that take data in order, so keep the same count here to
+ * match up the completions.
+ */
+static int
+fd_write_zerocopy(struct gensio_ll *ll, gensiods *rcount,
+		  const struct gensio_sg *sg, gensiods sglen,
+		  struct gensio_func_write_zerocopy *zc)
+{
+    struct fd_ll *fdll = ll_to_fd(ll);
+    struct fd_zc_write *w;
+    gensiods count = 0;
+    int err = 0;
+
+    fd_lock(fdll);
+    if (fdll->state != FD_OPEN || fdll->relay) {
+	err = GE_NOTREADY;
+	goto out_unlock;
+    }
+    if (fdll->zc_failed) {
+	err = GE_NOTSUP;
+	goto out_unlock;
+    }
+    if (!fdll->zc_on) {
+	bool on = true;
+	gensiods len = sizeof(on);
+
+	if (fdll->o->sock_control(fdll->iod, GENSIO_SOCKCTL_SET_ZEROCOPY,
+				  &on, &len)) {
+	    /* Not a socket that can do it, don't try again. */
+	    fdll->zc_failed = true;
+	    err = GE_NOTSUP;
+	    goto out_unlock;
+	}
+	fdll->zc_on = true;
+    }
+
+    w = fdll->o->zalloc(fdll->o, sizeof(*w));
+    if (!w) {
+	err = GE_NOMEM;
+	goto out_unlock;
+    }
+
+    err = fdll->o->send(fdll->iod, sg, sglen, &count, GENSIO_MSG_ZEROCOPY);
+    if (err || count == 0) {
+	fdll->o->free(fdll->o, w);
+	goto out_unlock;
+    }
+    w->num = fdll->zc_next++;
+    w->io = zc->io;
+    w->done = zc->done;
+    w->done_data = zc->done_data;
+    gensio_list_add_tail(&fdll->zc_writes, &w->link);
+    fdll->o->set_except_handler(fdll->iod, true);
+
+ out_unlock:
+    fd_unlock(fdll);
+    if (!err && rcount)
+	*rcount = count;
+    return err;
+}
+
+/*
+ * Call the done callbacks for the zero-copy writes in the list and
+ * free them.  Call with the lock held and a ref, the lock is released
+ * while calling them.  If the user freed the ll, just free them.
+ */
+static void
+fd_zerocopy_finish(struct fd_ll *fdll, struct gensio_list *list, int err)
+{
+    struct gensio_link *l;
+    struct fd_zc_write *w;
+
+    while (!gensio_list_empty(list)) {
+	l = gensio_list_first(list);
+	gensio_list_rm(list, l);
+	w = gensio_container_of(l, struct fd_zc_write, link);
+	if (!fdll->freed) {
+	    fd_unlock(fdll);
+	    w->done(w->io, err, w->done_data);
+	    fd_lock(fdll);
+	}
+	fdll->o->free(fdll->o, w);
+    }
+}
+
+/*
+ * Pull zero-copy completions off the socket and finish the writes
+ * the kernel is done with.  They may come in out of order.  Call
+ * with the lock held and a ref.
+ */
+static void
+fd_zerocopy_reap(struct fd_ll *fdll)
+{
+    struct gensio_zerocopy_done zd;
+    struct gensio_link *l, *l2;
+    struct fd_zc_write *w;
+    struct gensio_list done;
+    gensiods len;
+
+    if (gensio_list_empty(&fdll->zc_writes))
+	return;
+
+    gensio_list_init(&done);
+    for (;;) {
+	len = sizeof(zd);
+	if (fdll->o->sock_control(fdll->iod, GENSIO_SOCKCTL_GET_ZEROCOPY_DONE,
+				  &zd, &len))
+	    break;
+	gensio_list_for_each_safe(&fdll->zc_writes, l, l2) {
+	    w = gensio_container_of(l, struct fd_zc_write, link);
+	    /* Unsigned, so this handles the numbers wrapping. */
+	    if (w->num - zd.first <= zd.last - zd.first) {
+		gensio_list_rm(&fdll->zc_writes, l);
+		gensio_list_add_tail(&done, l);
+	    }
+	}
+    }
+    fd_zerocopy_finish(fdll, &done, 0);
+}
+
+/* Zero-copy completions need the except handler, see above. */
+static bool
+fd_except_wanted(struct fd_ll *fdll, bool enabled)
+{
+    return enabled || !gensio_list_empty(&fdll->zc_writes);
+}
+
 static void
 fd_deliver_read_data(struct fd_ll *fdll, int err)
 {
@@ -368,6 +755,7 @@ fd_deliver_read_data(struct fd_ll *fdll, int err)
 		goto retry;
 	}
     }
+    fd_release_read_data(fdll);
 }
 
 static void
@@ -392,13 +780,16 @@ fd_finish_open(struct fd_ll *fdll, int err)
 	if (fdll->write_enabled)
 	    fdll->o->set_write_handler(fdll->iod, true);
 	fdll->o->set_except_handler(fdll->iod,
-				    fdll->read_enabled || fdll->write_enabled);
+				    fd_except_wanted(fdll, fdll->read_enabled ||
+						     fdll->write_enabled));
     }
 }
 
 static void fd_finish_close(struct fd_ll *fdll)
 {
     fd_set_state(fdll, FD_CLOSED);
+    /* The socket is gone, so is anything the kernel was holding. */
+    fd_zerocopy_finish(fdll, &fdll->zc_writes, GE_LOCALCLOSED);
     if (fdll->close_done) {
 	gensio_ll_close_done close_done = fdll->close_done;
 
@@ -442,10 +833,11 @@ fd_deferred_op(struct gensio_runner *runner, void *cbdata)
     }
 
     fdll->deferred_op_pending = false;
-    if (fdll->state == FD_OPEN) {
+    if (fdll->state == FD_OPEN && !fdll->relay) {
 	fdll->o->set_read_handler(fdll->iod, fdll->read_enabled);
 	fdll->o->set_except_handler(fdll->iod,
-				    fdll->read_enabled || fdll->write_enabled);
+				    fd_except_wanted(fdll, fdll->read_enabled ||
+						     fdll->write_enabled));
 	fdll->o->set_write_handler(fdll->iod, fdll->write_enabled);
     }
     fd_deref_and_unlock(fdll);
@@ -462,9 +854,27 @@ fd_sched_deferred_op(struct fd_ll *fdll)
     }
 }
 
+/* The iod is going away, tell the relay to stop using it. */
+static void
+fd_drop_relay(struct fd_ll *fdll)
+{
+    struct gensio_ll_relay_hook *hook = fdll->relay;
+
+    if (hook) {
+	fdll->relay = NULL;
+	hook->closed(hook);
+    }
+}
+
 static void
 fd_start_close(struct fd_ll *fdll)
 {
+    fd_drop_relay(fdll);
+    if (fdll->mem_wait &&
+		gensio_os_mem_wait_cancel(fdll->o, &fdll->mem_waiter)) {
+	fdll->mem_wait = false;
+	fd_deref(fdll); /* Lose the waiter ref. */
+    }
     if (fdll->ops->check_close)
 	fdll->ops->check_close(fdll->handler_data, fdll->iod,
 			       GENSIO_LL_CLOSE_STATE_START, NULL);
@@ -478,15 +888,72 @@ fd_start_close(struct fd_ll *fdll)
     fd_set_state(fdll, FD_IN_CLOSE);
 }
 
+/*
+ * Check if there is really anything to read on a socket without
+ * needing a buffer.  Sets *count to 0 if not.
+ */
+static int
+fd_peek(struct fd_ll *fdll, gensiods *count)
+{
+    unsigned char c;
+
+    *count = 1;
+    if (fdll->o->iod_get_type(fdll->iod) != GENSIO_IOD_SOCKET)
+	return 0;
+    return fdll->o->recv(fdll->iod, &c, 1, count, GENSIO_MSG_PEEK);
+}
+
+static void
+fd_start_mem_wait(struct fd_ll *fdll)
+{
+    if (fdll->mem_wait)
+	return;
+    fdll->mem_wait = true;
+    fd_ref(fdll);
+    if (!gensio_os_mem_wait(fdll->o, &fdll->mem_waiter))
+	/* It already went back down. */
+	fdll->o->run(fdll->mem_runner);
+}
+
+static void
+fd_mem_ready(struct gensio_os_mem_waiter *w)
+{
+    struct fd_ll *fdll = gensio_container_of(w, struct fd_ll, mem_waiter);
+
+    /* Can't take the fd lock here, do the work from the runner. */
+    fdll->o->run(fdll->mem_runner);
+}
+
+static void
+fd_mem_wait_done(struct gensio_runner *runner, void *cb_data)
+{
+    struct fd_ll *fdll = cb_data;
+
+    fd_lock(fdll);
+    fdll->mem_wait = false;
+    if (fdll->state == FD_OPEN && fdll->read_enabled && !fdll->in_read &&
+		!fdll->relay) {
+	fdll->o->set_read_handler(fdll->iod, true);
+	fdll->o->set_except_handler(fdll->iod, true);
+    }
+    fd_deref_and_unlock(fdll); /* Lose the waiter ref. */
+}
+
+/*
+ * If peek is set, the read is a plain read from the iod, and if the
+ * read would need a new buffer, peek at the socket first to avoid
+ * allocating one on a spurious wakeup.
+ */
 static void
 fd_handle_incoming(struct fd_ll *fdll,
 		   int (*doread)(struct gensio_iod *iod, void *buf, gensiods count,
 				 gensiods *rcount, const char ***auxdata,
 				 void *cb_data),
-		   const char **auxdata, void *cb_data)
+		   const char **auxdata, void *cb_data, bool peek)
 {
     int err = 0;
-    gensiods count;
+    gensiods count = 1;
+    unsigned char *buf;
 
     fd_lock_and_ref(fdll);
     if (fdll->in_read || fdll->state == FD_ERR_WAIT ||
@@ -495,10 +962,34 @@ fd_handle_incoming(struct fd_ll *fdll,
     fdll->in_read = true;
 
     if (!fdll->read_data_len) {
+	buf = fdll->read_data;
 	fd_unlock(fdll);
-	err = doread(fdll->iod, fdll->read_data, fdll->read_data_size, &count,
-		     &auxdata, cb_data);
+	if (!buf && fdll->read_pool) {
+	    if (gensio_os_mem_over_soft_limit(fdll->o)) {
+		fd_lock(fdll);
+		fdll->in_read = false;
+		fd_start_mem_wait(fdll);
+		goto out_disable;
+	    }
+	    if (peek && fd_read_pool_empty(fdll->read_pool))
+		err = fd_peek(fdll, &count);
+	    if (!err && count)
+		err = gensio_os_mem_charge(fdll->o, &fdll->mem_used,
+					   fdll->read_data_size);
+	    if (!err && count) {
+		buf = fd_read_buf_alloc(fdll->read_pool);
+		if (!buf) {
+		    gensio_os_mem_uncharge(fdll->o, &fdll->mem_used,
+					   fdll->read_data_size);
+		    err = GE_NOMEM;
+		}
+	    }
+	}
+	if (!err && count)
+	    err = doread(fdll->iod, buf, fdll->read_data_size, &count,
+			 &auxdata, cb_data);
 	fd_lock(fdll);
+	fdll->read_data = buf;
 	if (!err) {
 	    fdll->read_data_len = count;
 	    fdll->auxdata = auxdata;
@@ -538,7 +1029,8 @@ fd_handle_incoming(struct fd_ll *fdll,
     } else {
     out_disable:
 	fdll->o->set_read_handler(fdll->iod, false);
-	fdll->o->set_except_handler(fdll->iod, fdll->write_enabled);
+	fdll->o->set_except_handler(fdll->iod,
+				    fd_except_wanted(fdll, fdll->write_enabled));
     }
     fd_deref_and_unlock(fdll);
 }
@@ -554,7 +1046,7 @@ void gensio_fd_ll_handle_incoming(struct gensio_ll *ll,
 {
     struct fd_ll *fdll = ll_to_fd(ll);
 
-    fd_handle_incoming(fdll, doread, auxdata, cb_data);
+    fd_handle_incoming(fdll, doread, auxdata, cb_data, false);
 }
 
 static int
@@ -564,17 +1056,42 @@ gensio_ll_fd_read(struct gensio_iod *iod, void *buf, gensiods count, gensiods *r
     return iod->f->read(iod, buf, count, rcount);
 }
 
+/*
+ * Pass readiness to the relay if one is set.  The relay is called
+ * with the fd lock held, so it can't go away while it's running, and
+ * it must not call back into the ll.
+ */
+static bool
+fd_relay_ready(struct fd_ll *fdll, bool read)
+{
+    struct gensio_ll_relay_hook *hook;
+
+    fd_lock(fdll);
+    hook = fdll->relay;
+    if (hook) {
+	if (read)
+	    hook->read_ready(hook);
+	else
+	    hook->write_ready(hook);
+    }
+    fd_unlock(fdll);
+    return hook != NULL;
+}
+
 static void
 fd_read_ready(struct gensio_iod *iod, void *cbdata)
 {
     struct fd_ll *fdll = cbdata;
 
+    if (fd_relay_ready(fdll, true))
+	return;
+
     if (fdll->ops->read_ready) {
 	fdll->ops->read_ready(fdll->handler_data, fdll->iod);
 	return;
     }
 
-    fd_handle_incoming(fdll, gensio_ll_fd_read, NULL, fdll);
+    fd_handle_incoming(fdll, gensio_ll_fd_read, NULL, fdll, true);
 }
 
 static int fd_setup_handlers(struct fd_ll *fdll);
@@ -586,7 +1103,8 @@ fd_handle_write_ready(struct fd_ll *fdll, struct gensio_iod *iod)
 	int err;
 
 	fdll->o->set_write_handler(iod, false);
-	fdll->o->set_except_handler(iod, fdll->read_enabled);
+	fdll->o->set_except_handler(iod,
+				    fd_except_wanted(fdll, fdll->read_enabled));
 	err = fdll->ops->check_open(fdll->handler_data, fdll->iod);
 	/*
 	 * The GE_NOMEM check is strange here, but it really has more
@@ -625,11 +1143,13 @@ fd_handle_write_ready(struct fd_ll *fdll, struct gensio_iod *iod)
 	    fdll->o->set_except_handler(fdll->iod, true);
 	} else {
 	    fdll->o->set_write_handler(iod, false);
-	    fdll->o->set_except_handler(iod, fdll->read_enabled);
+	    fdll->o->set_except_handler(iod,
+				fd_except_wanted(fdll, fdll->read_enabled));
 	}
     } else {
 	fdll->o->set_write_handler(iod, false);
-	fdll->o->set_except_handler(iod, fdll->read_enabled);
+	fdll->o->set_except_handler(iod,
+				    fd_except_wanted(fdll, fdll->read_enabled));
     }
 }
 
@@ -638,6 +1158,9 @@ fd_write_ready(struct gensio_iod *iod, void *cbdata)
 {
     struct fd_ll *fdll = cbdata;
 
+    if (fd_relay_ready(fdll, false))
+	return;
+
     fd_lock_and_ref(fdll);
     fd_handle_write_ready(fdll, iod);
     fd_deref_and_unlock(fdll);
@@ -650,6 +1173,21 @@ fd_except_ready(struct gensio_iod *iod, void *cbdata)
     int rv = 0;
 
     fd_lock(fdll);
+    if (fdll->relay) {
+	/* The relay doesn't do urgent data. */
+	fdll->o->set_except_handler(iod, false);
+	fd_unlock(fdll);
+	return;
+    }
+    if (!gensio_list_empty(&fdll->zc_writes)) {
+	/*
+	 * Zero-copy completions.  Go on to the normal handling in
+	 * case urgent data came in, too; that's harmless if not.
+	 */
+	fd_ref(fdll);
+	fd_zerocopy_reap(fdll);
+	fd_deref(fdll);
+    }
     /*
      * In some cases, if a connect() call fails, we get an exception,
      * not a write ready.  So in the open case, call write ready.
@@ -777,9 +1315,13 @@ fd_open(struct gensio_ll *ll, gensio_ll_open_done done, void *open_data)
     }
 
     fdll->close_requested = false;
+    fdll->zc_on = false;
+    fdll->zc_failed = false;
+    fdll->zc_next = 0;
     fdll->open_err = 0;
     fdll->read_data_len = 0;
     fdll->read_data_pos = 0;
+    fd_release_read_data(fdll);
 
     err = fdll->ops->sub_open(fdll->handler_data, &fdll->iod);
     if (err == GE_INPROGRESS || err == 0) {
@@ -866,7 +1408,9 @@ fd_set_read_callback_enable(struct gensio_ll *ll, bool enabled)
 	goto out_unlock;
     fdll->read_enabled = enabled;
 
-    if (fdll->in_read || fdll->state != FD_OPEN ||
+    if (fdll->relay) {
+	/* Applied when the relay is removed. */
+    } else if (fdll->in_read || fdll->state != FD_OPEN ||
 			(fdll->read_data_len && !enabled)) {
 	/* It will be handled in finish_read or open finish. */
     } else if (fdll->read_data_len) {
@@ -875,7 +1419,9 @@ fd_set_read_callback_enable(struct gensio_ll *ll, bool enabled)
 	fd_sched_deferred_op(fdll);
     } else {
 	fdll->o->set_read_handler(fdll->iod, enabled);
-	fdll->o->set_except_handler(fdll->iod, enabled || fdll->write_enabled);
+	fdll->o->set_except_handler(fdll->iod,
+				    fd_except_wanted(fdll, enabled ||
+						     fdll->write_enabled));
     }
  out_unlock:
     fd_unlock(fdll);
@@ -890,10 +1436,14 @@ fd_set_write_callback_enable(struct gensio_ll *ll, bool enabled)
     if (fdll->read_only)
 	goto out_unlock;
     fdll->write_enabled = enabled;
-    if (fdll->state == FD_OPEN || fdll->state == FD_IN_OPEN ||
+    if (fdll->relay) {
+	/* Applied when the relay is removed. */
+    } else if (fdll->state == FD_OPEN || fdll->state == FD_IN_OPEN ||
 		fdll->state == FD_IN_OPEN_RETRY) {
 	fdll->o->set_write_handler(fdll->iod, enabled);
-	fdll->o->set_except_handler(fdll->iod, enabled || fdll->read_enabled);
+	fdll->o->set_except_handler(fdll->iod,
+				    fd_except_wanted(fdll, enabled ||
+						     fdll->read_enabled));
     } else if (fdll->deferred_except) {
 	fd_sched_deferred_op(fdll);
     }
@@ -932,6 +1482,15 @@ static int fd_control(struct gensio_ll *ll, bool get, unsigned int option,
 {
     struct fd_ll *fdll = ll_to_fd(ll);
 
+    if (option == GENSIO_CONTROL_MEM_USAGE) {
+	if (!get)
+	    return GE_NOTSUP;
+	*datalen = snprintf(data, *datalen, "%lu",
+			    (unsigned long) __atomic_load_n(&fdll->mem_used,
+							    __ATOMIC_RELAXED));
+	return 0;
+    }
+
     if (!fdll->ops->control)
 	return GE_NOTSUP;
 
@@ -951,10 +1510,50 @@ static int fd_acontrol(struct gensio_ll *ll, bool get, unsigned int option,
 			       data);
 }
 
+static int
+fd_set_relay(struct gensio_ll *ll, struct gensio_ll_relay_hook *hook)
+{
+    struct fd_ll *fdll = ll_to_fd(ll);
+    int err = 0;
+
+    fd_lock(fdll);
+    if (hook) {
+	if (fdll->state != FD_OPEN || fdll->close_requested) {
+	    err = GE_NOTREADY;
+	    goto out_unlock;
+	}
+	if (fdll->relay || fdll->in_read || fdll->in_write ||
+		fdll->read_data_len || fdll->read_only || fdll->write_only ||
+		!gensio_list_empty(&fdll->zc_writes)) {
+	    err = GE_INUSE;
+	    goto out_unlock;
+	}
+	fdll->o->set_read_handler(fdll->iod, false);
+	fdll->o->set_write_handler(fdll->iod, false);
+	fdll->o->set_except_handler(fdll->iod, false);
+	hook->iod = fdll->iod;
+	fdll->relay = hook;
+    } else if (fdll->relay) {
+	fdll->relay = NULL;
+	if (fdll->state == FD_OPEN) {
+	    fdll->o->set_read_handler(fdll->iod, fdll->read_enabled);
+	    fdll->o->set_write_handler(fdll->iod, fdll->write_enabled);
+	    fdll->o->set_except_handler(fdll->iod,
+					fd_except_wanted(fdll,
+							 fdll->read_enabled ||
+							 fdll->write_enabled));
+	}
+    }
+ out_unlock:
+    fd_unlock(fdll);
+    return err;
+}
+
 static void fd_disable(struct gensio_ll *ll)
 {
     struct fd_ll *fdll = ll_to_fd(ll);
 
+    fd_drop_relay(fdll);
     fd_set_state(fdll, FD_CLOSED);
     fd_deref(fdll);
     fdll->o->clear_fd_handlers_norpt(fdll->iod);
@@ -974,6 +1573,9 @@ gensio_ll_fd_func(struct gensio_ll *ll, int op, gensiods *count,
     case GENSIO_LL_FUNC_WRITE_SG:
 	return fd_write(ll, count, cbuf, buflen, auxdata);
 
+    case GENSIO_LL_FUNC_WRITE_ZEROCOPY:
+	return fd_write_zerocopy(ll, count, cbuf, buflen, buf);
+
     case GENSIO_LL_FUNC_OPEN:
 	return fd_open(ll, (void *) cbuf, buf);
 
@@ -1002,6 +1604,9 @@ gensio_ll_fd_func(struct gensio_ll *ll, int op, gensiods *count,
 	fd_disable(ll);
 	return 0;
 
+    case GENSIO_LL_FUNC_SET_RELAY:
+	return fd_set_relay(ll, buf);
+
     default:
 	return GE_NOTSUP;
     }
@@ -1035,6 +1640,7 @@ fd_gensio_ll_alloc(struct gensio_os_funcs *o,
     fdll->refcount = 1;
     fdll->write_only = write_only;
     fdll->read_only = read_only;
+    gensio_list_init(&fdll->zc_writes);
     if (!iod) {
 	fd_set_state(fdll, FD_CLOSED);
     } else {
@@ -1055,7 +1661,15 @@ fd_gensio_ll_alloc(struct gensio_os_funcs *o,
 	goto out_nomem;
 
     fdll->read_data_size = max_read_size;
-    if (max_read_size > 0) {
+    if (max_read_size >= sizeof(struct fd_read_buf)) {
+	fdll->read_pool = fd_read_pool_get(o, max_read_size);
+	if (!fdll->read_pool)
+	    goto out_nomem;
+	fdll->mem_runner = o->alloc_runner(o, fd_mem_wait_done, fdll);
+	if (!fdll->mem_runner)
+	    goto out_nomem;
+	fdll->mem_waiter.ready = fd_mem_ready;
+    } else if (max_read_size > 0) {
 	fdll->read_data = o->zalloc(o, max_read_size);
 	if (!fdll->read_data)
 	    goto out_nomem;
@@ -0,0 +1,463 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2023  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * A size class allocator for OS handlers to put under zalloc/free.
+ *
+ * Small allocations are carved out of big slabs and kept on a free
+ * list per size class, nothing is ever given back to malloc until the
+ * pool is freed.  Each thread keeps a small cache of free objects per
+ * class so the common case does not take a lock; the cache gets
+ * refilled from (or flushed to) the shared list in batches.
+ * Allocations too big for the largest class go straight to malloc.
+ *
+ * Every object has a small header holding the size class, so free
+ * knows where it goes.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_osops.h>
+#include <gensio/gensio_list.h>
+#include <pthread_handler.h>
+
+#include "errtrig.h"
+
+#define MEMPOOL_MAGIC 0x6d656d70
+#define MEMPOOL_FREED 0x66726565
+#define MEMPOOL_LARGE 0xffffffff
+
+/* Sizes include the header. */
+static const unsigned int mempool_sizes[] = {
+    32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512,
+    768, 1024, 1536, 2048, 3072, 4096
+};
+#define MEMPOOL_NUM_CLASSES (sizeof(mempool_sizes) / sizeof(unsigned int))
+#define MEMPOOL_MAX_SIZE 4096
+
+#define MEMPOOL_SLAB_SIZE 65536
+
+/* Max objects in a thread's cache, per class. */
+#define MEMPOOL_CACHE_MAX 64
+
+union mempool_hdr {
+    struct {
+	uint32_t magic;
+	uint32_t sclass;
+	union mempool_hdr *next;
+    } h;
+    uint64_t align[2]; /* Keep the data 16-byte aligned. */
+};
+
+union mempool_slab {
+    union mempool_slab *next;
+    uint64_t align[2];
+};
+
+struct mempool_list {
+    union mempool_hdr *head;
+    unsigned int count;
+};
+
+struct mempool_class {
+    lock_type lock;
+    struct mempool_list free;
+};
+
+struct mempool_tstats {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t cache_hits;
+    uint64_t large_allocs;
+};
+
+#ifdef USE_PTHREADS
+struct mempool_tcache {
+    struct gensio_mempool *pool;
+    struct gensio_link link;
+    struct mempool_list c[MEMPOOL_NUM_CLASSES];
+    struct mempool_tstats stats;
+};
+#endif
+
+struct gensio_mempool {
+    lock_type lock;
+    union mempool_slab *slabs;
+    uint64_t num_slabs;
+    struct mempool_class classes[MEMPOOL_NUM_CLASSES];
+
+    /* Size class for each 16 byte step up to MEMPOOL_MAX_SIZE. */
+    unsigned char class_of[MEMPOOL_MAX_SIZE / 16 + 1];
+
+#ifdef USE_PTHREADS
+    pthread_key_t key;
+    struct gensio_list tcaches;
+#endif
+
+    /* Stats of threads that are gone, or of everything w/o threads. */
+    struct mempool_tstats stats;
+
+    bool abort_on_leak;
+};
+
+static void
+mempool_stat_inc(uint64_t *v)
+{
+    __atomic_fetch_add(v, 1, __ATOMIC_RELAXED);
+}
+
+static void
+mempool_list_push(struct mempool_list *l, union mempool_hdr *h)
+{
+    h->h.next = l->head;
+    l->head = h;
+    l->count++;
+}
+
+static union mempool_hdr *
+mempool_list_pop(struct mempool_list *l)
+{
+    union mempool_hdr *h = l->head;
+
+    if (h) {
+	l->head = h->h.next;
+	l->count--;
+    }
+    return h;
+}
+
+/* Move up to count objects from one list to another. */
+static void
+mempool_list_move(struct mempool_list *to, struct mempool_list *from,
+		  unsigned int count)
+{
+    union mempool_hdr *h;
+
+    while (count > 0 && (h = mempool_list_pop(from))) {
+	mempool_list_push(to, h);
+	count--;
+    }
+}
+
+/* Called with the class lock held. */
+static bool
+mempool_new_slab(struct gensio_mempool *p, unsigned int sclass)
+{
+    struct mempool_class *c = &p->classes[sclass];
+    unsigned int size = mempool_sizes[sclass];
+    union mempool_slab *slab;
+    unsigned char *b;
+    unsigned int i, count;
+
+    slab = malloc(MEMPOOL_SLAB_SIZE);
+    if (!slab)
+	return false;
+    b = ((unsigned char *) slab) + sizeof(*slab);
+    count = (MEMPOOL_SLAB_SIZE - sizeof(*slab)) / size;
+    for (i = 0; i < count; i++) {
+	union mempool_hdr *h = (union mempool_hdr *) (b + i * size);
+
+	h->h.magic = MEMPOOL_FREED;
+	h->h.sclass = sclass;
+	mempool_list_push(&c->free, h);
+    }
+
+    LOCK(&p->lock);
+    slab->next = p->slabs;
+    p->slabs = slab;
+    p->num_slabs++;
+    UNLOCK(&p->lock);
+
+    return true;
+}
+
+/* Get an object from the shared list, moving extras to l if not NULL. */
+static union mempool_hdr *
+mempool_get_shared(struct gensio_mempool *p, unsigned int sclass,
+		   struct mempool_list *l)
+{
+    struct mempool_class *c = &p->classes[sclass];
+    union mempool_hdr *h;
+
+    LOCK(&c->lock);
+    if (!c->free.head && !mempool_new_slab(p, sclass)) {
+	UNLOCK(&c->lock);
+	return NULL;
+    }
+    h = mempool_list_pop(&c->free);
+    if (l)
+	mempool_list_move(l, &c->free, MEMPOOL_CACHE_MAX / 2);
+    UNLOCK(&c->lock);
+
+    return h;
+}
+
+static void
+mempool_put_shared(struct gensio_mempool *p, unsigned int sclass,
+		   struct mempool_list *l, unsigned int count)
+{
+    struct mempool_class *c = &p->classes[sclass];
+
+    LOCK(&c->lock);
+    mempool_list_move(&c->free, l, count);
+    UNLOCK(&c->lock);
+}
+
+static void
+mempool_tstats_add(struct mempool_tstats *to, struct mempool_tstats *from)
+{
+    to->allocs += __atomic_load_n(&from->allocs, __ATOMIC_RELAXED);
+    to->frees += __atomic_load_n(&from->frees, __ATOMIC_RELAXED);
+    to->cache_hits += __atomic_load_n(&from->cache_hits, __ATOMIC_RELAXED);
+    to->large_allocs += __atomic_load_n(&from->large_allocs,
+					__ATOMIC_RELAXED);
+}
+
+#ifdef USE_PTHREADS
+/* Thread exit, give the cached objects back. */
+static void
+mempool_tcache_destroy(void *data)
+{
+    struct mempool_tcache *t = data;
+    struct gensio_mempool *p = t->pool;
+    unsigned int i;
+
+    for (i = 0; i < MEMPOOL_NUM_CLASSES; i++)
+	mempool_put_shared(p, i, &t->c[i], t->c[i].count);
+
+    LOCK(&p->lock);
+    gensio_list_rm(&p->tcaches, &t->link);
+    mempool_tstats_add(&p->stats, &t->stats);
+    UNLOCK(&p->lock);
+    free(t);
+}
+
+static struct mempool_tcache *
+mempool_get_tcache(struct gensio_mempool *p)
+{
+    struct mempool_tcache *t = pthread_getspecific(p->key);
+
+    if (t)
+	return t;
+
+    t = malloc(sizeof(*t));
+    if (!t)
+	return NULL;
+    memset(t, 0, sizeof(*t));
+    t->pool = p;
+    if (pthread_setspecific(p->key, t)) {
+	free(t);
+	return NULL;
+    }
+    LOCK(&p->lock);
+    gensio_list_add_tail(&p->tcaches, &t->link);
+    UNLOCK(&p->lock);
+    return t;
+}
+#endif
+
+struct gensio_mempool *
+gensio_mempool_alloc(void)
+{
+    struct gensio_mempool *p;
+    unsigned int i, j;
+    char *s;
+
+    p = malloc(sizeof(*p));
+    if (!p)
+	return NULL;
+    memset(p, 0, sizeof(*p));
+
+    s = getenv("GENSIO_MEMPOOL");
+    if (s && strstr(s, "abort"))
+	p->abort_on_leak = true;
+
+#ifdef USE_PTHREADS
+    if (pthread_key_create(&p->key, mempool_tcache_destroy)) {
+	free(p);
+	return NULL;
+    }
+    gensio_list_init(&p->tcaches);
+#endif
+    LOCK_INIT(&p->lock);
+    for (i = 0; i < MEMPOOL_NUM_CLASSES; i++)
+	LOCK_INIT(&p->classes[i].lock);
+
+    for (i = 0, j = 0; i <= MEMPOOL_MAX_SIZE / 16; i++) {
+	while (mempool_sizes[j] < i * 16)
+	    j++;
+	p->class_of[i] = j;
+    }
+
+    return p;
+}
+
+void
+gensio_mempool_free(struct gensio_mempool *p)
+{
+    union mempool_slab *slab;
+    unsigned int i;
+
+    if (!p)
+	return;
+
+    if (p->abort_on_leak) {
+	struct gensio_os_mempool_stats stats;
+
+	gensio_mempool_get_stats(p, &stats);
+	if (stats.allocs != stats.frees) {
+	    fprintf(stderr, "Lost memory: %llu pool allocations not freed\n",
+		    (unsigned long long) (stats.allocs - stats.frees));
+	    fflush(stderr);
+	    assert(false);
+	}
+    }
+
+#ifdef USE_PTHREADS
+    /* Other threads' caches point into the slabs, just drop them. */
+    pthread_key_delete(p->key);
+    while (!gensio_list_empty(&p->tcaches)) {
+	struct gensio_link *l = gensio_list_first(&p->tcaches);
+
+	gensio_list_rm(&p->tcaches, l);
+	free(gensio_container_of(l, struct mempool_tcache, link));
+    }
+#endif
+
+    while (p->slabs) {
+	slab = p->slabs;
+	p->slabs = slab->next;
+	free(slab);
+    }
+    for (i = 0; i < MEMPOOL_NUM_CLASSES; i++)
+	LOCK_DESTROY(&p->classes[i].lock);
+    LOCK_DESTROY(&p->lock);
+    free(p);
+}
+
+void *
+gensio_mempool_zalloc(struct gensio_mempool *p, gensiods size)
+{
+    union mempool_hdr *h = NULL;
+    struct mempool_tstats *stats = &p->stats;
+    unsigned int sclass;
+#ifdef USE_PTHREADS
+    struct mempool_tcache *t;
+#endif
+
+    if (do_errtrig())
+	return NULL;
+
+    if (size > MEMPOOL_MAX_SIZE - sizeof(*h)) {
+	h = malloc(sizeof(*h) + size);
+	if (!h)
+	    return NULL;
+	h->h.magic = MEMPOOL_MAGIC;
+	h->h.sclass = MEMPOOL_LARGE;
+	mempool_stat_inc(&p->stats.large_allocs);
+	goto out;
+    }
+
+    sclass = p->class_of[(size + sizeof(*h) + 15) / 16];
+#ifdef USE_PTHREADS
+    t = mempool_get_tcache(p);
+    if (t) {
+	stats = &t->stats;
+	h = mempool_list_pop(&t->c[sclass]);
+	if (h)
+	    mempool_stat_inc(&stats->cache_hits);
+	else
+	    h = mempool_get_shared(p, sclass, &t->c[sclass]);
+    } else
+#endif
+	h = mempool_get_shared(p, sclass, NULL);
+    if (!h)
+	return NULL;
+    assert(h->h.magic == MEMPOOL_FREED);
+    h->h.magic = MEMPOOL_MAGIC;
+
+ out:
+    mempool_stat_inc(&stats->allocs);
+    h++;
+    memset(h, 0, size);
+    return h;
+}
+
+void
+gensio_mempool_zfree(struct gensio_mempool *p, void *data)
+{
+    union mempool_hdr *h = ((union mempool_hdr *) data) - 1;
+    struct mempool_tstats *stats = &p->stats;
+    unsigned int sclass = h->h.sclass;
+#ifdef USE_PTHREADS
+    struct mempool_tcache *t;
+#endif
+
+    /* Catches double frees and memory not from the pool. */
+    assert(h->h.magic == MEMPOOL_MAGIC);
+
+    if (sclass == MEMPOOL_LARGE) {
+	h->h.magic = MEMPOOL_FREED;
+	free(h);
+	mempool_stat_inc(&p->stats.frees);
+	return;
+    }
+
+    assert(sclass < MEMPOOL_NUM_CLASSES);
+    h->h.magic = MEMPOOL_FREED;
+#ifdef USE_PTHREADS
+    t = mempool_get_tcache(p);
+    if (t) {
+	stats = &t->stats;
+	mempool_list_push(&t->c[sclass], h);
+	if (t->c[sclass].count > MEMPOOL_CACHE_MAX)
+	    mempool_put_shared(p, sclass, &t->c[sclass],
+			       MEMPOOL_CACHE_MAX / 2);
+    } else
+#endif
+    {
+	struct mempool_list l = { NULL, 0 };
+
+	mempool_list_push(&l, h);
+	mempool_put_shared(p, sclass, &l, 1);
+    }
+    mempool_stat_inc(&stats->frees);
+}
+
+void
+gensio_mempool_get_stats(struct gensio_mempool *p,
+			 struct gensio_os_mempool_stats *stats)
+{
+    struct mempool_tstats s;
+#ifdef USE_PTHREADS
+    struct gensio_link *l;
+#endif
+
+    memset(&s, 0, sizeof(s));
+    LOCK(&p->lock);
+    mempool_tstats_add(&s, &p->stats);
+#ifdef USE_PTHREADS
+    gensio_list_for_each(&p->tcaches, l) {
+	struct mempool_tcache *t = gensio_container_of(l, struct mempool_tcache,
+						       link);
+
+	mempool_tstats_add(&s, &t->stats);
+    }
+#endif
+    stats->allocs = s.allocs;
+    stats->frees = s.frees;
+    stats->cache_hits = s.cache_hits;
+    stats->large_allocs = s.large_allocs;
+    stats->slabs = p->num_slabs;
+    stats->slab_bytes = p->num_slabs * MEMPOOL_SLAB_SIZE;
+    UNLOCK(&p->lock);
+}
@@ -230,6 +230,12 @@ struct mux_inst {
     /* Number of bytes we have sent that are not acked. */
     gensiods sent_unacked;
 
+    /*
+     * read_data_len plus write_data_len charged against the os funcs
+     * memory budget, see chan_charge_mem().
+     */
+    gensiods mem_used;
+
     /*
      * Maximum number of bytes the remote end told us we can have
      * outstanding.
@@ -264,6 +270,29 @@ struct mux_inst {
     struct gensio_link link;
 };
 
+/*
+ * Data is charged to the memory budget before it is added to the
+ * channel's buffers.  If that fails at the hard limit, a user write
+ * fails with GE_MEMLIMIT, and received data fails the mux with
+ * GE_MEMLIMIT, since the data can't be refused after it has been
+ * sent.  chan_update_mem() gives back what has left the buffers.
+ */
+static int
+chan_charge_mem(struct mux_inst *chan, gensiods len)
+{
+    return gensio_os_mem_charge(chan->o, &chan->mem_used, len);
+}
+
+static void
+chan_update_mem(struct mux_inst *chan)
+{
+    gensiods used = chan->read_data_len + chan->write_data_len;
+
+    if (used < chan->mem_used)
+	gensio_os_mem_uncharge(chan->o, &chan->mem_used,
+			       chan->mem_used - used);
+}
+
 static gensiods
 chan_next_write_pos(struct mux_inst *chan, unsigned int count)
 {
@@ -279,6 +308,7 @@ chan_incr_write_pos(struct mux_inst *chan, unsigned int count)
 {
     chan->write_data_pos = chan_next_write_pos(chan, count);
     chan->write_data_len -= count;
+    chan_update_mem(chan);
 }
 
 static void
@@ -681,6 +711,7 @@ chan_free(struct mux_inst *chan)
 	o->free(o, chan->read_data);
     if (chan->write_data)
 	o->free(o, chan->write_data);
+    gensio_os_mem_uncharge(o, &chan->mem_used, chan->mem_used);
     if (chan->service)
 	o->free(o, chan->service);
     if (chan->deferred_op_runner)
@@ -1042,6 +1073,7 @@ chan_check_read(struct mux_inst *chan)
 	    chan->read_data_len -= olen + 3;
 	    to_ack += 3;
 	}
+	chan_update_mem(chan);
 	chan->received_unacked += to_ack;
     }
     /*
@@ -1185,6 +1217,11 @@ muxc_write(struct mux_inst *chan, gensiods *count,
 	truncated = true;
     }
 
+    if (chan_charge_mem(chan, tot_len)) {
+	mux_unlock(muxdata);
+	return GE_MEMLIMIT;
+    }
+
     /* FIXME - consolidate writes if possible. */
 
     /* Construct the header and put it in first. */
@@ -1681,6 +1718,7 @@ muxc_reinit(struct mux_inst *chan)
     chan->received_unacked = 0;
     chan->write_data_pos = 0;
     chan->write_data_len = 0;
+    chan_update_mem(chan);
     chan->write_ready_enabled = false;
     chan->in_write_ready = false;
     chan->sent_unacked = 0;
@@ -1819,6 +1857,15 @@ muxc_control(struct mux_inst *chan, bool get, int op,
 	    chan->do_oob = !!strtoul(data, NULL, 0);
 	break;
 
+    case GENSIO_CONTROL_MEM_USAGE:
+	if (!get) {
+	    err = GE_NOTSUP;
+	    break;
+	}
+	*datalen = snprintf(data, *datalen, "%lu",
+			    (unsigned long) chan->mem_used);
+	break;
+
     default:
 	err = GE_NOTSUP;
 	break;
@@ -2096,6 +2143,7 @@ mux_child_write_ready(struct mux_data *muxdata)
 	    /* Finished sending one message. */
 	    chan->write_data_pos = chan_next_write_pos(chan, chan->cur_msg_len);
 	    chan->write_data_len -= chan->cur_msg_len;
+	    chan_update_mem(chan);
 	    chan->cur_msg_len = 0;
 	    chan->sgpos = 0;
 	    chan->sglen = 0;
@@ -2461,6 +2509,7 @@ mux_child_read(struct mux_data *muxdata, int ierr,
 		}
 		/* If we receive a close, don't send any more data. */
 		chan->write_data_len = 0;
+		chan_update_mem(chan);
 		break;
 
 	    case MUX_DATA:
@@ -2539,6 +2588,8 @@ mux_child_read(struct mux_data *muxdata, int ierr,
 			proto_err_str = "Too much data from remote end";
 			goto protocol_err;
 		    }
+		    if (chan_charge_mem(chan, 3))
+			goto memlimit_err;
 		    /* Add the message flags first. */
 		    chan_addrdbyte(chan, muxdata->hdr[1]);
 		    chan_addrdbyte(chan, muxdata->data_size >> 8);
@@ -2654,12 +2705,16 @@ mux_child_read(struct mux_data *muxdata, int ierr,
 		assert(chan);
 		if (buflen + muxdata->data_pos < muxdata->data_size + 2) {
 		    /* Not all data received yet. */
+		    if (chan_charge_mem(chan, buflen))
+			goto memlimit_err;
 		    chan_addrdbuf(chan, buf, buflen);
 		    muxdata->data_pos += buflen;
 		    processed += buflen;
 		    goto out_unlock;
 		}
 		used = muxdata->data_size + 2 - muxdata->data_pos;
+		if (chan_charge_mem(chan, used))
+		    goto memlimit_err;
 		chan_addrdbuf(chan, buf, used);
 
 	    handle_read_no_data:
@@ -2682,6 +2737,10 @@ mux_child_read(struct mux_data *muxdata, int ierr,
     *ibuflen = processed;
     return 0;
 
+ memlimit_err:
+    ierr = GE_MEMLIMIT;
+    goto out_err;
+
  protocol_err_close_chan:
     /*
      * A protocol error was reported before the channel was reported
@@ -34,6 +34,26 @@
 
 #include "gensio_net.h"
 
+/*
+ * Maximum number of connections accepted each time the listening
+ * socket is readable by default, and the limit.  This keeps a flood
+ * of connections from starving other file descriptors.
+ */
+#define GENSIO_DEFAULT_NET_ACCEPT_BATCH	16
+#define GENSIO_MAX_NET_ACCEPT_BATCH	1024
+
+/* Maximum number of SO_REUSEPORT listeners for an accepter. */
+#define GENSIO_MAX_NET_REUSEPORT	256
+
+#ifdef __linux__
+/*
+ * Accepted TCP sockets inherit SO_KEEPALIVE, TCP_NODELAY, and
+ * SO_REUSEADDR from the listening socket, so they can be set once on
+ * the listener instead of on every new connection.
+ */
+#define GENSIO_NET_ACCEPT_INHERITS_SETUP 1
+#endif
+
 struct net_data {
     struct gensio_os_funcs *o;
 
@@ -536,6 +556,22 @@ struct netna_data {
 
     gensiods max_read_size;
     bool nodelay;
+    unsigned int accept_batch;
+
+    /*
+     * If non-zero, open this many sets of listening sockets with
+     * SO_REUSEPORT, each on its own reactor.
+     */
+    unsigned int reuseport;
+
+    /*
+     * Set if the socket options for new connections were set on the
+     * listening sockets and will be inherited.
+     */
+    bool setup_inherited;
+
+    /* Accept callbacks are disabled, stop accepting connections. */
+    bool accepts_disabled;
 
     gensio_acc_done shutdown_done;
     gensio_acc_done cb_en_done;
@@ -614,18 +650,33 @@ netna_finish_server_open(struct gensio *net, int err, void *cb_data)
     base_gensio_server_open_done(nadata->acc, net, err);
 }
 
-static void
-netna_readhandler(struct gensio_iod *iod, void *cbdata)
+static unsigned int
+netna_conn_setup(struct netna_data *nadata)
+{
+    unsigned int setup = (GENSIO_SET_OPENSOCK_KEEPALIVE |
+			  GENSIO_SET_OPENSOCK_NODELAY);
+
+    if (nadata->istcp)
+	setup |= GENSIO_OPENSOCK_KEEPALIVE;
+    if (nadata->nodelay)
+	setup |= GENSIO_OPENSOCK_NODELAY;
+    return setup;
+}
+
+/*
+ * Accept one connection from the listening socket.  Returns an error
+ * if no connection could be accepted, problems with an accepted
+ * connection are handled here and return 0.
+ */
+static int
+netna_accept_one(struct netna_data *nadata, struct gensio_iod *iod)
 {
-    struct netna_data *nadata = cbdata;
     struct gensio_iod *new_iod = NULL;
     struct gensio_addr *raddr;
     struct net_data *tdata = NULL;
     struct gensio *io = NULL;
-    unsigned int setup = (GENSIO_SET_OPENSOCK_REUSEADDR |
-			  GENSIO_OPENSOCK_REUSEADDR |
-			  GENSIO_SET_OPENSOCK_KEEPALIVE |
-			  GENSIO_SET_OPENSOCK_NODELAY);
+    struct gensio_os_funcs *o;
+    unsigned int setup;
     int err;
 
     err = nadata->o->accept(iod, &raddr, &new_iod);
@@ -635,14 +686,14 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
 			   "Error accepting net gensio: %s",
 			   gensio_err_to_str(err));
-	return;
+	return err;
     }
 
     err = base_gensio_accepter_new_child_start(nadata->acc);
     if (err) {
 	gensio_addr_free(raddr);
 	nadata->o->close(&new_iod);
-	return;
+	return err;
     }
 
 #ifdef HAVE_TCPD_H
@@ -663,7 +714,21 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
     }
 #endif
 
-    tdata = nadata->o->zalloc(nadata->o, sizeof(*tdata));
+    /*
+     * If the os funcs has multiple reactors, put the new connection on
+     * the next one.  If that fails, just leave it on ours.  With
+     * reuseport the kernel has already spread the connections across
+     * listeners on different reactors, so keep it where it is.
+     */
+    if (nadata->reuseport > 1) {
+	o = new_iod->f;
+    } else {
+	o = gensio_os_funcs_get_reactor(nadata->o, GENSIO_OS_REACTOR_NEXT);
+	if (gensio_os_funcs_iod_set_reactor(new_iod, o))
+	    o = new_iod->f;
+    }
+
+    tdata = o->zalloc(o, sizeof(*tdata));
     if (!tdata) {
 	gensio_acc_log(nadata->acc, GENSIO_LOG_INFO,
 		       "Error accepting net gensio: out of memory");
@@ -671,25 +736,26 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	goto out_err;
     }
 
-    tdata->o = nadata->o;
+    tdata->o = o;
     tdata->oob_char = -1;
     tdata->ai = raddr;
     tdata->istcp = nadata->istcp;
     tdata->nodelay = nadata->nodelay;
     raddr = NULL;
 
-    if (tdata->istcp)
-	setup |= GENSIO_OPENSOCK_KEEPALIVE;
-    if (tdata->nodelay)
-	setup |= GENSIO_OPENSOCK_NODELAY;
-    err = tdata->o->socket_set_setup(new_iod, setup, NULL);
-    if (err) {
-	gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-		       "Error setting up net port: %s", gensio_err_to_str(err));
-	goto out_err;
+    if (!nadata->setup_inherited) {
+	setup = netna_conn_setup(nadata);
+	setup |= GENSIO_SET_OPENSOCK_REUSEADDR | GENSIO_OPENSOCK_REUSEADDR;
+	err = tdata->o->socket_set_setup(new_iod, setup, NULL);
+	if (err) {
+	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+			   "Error setting up net port: %s",
+			   gensio_err_to_str(err));
+	    goto out_err;
+	}
     }
 
-    tdata->ll = fd_gensio_ll_alloc(nadata->o, new_iod, &net_server_fd_ll_ops,
+    tdata->ll = fd_gensio_ll_alloc(o, new_iod, &net_server_fd_ll_ops,
 				   tdata, nadata->max_read_size, false, false);
     if (!tdata->ll) {
 	gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
@@ -698,7 +764,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	goto out_err;
     }
 
-    io = base_gensio_server_alloc(nadata->o, tdata->ll, NULL, NULL,
+    io = base_gensio_server_alloc(o, tdata->ll, NULL, NULL,
 				  nadata->istcp ? "tcp" : "unix",
 				  netna_finish_server_open, nadata);
     if (!io) {
@@ -712,18 +778,18 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
     if (err)
 	goto out_err;
     base_gensio_accepter_new_child_end(nadata->acc, io, 0);
-    return;
+    return 0;
 
  out_err:
     base_gensio_accepter_new_child_end(nadata->acc, NULL, err);
     if (io) {
 	gensio_free(io);
-	return;
+	return 0;
     }
     if (tdata) {
 	if (tdata->ll) {
 	    gensio_ll_free(tdata->ll);
-	    return;
+	    return 0;
 	}
 
 	/* gensio_ll_free() frees it otherwise. */
@@ -733,6 +799,25 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	gensio_addr_free(raddr);
     if (new_iod)
 	nadata->o->close(&new_iod);
+    return 0;
+}
+
+static void
+netna_readhandler(struct gensio_iod *iod, void *cbdata)
+{
+    struct netna_data *nadata = cbdata;
+    unsigned int i;
+
+    /*
+     * Drain the pending connections, but only up to accept_batch of
+     * them, the rest will come on the next wakeup.
+     */
+    for (i = 0; i < nadata->accept_batch; i++) {
+	if (nadata->accepts_disabled)
+	    break;
+	if (netna_accept_one(nadata, iod))
+	    break;
+    }
 }
 
 #if HAVE_UNIX
@@ -782,8 +867,18 @@ netna_b4_listen(struct gensio_iod *iod, void *data)
     char unpath[MAX_UNIX_ADDR_PATH];
 #endif
 
-    if (nadata->istcp)
+    if (nadata->istcp) {
+#ifdef GENSIO_NET_ACCEPT_INHERITS_SETUP
+	/*
+	 * Set the options for new connections on the listener so
+	 * accepted sockets inherit them.  If that fails, set them on
+	 * each connection as it comes in.
+	 */
+	if (nadata->o->socket_set_setup(iod, netna_conn_setup(nadata), NULL))
+	    nadata->setup_inherited = false;
+#endif
 	return 0;
+    }
 
 #if HAVE_UNIX
     get_unix_addr_path(nadata->ai, unpath);
@@ -839,12 +934,77 @@ netna_b4_listen(struct gensio_iod *iod, void *data)
 #endif
 }
 
+/*
+ * Open reuseport sets of listening sockets, set n on reactor n, and
+ * put them all in acceptfds.
+ */
+static int
+netna_open_reuseport(struct netna_data *nadata)
+{
+    struct gensio_os_funcs *o;
+    struct gensio_opensocks *fds = NULL, *sfds, *nfds;
+    unsigned int nr_fds = 0, snr_fds, i, j;
+    int rv = 0;
+
+    for (i = 0; i < nadata->reuseport; i++) {
+	o = gensio_os_funcs_get_reactor(nadata->o, i);
+	rv = gensio_os_open_listen_sockets(o, nadata->ai,
+			       netna_readhandler,
+			       NULL, netna_fd_cleared, netna_b4_listen, nadata,
+			       (nadata->opensock_flags |
+				GENSIO_OPENSOCK_REUSEPORT),
+			       &sfds, &snr_fds);
+	if (rv)
+	    goto out_err;
+
+	nfds = nadata->o->zalloc(nadata->o,
+				 sizeof(*nfds) * (nr_fds + snr_fds));
+	if (!nfds) {
+	    for (j = 0; j < snr_fds; j++) {
+		o->clear_fd_handlers_norpt(sfds[j].iod);
+		o->close(&sfds[j].iod);
+	    }
+	    o->free(o, sfds);
+	    rv = GE_NOMEM;
+	    goto out_err;
+	}
+	if (fds) {
+	    memcpy(nfds, fds, sizeof(*fds) * nr_fds);
+	    nadata->o->free(nadata->o, fds);
+	}
+	memcpy(nfds + nr_fds, sfds, sizeof(*sfds) * snr_fds);
+	o->free(o, sfds);
+	fds = nfds;
+	nr_fds += snr_fds;
+    }
+
+    nadata->acceptfds = fds;
+    nadata->nr_acceptfds = nr_fds;
+    return 0;
+
+ out_err:
+    for (i = 0; i < nr_fds; i++) {
+	nadata->o->clear_fd_handlers_norpt(fds[i].iod);
+	nadata->o->close(&fds[i].iod);
+    }
+    if (fds)
+	nadata->o->free(nadata->o, fds);
+    return rv;
+}
+
 static int
 netna_startup(struct gensio_accepter *accepter, struct netna_data *nadata)
 {
     int rv;
 
-    rv = gensio_os_open_listen_sockets(nadata->o, nadata->ai,
+#ifdef GENSIO_NET_ACCEPT_INHERITS_SETUP
+    nadata->setup_inherited = nadata->istcp;
+#endif
+    nadata->accepts_disabled = false;
+    if (nadata->reuseport)
+	rv = netna_open_reuseport(nadata);
+    else
+	rv = gensio_os_open_listen_sockets(nadata->o, nadata->ai,
 			       netna_readhandler,
 			       NULL, netna_fd_cleared, netna_b4_listen, nadata,
 			       nadata->opensock_flags,
@@ -895,6 +1055,7 @@ netna_set_accept_callback_enable(struct gensio_accepter *accepter,
 	return GE_INUSE;
 
     nadata->cb_en_done = done;
+    nadata->accepts_disabled = !enabled;
     for (i = 0; i < nadata->nr_acceptfds; i++)
 	nadata->o->set_read_handler(nadata->acceptfds[i].iod, enabled);
 
@@ -1159,6 +1320,8 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
     bool nodelay = false;
     bool istcp = strcmp(type, "tcp") == 0;
     bool reuseaddr = istcp ? true : false;
+    unsigned int accept_batch = GENSIO_DEFAULT_NET_ACCEPT_BATCH;
+    unsigned int reuseport = 0;
 #if HAVE_UNIX
     unsigned int umode = 6, gmode = 6, omode = 6, mode;
     bool mode_set = false;
@@ -1204,6 +1367,24 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
 	if (istcp &&
 		gensio_pparm_bool(&p, args[i], "reuseaddr", &reuseaddr) > 0)
 	    continue;
+	if (gensio_pparm_uint(&p, args[i], "acceptbatch", &accept_batch) > 0) {
+	    if (accept_batch < 1 ||
+			accept_batch > GENSIO_MAX_NET_ACCEPT_BATCH) {
+		gensio_pparm_log(&p, "acceptbatch must be 1-%u",
+				 GENSIO_MAX_NET_ACCEPT_BATCH);
+		return GE_INVAL;
+	    }
+	    continue;
+	}
+	if (istcp &&
+		gensio_pparm_uint(&p, args[i], "reuseport", &reuseport) > 0) {
+	    if (reuseport > GENSIO_MAX_NET_REUSEPORT) {
+		gensio_pparm_log(&p, "reuseport must be 0-%u",
+				 GENSIO_MAX_NET_REUSEPORT);
+		return GE_INVAL;
+	    }
+	    continue;
+	}
 #ifdef HAVE_TCPD_H
 	if (istcp && gensio_pparm_value(&p, args[i], "tcpdname", &tcpdname))
 	    continue;
@@ -1242,6 +1423,12 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
 	return GE_INVAL;
     }
 
+    if (reuseport > 1 && gensio_addr_get_port(iai) == 0) {
+	/* Each set of sockets would get its own random port. */
+	gensio_pparm_slog(&p, "reuseport must have a port set");
+	return GE_INVAL;
+    }
+
     nadata = o->zalloc(o, sizeof(*nadata));
     if (!nadata)
 	return GE_NOMEM;
@@ -1294,6 +1481,8 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
     gensio_acc_set_is_reliable(nadata->acc, true);
     nadata->max_read_size = max_read_size;
     nadata->nodelay = nodelay;
+    nadata->accept_batch = accept_batch;
+    nadata->reuseport = reuseport;
 
     return 0;
 
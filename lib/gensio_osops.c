@@ -3936,6 +3936,17 @@ int gensio_os_funcs_start_timer_abs(struct gensio_os_funcs *o,
     return o->start_timer_abs(timer, timeout);
 }
 
+int
+gensio_os_funcs_start_timer_slack(struct gensio_os_funcs *o,
+				  struct gensio_timer *timer,
+				  gensio_time *timeout,
+				  gensio_time *slack)
+{
+    if (!o->start_timer_slack)
+	return o->start_timer(timer, timeout);
+    return o->start_timer_slack(timer, timeout, slack);
+}
+
 int
 gensio_os_funcs_stop_timer(struct gensio_os_funcs *o,
 			   struct gensio_timer *timer)
@@ -3982,6 +3993,125 @@ gensio_os_funcs_service(struct gensio_os_funcs *o, gensio_time *timeout)
     return o->service(o, timeout);
 }
 
+struct gensio_os_funcs *
+gensio_os_funcs_get_reactor(struct gensio_os_funcs *o, unsigned int idx)
+{
+    if (!o->get_reactor)
+	return o;
+    return o->get_reactor(o, idx);
+}
+
+int
+gensio_os_funcs_iod_set_reactor(struct gensio_iod *iod,
+				struct gensio_os_funcs *to)
+{
+    if (iod->f == to)
+	return 0;
+    if (!iod->f->iod_set_reactor)
+	return GE_NOTSUP;
+    return iod->f->iod_set_reactor(iod, to);
+}
+
+int
+gensio_os_mem_charge(struct gensio_os_funcs *o, gensiods *count,
+		     gensiods size)
+{
+    if (!o->mem_charge) {
+	if (count)
+	    __atomic_add_fetch(count, size, __ATOMIC_RELAXED);
+	return 0;
+    }
+    return o->mem_charge(o, count, size);
+}
+
+void
+gensio_os_mem_uncharge(struct gensio_os_funcs *o, gensiods *count,
+		       gensiods size)
+{
+    if (!o->mem_uncharge) {
+	if (count)
+	    __atomic_sub_fetch(count, size, __ATOMIC_RELAXED);
+	return;
+    }
+    o->mem_uncharge(o, count, size);
+}
+
+bool
+gensio_os_mem_over_soft_limit(struct gensio_os_funcs *o)
+{
+    if (!o->mem_over_soft_limit)
+	return false;
+    return o->mem_over_soft_limit(o);
+}
+
+bool
+gensio_os_mem_wait(struct gensio_os_funcs *o, struct gensio_os_mem_waiter *w)
+{
+    if (!o->mem_wait)
+	return false;
+    return o->mem_wait(o, w);
+}
+
+bool
+gensio_os_mem_wait_cancel(struct gensio_os_funcs *o,
+			  struct gensio_os_mem_waiter *w)
+{
+    if (!o->mem_wait_cancel)
+	return false;
+    return o->mem_wait_cancel(o, w);
+}
+
+int
+gensio_os_recvfrom_multi(struct gensio_iod *iod,
+			 struct gensio_recv_msg *msgs, unsigned int nmsgs,
+			 unsigned int *nrecv, int flags)
+{
+    struct gensio_os_funcs *o = iod->f;
+    int err;
+
+    if (o->recvfrom_multi)
+	return o->recvfrom_multi(iod, msgs, nmsgs, nrecv, flags);
+
+    *nrecv = 0;
+    if (nmsgs == 0)
+	return 0;
+    msgs[0].segsize = 0;
+    err = o->recvfrom(iod, msgs[0].buf, msgs[0].buflen, &msgs[0].len,
+		      flags, msgs[0].addr);
+    if (!err && msgs[0].len > 0)
+	*nrecv = 1;
+    return err;
+}
+
+int
+gensio_os_sendto_multi(struct gensio_iod *iod,
+		       struct gensio_send_msg *msgs, unsigned int nmsgs,
+		       unsigned int *nsent, int flags)
+{
+    struct gensio_os_funcs *o = iod->f;
+    unsigned int i;
+    int err;
+
+    if (o->sendto_multi)
+	return o->sendto_multi(iod, msgs, nmsgs, nsent, flags);
+
+    *nsent = 0;
+    for (i = 0; i < nmsgs; i++) {
+	err = o->sendto(iod, msgs[i].sg, msgs[i].sglen, &msgs[i].len,
+			flags, msgs[i].addr);
+	if (err) {
+	    /* Report errors after the first packet on the next send. */
+	    if (i == 0)
+		return err;
+	    break;
+	}
+	if (msgs[i].len == 0)
+	    break;
+	(*nsent)++;
+    }
+    return 0;
+}
+
 int
 gensio_os_funcs_handle_fork(struct gensio_os_funcs *o)
 {
@@ -0,0 +1,510 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#define _GNU_SOURCE /* Get splice() and pipe2(). */
+#include "config.h"
+#include <gensio/gensio_relay.h>
+#include <gensio/gensio_class.h>
+#include <gensio/gensio_base.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_err.h>
+
+#if defined(HAVE_SPLICE) && defined(HAVE_PIPE2)
+
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * Move at most this much per splice, it's the default pipe size so a
+ * splice into an empty pipe can take all of it.
+ */
+#define GENSIO_RELAY_CHUNK	65536
+
+/*
+ * Maximum number of chunks to move on one wakeup, so one busy
+ * direction doesn't starve everything else.
+ */
+#define GENSIO_RELAY_MAX_CHUNKS	16
+
+struct gensio_relay;
+
+struct relay_side {
+    struct gensio_relay *relay;
+    struct gensio_ll *ll;
+    struct gensio_ll_relay_hook hook;
+
+    /* Set to NULL when the ll is closed under us. */
+    struct gensio_iod *iod;
+    int fd;
+};
+
+/*
+ * Data moving from src to dst.  Normally the data is held in the
+ * pipe, but if splice() doesn't work on one of the fds (ttys on older
+ * kernels, for instance), the direction switches to copying through
+ * buf.
+ */
+struct relay_dir {
+    struct relay_side *src;
+    struct relay_side *dst;
+
+    int pipe[2];
+    gensiods in_pipe;
+
+    bool copy;
+    unsigned char *buf;
+    gensiods buf_pos;
+    gensiods buf_len;
+};
+
+struct gensio_relay {
+    struct gensio_os_funcs *o;
+    struct gensio_lock *lock;
+    unsigned int refcount;
+
+    struct relay_side side[2];
+    struct relay_dir dir[2];
+
+    bool stopped;
+    bool freed;
+    int err;
+
+    struct gensio_runner *runner;
+
+    gensio_relay_done done;
+    void *cb_data;
+};
+
+static void
+relay_lock(struct gensio_relay *relay)
+{
+    relay->o->lock(relay->lock);
+}
+
+static void
+relay_unlock(struct gensio_relay *relay)
+{
+    relay->o->unlock(relay->lock);
+}
+
+static void
+relay_finish_free(struct gensio_relay *relay)
+{
+    struct gensio_os_funcs *o = relay->o;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++) {
+	if (relay->dir[i].pipe[0] != -1) {
+	    close(relay->dir[i].pipe[0]);
+	    close(relay->dir[i].pipe[1]);
+	}
+	if (relay->dir[i].buf)
+	    o->free(o, relay->dir[i].buf);
+    }
+    if (relay->runner)
+	o->free_runner(relay->runner);
+    if (relay->lock)
+	o->free_lock(relay->lock);
+    o->free(o, relay);
+}
+
+static void
+relay_deref_and_unlock(struct gensio_relay *relay)
+{
+    unsigned int count;
+
+    assert(relay->refcount > 0);
+    count = --relay->refcount;
+    relay_unlock(relay);
+    if (count == 0)
+	relay_finish_free(relay);
+}
+
+static bool
+relay_pending(struct relay_dir *dir)
+{
+    return dir->in_pipe || dir->buf_len;
+}
+
+/* Enable the handlers for what each direction is waiting on. */
+static void
+relay_update_handlers(struct gensio_relay *relay)
+{
+    struct gensio_os_funcs *o = relay->o;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++) {
+	struct relay_dir *dir = &relay->dir[i];
+	bool pending = relay_pending(dir);
+
+	if (dir->src->iod)
+	    o->set_read_handler(dir->src->iod, !relay->stopped && !pending);
+	if (dir->dst->iod)
+	    o->set_write_handler(dir->dst->iod, !relay->stopped && pending);
+    }
+}
+
+static void
+relay_stop(struct gensio_relay *relay, int err)
+{
+    if (relay->stopped)
+	return;
+    relay->stopped = true;
+    relay->err = err;
+    relay_update_handlers(relay);
+    relay->refcount++;
+    relay->o->run(relay->runner);
+}
+
+static int
+relay_errno_to_err(struct gensio_relay *relay, int oserr)
+{
+    switch (oserr) {
+    case EPIPE:
+    case ECONNRESET:
+    case EIO: /* ptys return this when the other end goes away. */
+	return GE_REMCLOSE;
+    default:
+	return gensio_os_err_to_err(relay->o, oserr);
+    }
+}
+
+/*
+ * splice() doesn't work on one of the fds, copy from now on.  Anything
+ * already in the pipe is moved to the buffer.
+ */
+static int
+relay_to_copy(struct gensio_relay *relay, struct relay_dir *dir)
+{
+    ssize_t rv;
+
+    dir->copy = true;
+    if (!dir->buf) {
+	dir->buf = relay->o->zalloc(relay->o, GENSIO_RELAY_CHUNK);
+	if (!dir->buf)
+	    return GE_NOMEM;
+    }
+    dir->buf_pos = 0;
+    dir->buf_len = 0;
+    if (dir->in_pipe) {
+	rv = read(dir->pipe[0], dir->buf, dir->in_pipe);
+	if (rv < 0)
+	    return relay_errno_to_err(relay, errno);
+	dir->buf_len = rv;
+	dir->in_pipe -= rv;
+	if (dir->in_pipe)
+	    return GE_IOERR; /* Can't happen, the pipe had this much. */
+    }
+    return 0;
+}
+
+/* Get more data from the source.  Sets *again to false if none is ready. */
+static int
+relay_fill(struct gensio_relay *relay, struct relay_dir *dir, bool *again)
+{
+    ssize_t rv;
+
+    if (!dir->copy) {
+	rv = splice(dir->src->fd, NULL, dir->pipe[1], NULL, GENSIO_RELAY_CHUNK,
+		    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (rv < 0 && errno == EINVAL) {
+	    int err = relay_to_copy(relay, dir);
+
+	    if (err)
+		return err;
+	} else if (rv < 0) {
+	    goto out_err;
+	} else if (rv == 0) {
+	    return GE_REMCLOSE;
+	} else {
+	    dir->in_pipe = rv;
+	    return 0;
+	}
+    }
+
+    rv = read(dir->src->fd, dir->buf, GENSIO_RELAY_CHUNK);
+    if (rv < 0)
+	goto out_err;
+    if (rv == 0)
+	return GE_REMCLOSE;
+    dir->buf_pos = 0;
+    dir->buf_len = rv;
+    return 0;
+
+ out_err:
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+	*again = false;
+	return 0;
+    }
+    return relay_errno_to_err(relay, errno);
+}
+
+/* Send what we have to the destination. */
+static int
+relay_drain(struct gensio_relay *relay, struct relay_dir *dir)
+{
+    ssize_t rv;
+
+    if (dir->in_pipe) {
+	rv = splice(dir->pipe[0], NULL, dir->dst->fd, NULL, dir->in_pipe,
+		    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (rv < 0 && errno == EINVAL) {
+	    int err = relay_to_copy(relay, dir);
+
+	    if (err)
+		return err;
+	} else if (rv < 0) {
+	    goto out_err;
+	} else {
+	    dir->in_pipe -= rv;
+	    return 0;
+	}
+    }
+
+    if (dir->buf_len) {
+	rv = write(dir->dst->fd, dir->buf + dir->buf_pos, dir->buf_len);
+	if (rv < 0)
+	    goto out_err;
+	dir->buf_pos += rv;
+	dir->buf_len -= rv;
+    }
+    return 0;
+
+ out_err:
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	return 0;
+    return relay_errno_to_err(relay, errno);
+}
+
+/* Move data in one direction until it blocks.  Call with the lock held. */
+static void
+relay_move(struct gensio_relay *relay, struct relay_dir *dir)
+{
+    unsigned int i;
+    bool again = true;
+    int err = 0;
+
+    if (relay->stopped || !dir->src->iod || !dir->dst->iod)
+	return;
+
+    for (i = 0; again && i < GENSIO_RELAY_MAX_CHUNKS; i++) {
+	if (!relay_pending(dir)) {
+	    err = relay_fill(relay, dir, &again);
+	    if (err || !again)
+		break;
+	}
+	err = relay_drain(relay, dir);
+	if (err || relay_pending(dir))
+	    break;
+    }
+    if (err)
+	relay_stop(relay, err);
+    else
+	relay_update_handlers(relay);
+}
+
+static void
+relay_read_ready(struct gensio_ll_relay_hook *hook)
+{
+    struct relay_side *side = gensio_container_of(hook, struct relay_side,
+						  hook);
+    struct gensio_relay *relay = side->relay;
+
+    relay_lock(relay);
+    relay_move(relay, &relay->dir[side - relay->side]);
+    relay_unlock(relay);
+}
+
+static void
+relay_write_ready(struct gensio_ll_relay_hook *hook)
+{
+    struct relay_side *side = gensio_container_of(hook, struct relay_side,
+						  hook);
+    struct gensio_relay *relay = side->relay;
+
+    relay_lock(relay);
+    /* The direction writing to this side is the other side's. */
+    relay_move(relay, &relay->dir[1 - (side - relay->side)]);
+    relay_unlock(relay);
+}
+
+static void
+relay_closed(struct gensio_ll_relay_hook *hook)
+{
+    struct relay_side *side = gensio_container_of(hook, struct relay_side,
+						  hook);
+    struct gensio_relay *relay = side->relay;
+
+    relay_lock(relay);
+    side->iod = NULL;
+    hook->iod = NULL;
+    relay_stop(relay, GE_LOCALCLOSED);
+    relay_unlock(relay);
+}
+
+/*
+ * Give the lls back their own I/O.  This must not be called with the
+ * relay lock held, the ll calls the hooks with its lock held.
+ */
+static void
+relay_clear_hooks(struct gensio_relay *relay)
+{
+    gensio_ll_set_relay(relay->side[0].ll, NULL);
+    gensio_ll_set_relay(relay->side[1].ll, NULL);
+}
+
+static void
+relay_done_runner(struct gensio_runner *runner, void *cb_data)
+{
+    struct gensio_relay *relay = cb_data;
+    gensio_relay_done done = NULL;
+
+    relay_lock(relay);
+    if (!relay->freed) {
+	relay_unlock(relay);
+	relay_clear_hooks(relay);
+	relay_lock(relay);
+	if (!relay->freed)
+	    done = relay->done;
+    }
+    relay_unlock(relay);
+
+    if (done)
+	done(relay, relay->err, relay->cb_data);
+
+    relay_lock(relay);
+    relay_deref_and_unlock(relay); /* Lose the runner's ref. */
+}
+
+static int
+relay_get_ll(struct gensio *io, struct gensio_ll **ll)
+{
+    int rv;
+
+    rv = gensio_call_func(io, GENSIO_FUNC_GET_LL, NULL, NULL, 0, ll, NULL);
+    if (rv)
+	return GE_NOTSUP;
+    return 0;
+}
+
+int
+gensio_relay_alloc(struct gensio *io1, struct gensio *io2,
+		   gensio_relay_done done, void *cb_data,
+		   struct gensio_relay **rrelay)
+{
+    struct gensio_os_funcs *o = gensio_get_os_funcs(io1);
+    struct gensio_relay *relay;
+    struct gensio_ll *ll1, *ll2;
+    unsigned int i;
+    int rv;
+
+    rv = relay_get_ll(io1, &ll1);
+    if (!rv)
+	rv = relay_get_ll(io2, &ll2);
+    if (rv)
+	return rv;
+
+    relay = o->zalloc(o, sizeof(*relay));
+    if (!relay)
+	return GE_NOMEM;
+    relay->o = o;
+    relay->refcount = 1;
+    relay->done = done;
+    relay->cb_data = cb_data;
+    for (i = 0; i < 2; i++) {
+	relay->side[i].relay = relay;
+	relay->side[i].hook.read_ready = relay_read_ready;
+	relay->side[i].hook.write_ready = relay_write_ready;
+	relay->side[i].hook.closed = relay_closed;
+	relay->dir[i].src = &relay->side[i];
+	relay->dir[i].dst = &relay->side[1 - i];
+	relay->dir[i].pipe[0] = -1;
+    }
+    relay->side[0].ll = ll1;
+    relay->side[1].ll = ll2;
+
+    relay->lock = o->alloc_lock(o);
+    if (!relay->lock)
+	goto out_nomem;
+    relay->runner = o->alloc_runner(o, relay_done_runner, relay);
+    if (!relay->runner)
+	goto out_nomem;
+
+    for (i = 0; i < 2; i++) {
+	if (pipe2(relay->dir[i].pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+	    relay->dir[i].pipe[0] = -1;
+	    rv = gensio_os_err_to_err(o, errno);
+	    goto out_err;
+	}
+    }
+
+    rv = gensio_ll_set_relay(ll1, &relay->side[0].hook);
+    if (rv)
+	goto out_err;
+    rv = gensio_ll_set_relay(ll2, &relay->side[1].hook);
+    if (rv) {
+	gensio_ll_set_relay(ll1, NULL);
+	goto out_err;
+    }
+
+    relay_lock(relay);
+    for (i = 0; i < 2; i++) {
+	relay->side[i].iod = relay->side[i].hook.iod;
+	relay->side[i].fd = o->iod_get_fd(relay->side[i].iod);
+    }
+    relay_update_handlers(relay);
+    relay_unlock(relay);
+
+    *rrelay = relay;
+    return 0;
+
+ out_nomem:
+    rv = GE_NOMEM;
+ out_err:
+    relay_finish_free(relay);
+    return rv;
+}
+
+void
+gensio_relay_free(struct gensio_relay *relay)
+{
+    relay_lock(relay);
+    relay->freed = true;
+    if (!relay->stopped) {
+	relay->stopped = true;
+	relay_update_handlers(relay);
+    }
+    relay_unlock(relay);
+
+    /*
+     * After this no hook can be running, and the runner won't touch
+     * the lls since freed is set.
+     */
+    relay_clear_hooks(relay);
+
+    relay_lock(relay);
+    relay_deref_and_unlock(relay);
+}
+
+#else /* HAVE_SPLICE */
+
+int
+gensio_relay_alloc(struct gensio *io1, struct gensio *io2,
+		   gensio_relay_done done, void *cb_data,
+		   struct gensio_relay **relay)
+{
+    return GE_NOTSUP;
+}
+
+void
+gensio_relay_free(struct gensio_relay *relay)
+{
+}
+
+#endif /* HAVE_SPLICE */
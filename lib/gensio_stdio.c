@@ -304,6 +304,7 @@ check_waitpid(struct stdion_channel *schan)
     int rv;
     gensiods count = 0;
     gensio_time timeout = { 0, 10000000 };
+    gensio_time slack = { 0, 5000000 };
 
     if (nadata->closing_chan)
 	schan = nadata->closing_chan;
@@ -371,7 +372,8 @@ check_waitpid(struct stdion_channel *schan)
 	goto close_anyway;
     nadata->waitpid_retries++;
     stdiona_ref(nadata);
-    rv = o->start_timer(nadata->waitpid_timer, &timeout);
+    rv = gensio_os_funcs_start_timer_slack(o, nadata->waitpid_timer,
+					   &timeout, &slack);
     assert(rv == 0);
     nadata->closing_chan = schan;
 }
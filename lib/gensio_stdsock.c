@@ -32,6 +32,7 @@ typedef int sockret;
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <errno.h>
 #include <unistd.h>
 typedef socklen_t taddrlen;
@@ -84,8 +85,40 @@ struct gensio_stdsock_info {
     /* Is the extrainfo flag set? */
     bool extrainfo;
 #endif
+
+    /* UDP segment size for GSO sends and GRO receives, 0 if off. */
+    unsigned int gso_size;
+
+    /* SO_ZEROCOPY is on. */
+    bool zerocopy;
 };
 
+/*
+ * GSO is only done by sendto_multi and GRO packets are only split by
+ * recvfrom_multi, so those are required.
+ */
+#if defined(UDP_SEGMENT) && defined(HAVE_SENDMMSG)
+#define GENSIO_STDSOCK_UDP_GSO
+/* Maximum segments in one GSO send and the maximum total size. */
+#define GENSIO_STDSOCK_GSO_MAX_SEGS	64
+#define GENSIO_STDSOCK_GSO_MAX_BYTES	65507
+#endif
+#if defined(UDP_GRO) && defined(HAVE_RECVMMSG)
+#define GENSIO_STDSOCK_UDP_GRO
+#endif
+
+/*
+ * Zero-copy sends need the completions from the error queue, which
+ * is Linux specific.
+ */
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) \
+	&& defined(HAVE_SENDMSG) && defined(HAVE_RECVMSG)
+#include <linux/errqueue.h>
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+#define GENSIO_STDSOCK_ZEROCOPY
+#endif
+#endif
+
 struct gensio_listen_scan_info {
     unsigned int curr;
     unsigned int start;
@@ -163,6 +196,21 @@ do {								\
     rv = gensio_os_err_to_err(o, err);				\
 } while(0)
 
+/*
+ * recv() and send() are only used on stream sockets, so a short one
+ * means there is nothing more to read or no more room.  Tell the os
+ * handler, see GENSIO_IOD_CONTROL_DRAINED.
+ */
+static void
+gensio_stdsock_drained(struct gensio_iod *iod, gensiods *rcount,
+		       gensiods len, int write)
+{
+#ifdef HAVE_EPOLL_PWAIT
+    if (rcount && *rcount < len)
+	iod->f->iod_control(iod, GENSIO_IOD_CONTROL_DRAINED, false, write);
+#endif
+}
+
 static int
 close_socket(struct gensio_os_funcs *o, int fd)
 {
@@ -736,12 +784,17 @@ gensio_stdsock_recv(struct gensio_iod *iod, void *buf, gensiods buflen,
     sockret rv;
     int flags = (gflags & GENSIO_MSG_OOB) ? MSG_OOB : 0;
 
+    if (gflags & GENSIO_MSG_PEEK)
+	flags |= MSG_PEEK;
+
     if (do_errtrig())
 	return GE_NOMEM;
 
  retry:
     rv = recv(o->iod_get_fd(iod), buf, buflen, flags);
     ERRHANDLE();
+    if (!rv && !flags)
+	gensio_stdsock_drained(iod, rcount, buflen, 0);
     return rv;
 }
 
@@ -775,6 +828,19 @@ gensio_stdsock_send(struct gensio_iod *iod,
     sockret rv;
     int flags = (gflags & GENSIO_MSG_OOB) ? MSG_OOB : 0;
 
+    if (gflags & GENSIO_MSG_ZEROCOPY) {
+#ifdef GENSIO_STDSOCK_ZEROCOPY
+	struct gensio_stdsock_info *gsi;
+
+	if (o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
+			   (intptr_t) &gsi) || !gsi->zerocopy)
+	    return GE_NOTSUP;
+	flags |= MSG_ZEROCOPY;
+#else
+	return GE_NOTSUP;
+#endif
+    }
+
     if (do_errtrig())
 	return GE_NOMEM;
 
@@ -788,7 +854,21 @@ gensio_stdsock_send(struct gensio_iod *iod,
 
     retry:
 	rv = sendmsg(o->iod_get_fd(iod), &hdr, flags);
+#ifdef GENSIO_STDSOCK_ZEROCOPY
+	if (rv < 0 && (flags & MSG_ZEROCOPY) && sock_errno == ENOBUFS)
+	    /* Out of memory for pinning pages, the caller can copy. */
+	    return GE_NOMEM;
+#endif
 	ERRHANDLE();
+#ifdef HAVE_EPOLL_PWAIT
+	if (!rv) {
+	    gensiods i, len = 0;
+
+	    for (i = 0; i < sglen; i++)
+		len += sg[i].buflen;
+	    gensio_stdsock_drained(iod, rcount, len, 1);
+	}
+#endif
 #else
 	gensiods len;
 	void *buf;
@@ -851,6 +931,141 @@ gensio_stdsock_sendto(struct gensio_iod *iod,
     return rv;
 }
 
+/* Maximum number of packets to handle in one recvmmsg()/sendmmsg() call. */
+#define GENSIO_STDSOCK_MAX_MMSG 32
+
+#ifdef HAVE_SENDMMSG
+static gensiods
+gensio_stdsock_sg_len(const struct gensio_sg *sg, gensiods sglen)
+{
+    gensiods i, len = 0;
+
+    for (i = 0; i < sglen; i++)
+	len += sg[i].buflen;
+    return len;
+}
+
+static int
+gensio_stdsock_sendto_multi(struct gensio_iod *iod,
+			    struct gensio_send_msg *msgs, unsigned int nmsgs,
+			    unsigned int *nsent, int gflags)
+{
+    struct gensio_os_funcs *o = iod->f;
+    struct mmsghdr hdrs[GENSIO_STDSOCK_MAX_MMSG];
+    unsigned int nsegs[GENSIO_STDSOCK_MAX_MMSG];
+    gensiods lens[GENSIO_STDSOCK_MAX_MMSG];
+    struct addrinfo *ai;
+    unsigned int i, j, m, nhdrs;
+    int rv, flags = (gflags & GENSIO_MSG_OOB) ? MSG_OOB : 0;
+#ifdef GENSIO_STDSOCK_UDP_GSO
+    struct gensio_stdsock_info *gsi;
+    unsigned char ctrl[GENSIO_STDSOCK_MAX_MMSG][CMSG_SPACE(sizeof(uint16_t))];
+    struct iovec iovs[GENSIO_STDSOCK_MAX_MMSG * 2];
+    unsigned int iovpos = 0, first;
+    gensiods total, sglen;
+    struct cmsghdr *cmsg;
+    int err;
+#endif
+
+    if (do_errtrig())
+	return GE_NOMEM;
+
+#ifdef GENSIO_STDSOCK_UDP_GSO
+    err = o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
+			 (intptr_t) &gsi);
+    if (err)
+	return err;
+#endif
+
+    if (nmsgs > GENSIO_STDSOCK_MAX_MMSG)
+	nmsgs = GENSIO_STDSOCK_MAX_MMSG;
+    memset(hdrs, 0, sizeof(hdrs[0]) * nmsgs);
+    for (i = 0, nhdrs = 0; i < nmsgs; nhdrs++) {
+	lens[i] = gensio_stdsock_sg_len(msgs[i].sg, msgs[i].sglen);
+	ai = gensio_addr_addrinfo_get_curr(msgs[i].addr);
+	hdrs[nhdrs].msg_hdr.msg_name = (void *) ai->ai_addr;
+	hdrs[nhdrs].msg_hdr.msg_namelen = ai->ai_addrlen;
+	hdrs[nhdrs].msg_hdr.msg_iov = (struct iovec *) msgs[i].sg;
+	hdrs[nhdrs].msg_hdr.msg_iovlen = msgs[i].sglen;
+	nsegs[nhdrs] = 1;
+	i++;
+
+#ifdef GENSIO_STDSOCK_UDP_GSO
+	/*
+	 * Packets of exactly the segment size to the same address can
+	 * go out as one GSO send, the last one may be shorter.
+	 */
+	first = i - 1;
+	if (!gsi->gso_size || lens[first] != gsi->gso_size)
+	    continue;
+	total = lens[first];
+	while (i < nmsgs && nsegs[nhdrs] < GENSIO_STDSOCK_GSO_MAX_SEGS) {
+	    lens[i] = gensio_stdsock_sg_len(msgs[i].sg, msgs[i].sglen);
+	    if (lens[i] == 0 || lens[i] > gsi->gso_size ||
+			total + lens[i] > GENSIO_STDSOCK_GSO_MAX_BYTES)
+		break;
+	    if (msgs[i].addr != msgs[first].addr &&
+			!gensio_addr_equal(msgs[i].addr, msgs[first].addr,
+					   true, false))
+		break;
+	    sglen = msgs[i].sglen;
+	    if (nsegs[nhdrs] == 1)
+		sglen += msgs[first].sglen;
+	    if (iovpos + sglen > GENSIO_STDSOCK_MAX_MMSG * 2)
+		break;
+	    if (nsegs[nhdrs] == 1) {
+		/* Move the first packet's data into the iovec array. */
+		memcpy(iovs + iovpos, msgs[first].sg,
+		       sizeof(*iovs) * msgs[first].sglen);
+		hdrs[nhdrs].msg_hdr.msg_iov = iovs + iovpos;
+		iovpos += msgs[first].sglen;
+	    }
+	    memcpy(iovs + iovpos, msgs[i].sg, sizeof(*iovs) * msgs[i].sglen);
+	    iovpos += msgs[i].sglen;
+	    hdrs[nhdrs].msg_hdr.msg_iovlen += msgs[i].sglen;
+	    total += lens[i];
+	    nsegs[nhdrs]++;
+	    i++;
+	    if (lens[i - 1] < gsi->gso_size)
+		break; /* Only the last segment can be short. */
+	}
+	if (nsegs[nhdrs] > 1) {
+	    hdrs[nhdrs].msg_hdr.msg_control = ctrl[nhdrs];
+	    hdrs[nhdrs].msg_hdr.msg_controllen = sizeof(ctrl[nhdrs]);
+	    cmsg = CMSG_FIRSTHDR(&hdrs[nhdrs].msg_hdr);
+	    cmsg->cmsg_level = SOL_UDP;
+	    cmsg->cmsg_type = UDP_SEGMENT;
+	    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	    *((uint16_t *) CMSG_DATA(cmsg)) = gsi->gso_size;
+	}
+#endif
+    }
+
+ retry:
+    rv = sendmmsg(o->iod_get_fd(iod), hdrs, nhdrs, flags);
+    if (rv < 0) {
+	if (sock_errno == SOCK_EINTR)
+	    goto retry;
+	if (sock_errno == SOCK_EWOULDBLOCK || sock_errno == SOCK_EAGAIN)
+	    rv = 0; /* Nothing could be sent. */
+	else
+	    return gensio_os_err_to_err(o, sock_errno);
+    }
+
+    for (i = 0, m = 0; i < (unsigned int) rv; i++) {
+	if (nsegs[i] == 1) {
+	    msgs[m++].len = hdrs[i].msg_len;
+	} else {
+	    /* GSO sends are all or nothing. */
+	    for (j = 0; j < nsegs[i]; j++, m++)
+		msgs[m].len = lens[m];
+	}
+    }
+    *nsent = m;
+    return 0;
+}
+#endif
+
 static struct gensio_addr *
 gensio_addr_addrinfo_alloc_recvfrom(struct gensio_os_funcs *o)
 {
@@ -863,6 +1078,120 @@ gensio_addr_addrinfo_alloc_recvfrom(struct gensio_os_funcs *o)
 				     true);
 }
 
+#ifdef HAVE_RECVMSG
+/*
+ * Pull the interface index and destination address out of the
+ * control data from a received packet and put them in the second and
+ * third addresses in addr.
+ */
+static void
+gensio_stdsock_recv_extrainfo(struct msghdr *hdr, struct gensio_addr *addr)
+{
+    struct addrinfo *ai;
+    struct cmsghdr *cmsg;
+
+#ifdef IP_PKTINFO
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IP &&
+		    cmsg->cmsg_type == IP_PKTINFO) {
+	    struct in_pktinfo *pi;
+
+	    pi = (struct in_pktinfo *) CMSG_DATA(cmsg);
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = GENSIO_AF_IFINDEX;
+		inaddr = (struct sockaddr *) ai->ai_addr;
+		inaddr->sa_family = GENSIO_AF_IFINDEX;
+		*((unsigned int *) inaddr->sa_data) = pi->ipi_ifindex;
+	    }
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr_in *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = AF_INET;
+		inaddr = (struct sockaddr_in *) ai->ai_addr;
+		inaddr->sin_family = AF_INET;
+		inaddr->sin_port = 0;
+		inaddr->sin_addr = pi->ipi_addr;
+	    }
+	}
+    }
+#elif defined(IP_RECVIF) && defined(IP_RECVDSTADDR)
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IP &&
+		    cmsg->cmsg_type == IP_RECVIF) {
+	    uint16_t *iptr;
+	    struct sockaddr *inaddr;
+
+	    /*
+	     * There's no docs on this that I could find, but the
+	     * value seems to be in the second 16-bit value in the
+	     * data.  Not sure if it will work on big endian, or
+	     * if this is even right.
+	     */
+	    iptr = (uint16_t *) CMSG_DATA(cmsg);
+	    if (gensio_addr_next(addr)) {
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = GENSIO_AF_IFINDEX;
+		inaddr = (struct sockaddr *) ai->ai_addr;
+		inaddr->sa_family = GENSIO_AF_IFINDEX;
+		*((unsigned int *) inaddr->sa_data) = iptr[1];
+	    }
+	}
+    }
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IP &&
+		   cmsg->cmsg_type == IP_RECVDSTADDR) {
+	    struct sockaddr_in *inaddr;
+
+	    if (gensio_addr_next(addr)) {
+		struct in_addr *iptr;
+
+		iptr = (struct in_addr *) CMSG_DATA(cmsg);
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = AF_INET;
+		inaddr = (struct sockaddr_in *) ai->ai_addr;
+		inaddr->sin_family = AF_INET;
+		inaddr->sin_port = 0;
+		inaddr->sin_addr = *iptr;
+	    }
+	}
+    }
+#endif
+#ifdef IPV6_RECVPKTINFO
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IPV6 &&
+		    cmsg->cmsg_type == IPV6_PKTINFO) {
+	    struct in6_pktinfo *pi;
+
+	    pi = (struct in6_pktinfo *) CMSG_DATA(cmsg);
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = GENSIO_AF_IFINDEX;
+		inaddr = (struct sockaddr *) ai->ai_addr;
+		inaddr->sa_family = GENSIO_AF_IFINDEX;
+		*((unsigned int *) inaddr->sa_data) = pi->ipi6_ifindex;
+	    }
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr_in6 *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = AF_INET6;
+		inaddr = (struct sockaddr_in6 *) ai->ai_addr;
+		memset(inaddr, 0, sizeof(*inaddr));
+		inaddr->sin6_family = AF_INET6;
+		inaddr->sin6_addr = pi->ipi6_addr;
+	    }
+	}
+    }
+#endif
+}
+#endif
+
 static int
 gensio_stdsock_recvfrom(struct gensio_iod *iod,
 			void *buf, gensiods buflen, gensiods *rcount,
@@ -919,114 +1248,123 @@ gensio_stdsock_recvfrom(struct gensio_iod *iod,
 	    err = sock_errno;
     }
 #ifdef HAVE_RECVMSG
-    if (!err && gsi->extrainfo) {
-	struct cmsghdr *cmsg;
+    if (!err && gsi->extrainfo)
+	gensio_stdsock_recv_extrainfo(&hdr, addr);
+#endif
+    gensio_addr_rewind(addr);
+    if (!err && rcount)
+	*rcount = rv;
+    return gensio_os_err_to_err(o, err);
+}
 
-#ifdef IP_PKTINFO
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IP &&
-			cmsg->cmsg_type == IP_PKTINFO) {
-		struct in_pktinfo *pi;
-
-		pi = (struct in_pktinfo *) CMSG_DATA(cmsg);
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = GENSIO_AF_IFINDEX;
-		    inaddr = (struct sockaddr *) ai->ai_addr;
-		    inaddr->sa_family = GENSIO_AF_IFINDEX;
-		    *((unsigned int *) inaddr->sa_data) = pi->ipi_ifindex;
-		}
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr_in *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = AF_INET;
-		    inaddr = (struct sockaddr_in *) ai->ai_addr;
-		    inaddr->sin_family = AF_INET;
-		    inaddr->sin_port = 0;
-		    inaddr->sin_addr = pi->ipi_addr;
-		}
-	    }
-	}
-#elif defined(IP_RECVIF) && defined(IP_RECVDSTADDR)
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IP &&
-			cmsg->cmsg_type == IP_RECVIF) {
-		uint16_t *iptr;
-		struct sockaddr *inaddr;
 
-		/*
-		 * There's no docs on this that I could find, but the
-		 * value seems to be in the second 16-bit value in the
-		 * data.  Not sure if it will work on big endian, or
-		 * if this is even right.
-		 */
-		iptr = (uint16_t *) CMSG_DATA(cmsg);
-		if (gensio_addr_next(addr)) {
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = GENSIO_AF_IFINDEX;
-		    inaddr = (struct sockaddr *) ai->ai_addr;
-		    inaddr->sa_family = GENSIO_AF_IFINDEX;
-		    *((unsigned int *) inaddr->sa_data) = iptr[1];
-		}
-	    }
-	}
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IP &&
-		       cmsg->cmsg_type == IP_RECVDSTADDR) {
-		struct sockaddr_in *inaddr;
+#ifdef HAVE_RECVMMSG
+static int
+gensio_stdsock_recvfrom_multi(struct gensio_iod *iod,
+			      struct gensio_recv_msg *msgs, unsigned int nmsgs,
+			      unsigned int *nrecv, int flags)
+{
+    struct gensio_os_funcs *o = iod->f;
+    struct gensio_stdsock_info *gsi;
+    struct mmsghdr hdrs[GENSIO_STDSOCK_MAX_MMSG];
+    struct iovec iovs[GENSIO_STDSOCK_MAX_MMSG];
+    unsigned char ctrlinfo[GENSIO_STDSOCK_MAX_MMSG][128];
+    struct addrinfo *ai;
+    unsigned int i;
+    int rv, err;
 
-		if (gensio_addr_next(addr)) {
-		    struct in_addr *iptr;
+    if (do_errtrig())
+	return GE_NOMEM;
 
-		    iptr = (struct in_addr *) CMSG_DATA(cmsg);
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = AF_INET;
-		    inaddr = (struct sockaddr_in *) ai->ai_addr;
-		    inaddr->sin_family = AF_INET;
-		    inaddr->sin_port = 0;
-		    inaddr->sin_addr = *iptr;
-		}
-	    }
+    err = o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
+			 (intptr_t) &gsi);
+    if (err)
+	return err;
+
+    if (nmsgs > GENSIO_STDSOCK_MAX_MMSG)
+	nmsgs = GENSIO_STDSOCK_MAX_MMSG;
+    memset(hdrs, 0, sizeof(hdrs[0]) * nmsgs);
+    for (i = 0; i < nmsgs; i++) {
+	gensio_addr_rewind(msgs[i].addr);
+	ai = gensio_addr_addrinfo_get_curr(msgs[i].addr);
+	hdrs[i].msg_hdr.msg_name = ai->ai_addr;
+	hdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+	iovs[i].iov_base = msgs[i].buf;
+	iovs[i].iov_len = msgs[i].buflen;
+	hdrs[i].msg_hdr.msg_iov = &iovs[i];
+	hdrs[i].msg_hdr.msg_iovlen = 1;
+	if (gsi->extrainfo || gsi->gso_size) {
+	    hdrs[i].msg_hdr.msg_control = ctrlinfo[i];
+	    hdrs[i].msg_hdr.msg_controllen = sizeof(ctrlinfo[i]);
 	}
-#endif
-#ifdef IPV6_RECVPKTINFO
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IPV6 &&
-			cmsg->cmsg_type == IPV6_PKTINFO) {
-		struct in6_pktinfo *pi;
-
-		pi = (struct in6_pktinfo *) CMSG_DATA(cmsg);
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = GENSIO_AF_IFINDEX;
-		    inaddr = (struct sockaddr *) ai->ai_addr;
-		    inaddr->sa_family = GENSIO_AF_IFINDEX;
-		    *((unsigned int *) inaddr->sa_data) = pi->ipi6_ifindex;
-		}
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr_in6 *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = AF_INET6;
-		    inaddr = (struct sockaddr_in6 *) ai->ai_addr;
-		    memset(inaddr, 0, sizeof(*inaddr));
-		    inaddr->sin6_family = AF_INET6;
-		    inaddr->sin6_addr = pi->ipi6_addr;
+	msgs[i].segsize = 0;
+    }
+
+ retry:
+    rv = recvmmsg(o->iod_get_fd(iod), hdrs, nmsgs, flags, NULL);
+    if (rv < 0) {
+	if (sock_errno == SOCK_EINTR)
+	    goto retry;
+	if (sock_errno == SOCK_EWOULDBLOCK || sock_errno == SOCK_EAGAIN)
+	    rv = 0; /* Nothing was ready. */
+	else
+	    return gensio_os_err_to_err(o, sock_errno);
+    }
+
+    for (i = 0; i < (unsigned int) rv; i++) {
+	ai = gensio_addr_addrinfo_get_curr(msgs[i].addr);
+	ai->ai_addrlen = hdrs[i].msg_hdr.msg_namelen;
+	ai->ai_family = ai->ai_addr->sa_family;
+	msgs[i].len = hdrs[i].msg_len;
+	if (gsi->extrainfo)
+	    gensio_stdsock_recv_extrainfo(&hdrs[i].msg_hdr, msgs[i].addr);
+#ifdef GENSIO_STDSOCK_UDP_GRO
+	if (gsi->gso_size) {
+	    struct cmsghdr *cmsg;
+	    struct msghdr *hdr = &hdrs[i].msg_hdr;
+
+	    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg;
+		 cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP &&
+			    cmsg->cmsg_type == UDP_GRO) {
+		    int segsize = *((int *) CMSG_DATA(cmsg));
+
+		    /* The kernel coalesced packets, report the size. */
+		    if (segsize > 0 && (gensiods) segsize < msgs[i].len)
+			msgs[i].segsize = segsize;
 		}
 	    }
 	}
 #endif
+	gensio_addr_rewind(msgs[i].addr);
     }
+    *nrecv = rv;
+    return 0;
+}
+#endif
+
+/*
+ * If the os funcs have socket busy polling turned on, set it on the
+ * socket.  This is just a hint, and raising it may require privileges,
+ * so errors are ignored.
+ */
+static void
+gensio_stdsock_set_busy_poll(struct gensio_os_funcs *o, int fd)
+{
+#ifdef SO_BUSY_POLL
+    struct gensio_os_busy_poll bp;
+    gensiods len = sizeof(bp);
+    int val;
+
+    if (!o->control)
+	return;
+    if (o->control(o, GENSIO_CONTROL_GET_BUSY_POLL, &bp, &len))
+	return;
+    if (!bp.sock_usecs)
+	return;
+    val = bp.sock_usecs;
+    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val));
 #endif
-    gensio_addr_rewind(addr);
-    if (!err && rcount)
-	*rcount = rv;
-    return gensio_os_err_to_err(o, err);
 }
 
 static int
@@ -1059,7 +1397,12 @@ gensio_stdsock_accept(struct gensio_iod *iod,
 	len = sizeof(sadata);
     }
 
+#ifdef HAVE_ACCEPT4
+    /* Get non-blocking and close-on-exec without the extra syscalls. */
+    rv = accept4(o->iod_get_fd(iod), sa, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     rv = accept(o->iod_get_fd(iod), sa, &len);
+#endif
 
     if (rv >= 0) {
 	gsi = o->zalloc(o, sizeof(*gsi));
@@ -1074,10 +1417,13 @@ gensio_stdsock_accept(struct gensio_iod *iod,
 	    close_socket(o, rv);
 	    goto out;
 	}
+	gensio_stdsock_set_busy_poll(o, rv);
 
+#ifndef HAVE_ACCEPT4
 	err = o->set_non_blocking(riod);
 	if (err)
 	    goto out;
+#endif
 
 	o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
 		       (intptr_t) &ogsi);
@@ -1094,7 +1440,7 @@ gensio_stdsock_accept(struct gensio_iod *iod,
 	*newiod = riod;
     } else {
 	rv = sock_errno;
-	if (rv == SOCK_EAGAIN && rv == SOCK_EWOULDBLOCK)
+	if (rv == SOCK_EAGAIN || rv == SOCK_EWOULDBLOCK)
 	    err = GE_NODATA;
 	else
 	    err = gensio_os_err_to_err(o, rv);
@@ -1193,6 +1539,7 @@ gensio_stdsock_socket_open(struct gensio_os_funcs *o,
 	close_socket(o, newfd);
 	return err;
     }
+    gensio_stdsock_set_busy_poll(o, newfd);
     err = o->set_non_blocking(iod);
     if (err) {
 	o->close(&iod);
@@ -1259,6 +1606,17 @@ gensio_stdsock_socket_set_setup(struct gensio_iod *iod,
 	    return gensio_os_err_to_err(o, sock_errno);
     }
 
+    if (opensock_flags & GENSIO_SET_OPENSOCK_REUSEPORT) {
+#ifdef SO_REUSEPORT
+	val = !!(opensock_flags & GENSIO_OPENSOCK_REUSEPORT);
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+		       (void *)&val, sizeof(val)) == -1)
+	    return gensio_os_err_to_err(o, sock_errno);
+#else
+	return GE_NOTSUP;
+#endif
+    }
+
     if (bindaddr) {
 	struct addrinfo *ai;
 
@@ -1952,6 +2310,144 @@ gensio_stdsock_get_extrainfo(struct gensio_iod *iod, unsigned int *val)
 #endif
 }
 
+static int
+gensio_stdsock_set_gso(struct gensio_iod *iod, unsigned int val)
+{
+#ifndef GENSIO_STDSOCK_UDP_GSO
+    return GE_NOTSUP;
+#else
+    struct gensio_os_funcs *o = iod->f;
+    struct gensio_stdsock_info *gsi;
+    int err;
+
+    err = o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
+			 (intptr_t) &gsi);
+    if (err)
+	return err;
+
+    if (gsi->protocol != GENSIO_NET_PROTOCOL_UDP)
+	return GE_INVAL;
+    if (val > GENSIO_STDSOCK_GSO_MAX_BYTES)
+	return GE_INVAL;
+    /* The fallbacks for these can't split or coalesce packets. */
+    if (val && (!o->recvfrom_multi || !o->sendto_multi))
+	return GE_NOTSUP;
+
+#ifdef GENSIO_STDSOCK_UDP_GRO
+    {
+	int on = !!val;
+
+	err = setsockopt(o->iod_get_fd(iod), SOL_UDP, UDP_GRO,
+			 &on, sizeof(on));
+	if (err)
+	    return gensio_os_err_to_err(o, sock_errno);
+    }
+#endif
+    gsi->gso_size = val;
+    return 0;
+#endif
+}
+
+static int
+gensio_stdsock_get_gso(struct gensio_iod *iod, unsigned int *val)
+{
+    struct gensio_os_funcs *o = iod->f;
+    struct gensio_stdsock_info *gsi;
+    int err;
+
+    err = o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
+			 (intptr_t) &gsi);
+    if (err)
+	return err;
+
+    *val = gsi->gso_size;
+    return 0;
+}
+
+static int
+gensio_stdsock_set_zerocopy(struct gensio_iod *iod, bool val)
+{
+#ifndef GENSIO_STDSOCK_ZEROCOPY
+    return GE_NOTSUP;
+#else
+    struct gensio_os_funcs *o = iod->f;
+    struct gensio_stdsock_info *gsi;
+    int err, on = val;
+
+    err = o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
+			 (intptr_t) &gsi);
+    if (err)
+	return err;
+
+    if (gsi->protocol != GENSIO_NET_PROTOCOL_TCP)
+	return GE_NOTSUP;
+
+    if (setsockopt(o->iod_get_fd(iod), SOL_SOCKET, SO_ZEROCOPY,
+		   &on, sizeof(on)) == -1) {
+	if (sock_errno == ENOPROTOOPT || sock_errno == EOPNOTSUPP)
+	    return GE_NOTSUP;
+	return gensio_os_err_to_err(o, sock_errno);
+    }
+    /* The completions come in on the error queue. */
+    err = o->iod_control(iod, GENSIO_IOD_CONTROL_ERRQUEUE, false, val);
+    if (err)
+	return err;
+    gsi->zerocopy = val;
+    return 0;
+#endif
+}
+
+/*
+ * Pull the next zero-copy completion off the error queue.  Other
+ * things on the error queue are thrown away.
+ */
+static int
+gensio_stdsock_get_zerocopy_done(struct gensio_iod *iod,
+				 struct gensio_zerocopy_done *done)
+{
+#ifndef GENSIO_STDSOCK_ZEROCOPY
+    return GE_NOTSUP;
+#else
+    struct gensio_os_funcs *o = iod->f;
+    struct sock_extended_err *serr;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    union {
+	char buf[CMSG_SPACE(sizeof(*serr)) * 4];
+	struct cmsghdr align;
+    } ctrl;
+
+    for (;;) {
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
+	if (recvmsg(o->iod_get_fd(iod), &msg, MSG_ERRQUEUE) == -1) {
+	    if (sock_errno == SOCK_EINTR)
+		continue;
+	    if (sock_errno == SOCK_EAGAIN || sock_errno == SOCK_EWOULDBLOCK)
+		return GE_NODATA;
+	    return gensio_os_err_to_err(o, sock_errno);
+	}
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	    if (!((cmsg->cmsg_level == SOL_IP &&
+		   cmsg->cmsg_type == IP_RECVERR) ||
+		  (cmsg->cmsg_level == SOL_IPV6 &&
+		   cmsg->cmsg_type == IPV6_RECVERR)))
+		continue;
+	    serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+	    if (serr->ee_errno != 0 ||
+			serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		continue;
+	    /* ee_info to ee_data is the range of sends completed. */
+	    done->first = serr->ee_info;
+	    done->last = serr->ee_data;
+	    return 0;
+	}
+    }
+#endif
+}
+
 static int
 gensio_stdsock_control(struct gensio_iod *iod, int func,
 		       void *data, gensiods *datalen)
@@ -1993,6 +2489,22 @@ gensio_stdsock_control(struct gensio_iod *iod, int func,
 	if (*datalen != sizeof(unsigned int))
 	    return GE_INVAL;
 	return gensio_stdsock_get_extrainfo(iod, ((unsigned int *) data));
+    case GENSIO_SOCKCTL_SET_GSO:
+	if (*datalen != sizeof(unsigned int))
+	    return GE_INVAL;
+	return gensio_stdsock_set_gso(iod, *((unsigned int *) data));
+    case GENSIO_SOCKCTL_GET_GSO:
+	if (*datalen != sizeof(unsigned int))
+	    return GE_INVAL;
+	return gensio_stdsock_get_gso(iod, ((unsigned int *) data));
+    case GENSIO_SOCKCTL_SET_ZEROCOPY:
+	if (*datalen != sizeof(bool))
+	    return GE_INVAL;
+	return gensio_stdsock_set_zerocopy(iod, *((bool *) data));
+    case GENSIO_SOCKCTL_GET_ZEROCOPY_DONE:
+	if (*datalen != sizeof(struct gensio_zerocopy_done))
+	    return GE_INVAL;
+	return gensio_stdsock_get_zerocopy_done(iod, data);
     default:
 	return GE_NOTSUP;
     }
@@ -2231,6 +2743,25 @@ gensio_setup_listen_socket(struct gensio_os_funcs *o, bool do_listen,
 	}
     }
 
+    if (opensock_flags & GENSIO_OPENSOCK_REUSEPORT) {
+#ifdef SO_REUSEPORT
+	/*
+	 * Unix sockets can't share a path, and reuseaddr would delete
+	 * the other sockets' path anyway.
+	 */
+	if (family == AF_UNIX) {
+	    rv = GE_NOTSUP;
+	    goto out;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+		       (void *) &optval, sizeof(optval)) == -1)
+	    goto out_err;
+#else
+	rv = GE_NOTSUP;
+	goto out;
+#endif
+    }
+
     if (check_ipv6_only(family, sockproto, flags, fd) == -1)
 	goto out_err;
 #if !HAVE_WORKING_PORT0
@@ -2324,7 +2855,11 @@ gensio_setup_listen_socket(struct gensio_os_funcs *o, bool do_listen,
 	    goto out;
     }
 
-    if (do_listen && listen(fd, 5) != 0)
+    /*
+     * Accepters drain the queue in batches, give them room to hold a
+     * burst of connections between wakeups.
+     */
+    if (do_listen && listen(fd, SOMAXCONN) != 0)
 	goto out_err;
 
  out:
@@ -2358,6 +2893,12 @@ gensio_stdsock_set_os_funcs(struct gensio_os_funcs *o)
     o->sendto = gensio_stdsock_sendto;
     o->addr_alloc_recvfrom = gensio_addr_addrinfo_alloc_recvfrom;
     o->recvfrom = gensio_stdsock_recvfrom;
+#ifdef HAVE_RECVMMSG
+    o->recvfrom_multi = gensio_stdsock_recvfrom_multi;
+#endif
+#ifdef HAVE_SENDMMSG
+    o->sendto_multi = gensio_stdsock_sendto_multi;
+#endif
     o->accept = gensio_stdsock_accept;
     o->socket_open = gensio_stdsock_socket_open;
     o->socket_set_setup = gensio_stdsock_socket_set_setup;
@@ -30,6 +30,25 @@
  */
 #define GENSIO_DEFAULT_UDP_BUF_SIZE	65536
 
+/*
+ * Number of packet slots for accepters and clients by default, and
+ * the limits.  No more than UDPNA_MAX_BATCH packets are received
+ * with one system call.
+ */
+#define GENSIO_DEFAULT_UDP_ACC_BATCH	16
+#define GENSIO_DEFAULT_UDP_BATCH	1
+#define GENSIO_MAX_UDP_BATCH		1024
+#define UDPNA_MAX_BATCH			32
+
+/* Space for packets queued to be sent together. */
+#define UDPNA_TX_BUF_SIZE		65536
+
+/*
+ * Starting number of buckets in the remote address hash table, it
+ * doubles when the average chain gets longer than two.
+ */
+#define UDPNA_HASH_INIT_SIZE		16
+
 struct udpna_data;
 
 enum udpn_state {
@@ -39,6 +58,25 @@ enum udpn_state {
     UDPN_IN_CLOSE
 };
 
+/*
+ * A received packet.  The address is allocated with the slot and is
+ * filled in by the receive, so each queued packet keeps its own
+ * source address.  If segsize is not zero, the OS coalesced packets
+ * of that size (the last may be shorter) into the slot and they are
+ * delivered one at a time.
+ */
+struct udpna_slot {
+    struct gensio_link link;
+    struct gensio_addr *addr;
+    unsigned char *data;
+    gensiods len;
+    gensiods pos;
+    gensiods segsize;
+};
+
+#define gensio_link_to_slot(l) \
+    gensio_container_of(l, struct udpna_slot, link)
+
 struct udpn_data {
     struct gensio *io;
     struct udpna_data *nadata;
@@ -53,7 +91,6 @@ struct udpn_data {
     bool in_read;	/* Currently in a read callback. */
     bool deferred_read;
     bool in_write;	/* Currently in a write callback. */
-    bool write_pending; /* Need to redo the write callback. */
     bool in_open_cb;	/* Currently in an open callback. */
     bool in_close_cb;	/* Currently in a close callback. */
     bool extrainfo;	/* Deliver extrainfo to user? */
@@ -71,12 +108,42 @@ struct udpn_data {
     struct gensio_runner *deferred_op_runner;	/* NULL if not a client. */
 
     struct gensio_addr *raddr;		/* Points to remote, for convenience. */
+    uint32_t raddr_hash;		/* Hash of raddr. */
+    struct gensio_link hlink;		/* In the accepter's hash table. */
+
+    /* Received packets waiting to be delivered to the user. */
+    struct gensio_list pending;
+
+    /*
+     * Number of packets in the accepter's transmit queue from this
+     * udpn, the close won't finish until they are sent.  tx_err holds
+     * an error from sending a queued packet, it is returned from the
+     * next write.
+     */
+    unsigned int tx_queued;
+    int tx_err;
+
+    /* For the write handler's list of udpns to call. */
+    struct gensio_link wlink;
 
     struct gensio_link link;
 };
 
 #define gensio_link_to_ndata(l) \
     gensio_container_of(l, struct udpn_data, link);
+#define gensio_wlink_to_ndata(l) \
+    gensio_container_of(l, struct udpn_data, wlink);
+#define gensio_hlink_to_ndata(l) \
+    gensio_container_of(l, struct udpn_data, hlink);
+
+/* A packet waiting to be sent, the data is in tx_data. */
+struct udpna_txmsg {
+    struct udpn_data *ndata;
+    struct gensio_iod *iod;
+    struct gensio_addr *addr;	/* Freed after sending, NULL for raddr. */
+    gensiods pos;
+    gensiods len;
+};
 
 struct udpna_data;
 
@@ -104,15 +171,29 @@ struct udpna_data {
 
     gensiods max_read_size;
 
+    /*
+     * Packets are received in batches into free slots, then each slot
+     * is queued on the udpn it belongs to until the user consumes it.
+     * Reading from the socket is only stopped when all the slots are
+     * in use.  read_data backs the data for all the slots.
+     */
     unsigned char *read_data;
-
-    bool readhandler_read_disabled;
-    gensiods data_pending_len;
-    gensiods data_pos;
-    struct udpn_data *pending_data_owner;
+    struct udpna_slot *slots;
+    unsigned int nr_slots;
+    struct gensio_list free_slots;
+    bool slots_read_disabled;
 
     struct gensio_list closed_udpns;
 
+    /*
+     * Every udpn on udpns or closed_udpns is also in this hash table
+     * by remote address, for looking up the udpn for a packet.  The
+     * size is a power of two.
+     */
+    struct gensio_list *udpn_hash;
+    unsigned int udpn_hash_size;
+    unsigned int udpn_hash_count;
+
     /*
      * Used to run read callbacks from the selector to avoid running
      * it directly from user calls.
@@ -146,9 +227,21 @@ struct udpna_data {
     unsigned int extrainfo; /* Is extrainfo enabled or disabled in the iod? */
 
     bool nocon;		/* Disable connection-oriented handling. */
-    struct gensio_addr *curr_recvaddr;	/* Address of current received packet */
 
-    bool in_write;
+    unsigned int gso_size; /* Segment size for offload, 0 for none. */
+
+    /*
+     * Packets written from write callbacks are queued here and sent
+     * together when the write handler is done calling the udpns or
+     * when the queue is full.  All the packets are for the same iod.
+     * tx_data is allocated on first use.
+     */
+    struct udpna_txmsg txq[UDPNA_MAX_BATCH];
+    unsigned int txq_len;
+    unsigned char *tx_data;
+    gensiods tx_data_len;
+
+    bool in_write;	/* The write handler is calling the udpns. */
     unsigned int read_disable_count;
     bool read_disabled;
     unsigned int write_enable_count;
@@ -296,20 +389,77 @@ udpn_remove_from_list(struct gensio_list *list, struct udpn_data *ndata)
 }
 
 static struct udpn_data *
-udpn_find(struct gensio_list *list, struct gensio_addr *addr)
+udpn_find(struct udpna_data *nadata, struct gensio_list *list,
+	  struct gensio_addr *addr)
 {
+    struct gensio_list *bucket;
     struct gensio_link *l;
+    uint32_t hash = gensio_addr_hash(addr, true, false);
 
-    gensio_list_for_each(list, l) {
-	struct udpn_data *ndata = gensio_link_to_ndata(l);
+    bucket = &nadata->udpn_hash[hash & (nadata->udpn_hash_size - 1)];
+    gensio_list_for_each(bucket, l) {
+	struct udpn_data *ndata = gensio_hlink_to_ndata(l);
 
-	if (gensio_addr_equal(ndata->raddr, addr, true, false))
+	if (ndata->raddr_hash == hash &&
+		gensio_list_link_in_this_list(&ndata->link, list) &&
+		gensio_addr_equal(ndata->raddr, addr, true, false))
 	    return ndata;
     }
 
     return NULL;
 }
 
+static void
+udpna_hash_grow(struct udpna_data *nadata)
+{
+    struct gensio_os_funcs *o = nadata->o;
+    unsigned int i, size = nadata->udpn_hash_size * 2;
+    struct gensio_list *hash;
+    struct gensio_link *l;
+
+    hash = o->zalloc(o, sizeof(*hash) * size);
+    if (!hash)
+	return; /* Just live with longer chains. */
+    for (i = 0; i < size; i++)
+	gensio_list_init(&hash[i]);
+
+    for (i = 0; i < nadata->udpn_hash_size; i++) {
+	while (!gensio_list_empty(&nadata->udpn_hash[i])) {
+	    struct udpn_data *ndata;
+
+	    l = gensio_list_first(&nadata->udpn_hash[i]);
+	    gensio_list_rm(&nadata->udpn_hash[i], l);
+	    ndata = gensio_hlink_to_ndata(l);
+	    gensio_list_add_tail(&hash[ndata->raddr_hash & (size - 1)], l);
+	}
+    }
+    o->free(o, nadata->udpn_hash);
+    nadata->udpn_hash = hash;
+    nadata->udpn_hash_size = size;
+}
+
+static void
+udpn_hash_add(struct udpna_data *nadata, struct udpn_data *ndata)
+{
+    unsigned int b;
+
+    ndata->raddr_hash = gensio_addr_hash(ndata->raddr, true, false);
+    b = ndata->raddr_hash & (nadata->udpn_hash_size - 1);
+    gensio_list_add_tail(&nadata->udpn_hash[b], &ndata->hlink);
+    nadata->udpn_hash_count++;
+    if (nadata->udpn_hash_count > nadata->udpn_hash_size * 2)
+	udpna_hash_grow(nadata);
+}
+
+static void
+udpn_hash_rm(struct udpna_data *nadata, struct udpn_data *ndata)
+{
+    unsigned int b = ndata->raddr_hash & (nadata->udpn_hash_size - 1);
+
+    gensio_list_rm(&nadata->udpn_hash[b], &ndata->hlink);
+    nadata->udpn_hash_count--;
+}
+
 static void udpn_add_to_list(struct gensio_list *list, struct udpn_data *ndata)
 {
     gensio_list_add_tail(list, &ndata->link);
@@ -362,6 +512,28 @@ i_udpna_fd_read_disable(struct udpna_data *nadata, int line)
 }
 #define udpna_fd_read_disable(nadata) i_udpna_fd_read_disable(nadata, __LINE__)
 
+static void
+udpna_put_slot(struct udpna_data *nadata, struct udpna_slot *slot)
+{
+    gensio_list_add_tail(&nadata->free_slots, &slot->link);
+    if (nadata->slots_read_disabled) {
+	nadata->slots_read_disabled = false;
+	udpna_fd_read_enable(nadata);
+    }
+}
+
+static void
+udpn_flush_pending(struct udpna_data *nadata, struct udpn_data *ndata)
+{
+    struct gensio_link *l;
+
+    while (!gensio_list_empty(&ndata->pending)) {
+	l = gensio_list_first(&ndata->pending);
+	gensio_list_rm(&ndata->pending, l);
+	udpna_put_slot(nadata, gensio_link_to_slot(l));
+    }
+}
+
 static void
 udpna_disable_write(struct udpna_data *nadata)
 {
@@ -415,10 +587,23 @@ udpna_do_free(struct udpna_data *nadata)
 	gensio_addr_free(nadata->ai);
     if (nadata->fds)
 	nadata->o->free(nadata->o, nadata->fds);
-    if (nadata->curr_recvaddr)
-	gensio_addr_free(nadata->curr_recvaddr);
+    if (nadata->udpn_hash)
+	nadata->o->free(nadata->o, nadata->udpn_hash);
+    if (nadata->slots) {
+	for (i = 0; i < nadata->nr_slots; i++) {
+	    if (nadata->slots[i].addr)
+		gensio_addr_free(nadata->slots[i].addr);
+	}
+	nadata->o->free(nadata->o, nadata->slots);
+    }
     if (nadata->read_data)
 	nadata->o->free(nadata->o, nadata->read_data);
+    for (i = 0; i < nadata->txq_len; i++) {
+	if (nadata->txq[i].addr)
+	    gensio_addr_free(nadata->txq[i].addr);
+    }
+    if (nadata->tx_data)
+	nadata->o->free(nadata->o, nadata->tx_data);
     if (nadata->lock)
 	nadata->o->free_lock(nadata->lock);
     if (nadata->acc)
@@ -472,21 +657,151 @@ udpn_finish_free(struct udpn_data *ndata)
     struct udpna_data *nadata = ndata->nadata;
 
     udpn_remove_from_list(&nadata->closed_udpns, ndata);
+    udpn_hash_rm(nadata, ndata);
+    udpn_flush_pending(nadata, ndata);
     assert(nadata->udpn_count > 0);
     nadata->udpn_count--;
     udpn_do_free(ndata);
     udpna_check_finish_free(nadata);
 }
 
+static void udpn_start_deferred_op(struct udpn_data *ndata);
+
+/*
+ * Send what is in the transmit queue.  Anything that can't be sent
+ * now stays in the queue, the write handler will try again.
+ */
+static void
+udpna_tx_flush(struct udpna_data *nadata)
+{
+    struct gensio_send_msg msgs[UDPNA_MAX_BATCH];
+    struct gensio_sg sgs[UDPNA_MAX_BATCH];
+    struct udpna_txmsg *txm;
+    struct udpn_data *ndata;
+    unsigned int i, start = 0, nsent;
+    gensiods pos;
+    int err;
+
+    for (i = 0; i < nadata->txq_len; i++) {
+	txm = &nadata->txq[i];
+	sgs[i].buf = nadata->tx_data + txm->pos;
+	sgs[i].buflen = txm->len;
+	msgs[i].sg = &sgs[i];
+	msgs[i].sglen = 1;
+	msgs[i].addr = txm->addr ? txm->addr : txm->ndata->raddr;
+    }
+
+    while (start < nadata->txq_len) {
+	err = gensio_os_sendto_multi(nadata->txq[0].iod, msgs + start,
+				     nadata->txq_len - start, &nsent, 0);
+	if (err) {
+	    /* The first packet failed, drop it and report it later. */
+	    nadata->txq[start].ndata->tx_err = err;
+	    nsent = 1;
+	} else if (nsent == 0) {
+	    break;
+	}
+
+	for (i = start; i < start + nsent; i++) {
+	    txm = &nadata->txq[i];
+	    ndata = txm->ndata;
+	    if (txm->addr)
+		gensio_addr_free(txm->addr);
+	    assert(ndata->tx_queued > 0);
+	    ndata->tx_queued--;
+	    if (ndata->tx_queued == 0 && ndata->state == UDPN_IN_CLOSE)
+		/* The close was waiting on this, finish it from the runner. */
+		udpn_start_deferred_op(ndata);
+	}
+	start += nsent;
+    }
+
+    if (start == nadata->txq_len) {
+	nadata->txq_len = 0;
+	nadata->tx_data_len = 0;
+    } else if (start > 0) {
+	/* Move what is left to the front. */
+	pos = nadata->txq[start].pos;
+	nadata->txq_len -= start;
+	memmove(nadata->txq, nadata->txq + start,
+		sizeof(nadata->txq[0]) * nadata->txq_len);
+	nadata->tx_data_len -= pos;
+	memmove(nadata->tx_data, nadata->tx_data + pos, nadata->tx_data_len);
+	for (i = 0; i < nadata->txq_len; i++)
+	    nadata->txq[i].pos -= pos;
+    }
+}
+
+/*
+ * Try to put a packet in the transmit queue.  Returns false if the
+ * packet should be sent directly.  If the udpn has packets queued it
+ * must stay in order, so this will set *count to zero if there is no
+ * room.  On success this takes over addr.
+ */
+static bool
+udpna_tx_queue(struct udpna_data *nadata, struct udpn_data *ndata,
+	       const struct gensio_sg *sg, gensiods sglen,
+	       struct gensio_addr *addr, gensiods len, gensiods *count)
+{
+    struct udpna_txmsg *txm;
+    gensiods i, pos;
+
+    if (len == 0 || len > UDPNA_TX_BUF_SIZE)
+	goto no_room;
+
+    if (nadata->txq_len > 0 && nadata->txq[0].iod != ndata->myiod)
+	udpna_tx_flush(nadata);
+    if (nadata->txq_len == UDPNA_MAX_BATCH ||
+		nadata->tx_data_len + len > UDPNA_TX_BUF_SIZE)
+	udpna_tx_flush(nadata);
+    if (nadata->txq_len == UDPNA_MAX_BATCH ||
+		nadata->tx_data_len + len > UDPNA_TX_BUF_SIZE ||
+		(nadata->txq_len > 0 && nadata->txq[0].iod != ndata->myiod))
+	goto no_room;
+
+    if (!nadata->tx_data) {
+	nadata->tx_data = nadata->o->zalloc(nadata->o, UDPNA_TX_BUF_SIZE);
+	if (!nadata->tx_data)
+	    goto no_room;
+    }
+
+    txm = &nadata->txq[nadata->txq_len++];
+    txm->ndata = ndata;
+    txm->iod = ndata->myiod;
+    txm->addr = addr;
+    txm->pos = nadata->tx_data_len;
+    txm->len = len;
+    for (i = 0, pos = txm->pos; i < sglen; i++) {
+	memcpy(nadata->tx_data + pos, sg[i].buf, sg[i].buflen);
+	pos += sg[i].buflen;
+    }
+    nadata->tx_data_len = pos;
+    ndata->tx_queued++;
+    if (count)
+	*count = len;
+    return true;
+
+ no_room:
+    if (ndata->tx_queued == 0)
+	return false;
+    if (addr)
+	gensio_addr_free(addr);
+    if (count)
+	*count = 0;
+    return true;
+}
+
 static int
 udpn_write(struct gensio *io, gensiods *count,
 	   const struct gensio_sg *sg, gensiods sglen,
 	   const char *const *auxdata)
 {
     struct udpn_data *ndata = gensio_get_gensio_data(io);
+    struct udpna_data *nadata = ndata->nadata;
     struct gensio_addr *addr = NULL;
     unsigned int i;
     bool free_addr = false;
+    gensiods len = 0;
     int err;
 
     for (i = 0; auxdata && auxdata[i]; i++) {
@@ -503,10 +818,35 @@ udpn_write(struct gensio *io, gensiods *count,
 	}
     }
 
+    for (i = 0; i < sglen; i++)
+	len += sg[i].buflen;
+
+    udpna_lock(nadata);
+    if (ndata->tx_err) {
+	err = ndata->tx_err;
+	ndata->tx_err = 0;
+	udpna_unlock(nadata);
+	goto out;
+    }
+    /*
+     * Writes from the write handler's callbacks are queued and sent
+     * together.  Once a udpn has packets queued, its writes must be
+     * queued, too, to keep them in order.
+     */
+    if ((nadata->in_write && ndata->in_write) || ndata->tx_queued) {
+	if (udpna_tx_queue(nadata, ndata, sg, sglen,
+			   free_addr ? addr : NULL, len, count)) {
+	    udpna_unlock(nadata);
+	    return 0;
+	}
+    }
+    udpna_unlock(nadata);
+
     if (!addr)
 	addr = ndata->raddr;
 
     err = ndata->o->sendto(ndata->myiod, sg, sglen, count, 0, addr);
+ out:
     if (free_addr)
 	gensio_addr_free(addr);
     return err;
@@ -515,7 +855,8 @@ udpn_write(struct gensio *io, gensiods *count,
 static void
 udpn_finish_close(struct udpna_data *nadata, struct udpn_data *ndata)
 {
-    if (ndata->in_read || ndata->in_write || ndata->in_open_cb)
+    if (ndata->in_read || ndata->in_write || ndata->in_open_cb ||
+		ndata->tx_queued)
 	return;
 
     udpn_set_state(ndata, UDPN_CLOSED);
@@ -533,10 +874,7 @@ udpn_finish_close(struct udpna_data *nadata, struct udpn_data *ndata)
 	ndata->in_close_cb = false;
     }
 
-    if (nadata->pending_data_owner == ndata) {
-	nadata->pending_data_owner = NULL;
-	nadata->data_pending_len = 0;
-    }
+    udpn_flush_pending(nadata, ndata);
 
     if (ndata->freed && !ndata->deferred_op_pending)
 	udpn_finish_free(ndata);
@@ -547,7 +885,8 @@ udpn_finish_read(struct udpn_data *ndata)
 {
     struct udpna_data *nadata = ndata->nadata;
     struct gensio *io = ndata->io;
-    gensiods count;
+    struct udpna_slot *slot;
+    gensiods count, pktlen;
     char raddrdata[200];
     char daddrdata[200];
     char ifidx[20];
@@ -557,15 +896,22 @@ udpn_finish_read(struct udpn_data *ndata)
     gensiods pos;
 
  retry:
+    if (gensio_list_empty(&ndata->pending))
+	goto out;
+    slot = gensio_link_to_slot(gensio_list_first(&ndata->pending));
     udpna_unlock(nadata);
-    count = nadata->data_pending_len;
+    /* Data left in the current packet. */
+    pktlen = slot->len - slot->pos;
+    if (slot->segsize && pktlen > slot->segsize - slot->pos % slot->segsize)
+	pktlen = slot->segsize - slot->pos % slot->segsize;
+    count = pktlen;
     auxdata = NULL;
 
     auxdata = auxmem;
     auxmem[0] = raddrdata;
     strcpy(raddrdata, "addr:");
     pos = 5;
-    err = gensio_addr_to_str(nadata->curr_recvaddr, raddrdata, &pos,
+    err = gensio_addr_to_str(slot->addr, raddrdata, &pos,
 			     sizeof(raddrdata));
     if (err) {
 	strcpy(raddrdata, "err:addr:");
@@ -575,18 +921,18 @@ udpn_finish_read(struct udpn_data *ndata)
 
     if (ndata->extrainfo) {
 	/* Get the ifidx */
-	if (gensio_addr_next(nadata->curr_recvaddr)) {
+	if (gensio_addr_next(slot->addr)) {
 	    pos = 0;
-	    err = gensio_addr_to_str(nadata->curr_recvaddr, ifidx, &pos,
+	    err = gensio_addr_to_str(slot->addr, ifidx, &pos,
 				     sizeof(ifidx));
 	    if (!err)
 		auxmem[1] = ifidx;
 	}
 	/* Get the destination address */
-	if (gensio_addr_next(nadata->curr_recvaddr)) {
+	if (gensio_addr_next(slot->addr)) {
 	    strncpy(daddrdata, "daddr:", sizeof(daddrdata));
 	    pos = 6;
-	    err = gensio_addr_to_str(nadata->curr_recvaddr, daddrdata, &pos,
+	    err = gensio_addr_to_str(slot->addr, daddrdata, &pos,
 				     sizeof(daddrdata));
 	    if (!err) {
 		/* Chop off the ,0 at the end. */
@@ -596,9 +942,10 @@ udpn_finish_read(struct udpn_data *ndata)
 		auxmem[2] = daddrdata;
 	    }
 	}
+	gensio_addr_rewind(slot->addr);
     }
 
-    err = gensio_cb(io, GENSIO_EVENT_READ, 0, nadata->read_data,
+    err = gensio_cb(io, GENSIO_EVENT_READ, 0, slot->data + slot->pos,
 		    &count, auxdata);
     udpna_lock(nadata);
     if (err)
@@ -609,16 +956,18 @@ udpn_finish_read(struct udpn_data *ndata)
 	goto out;
     }
 
-    if (count < nadata->data_pending_len) {
+    if (count < pktlen) {
 	/* The user didn't comsume all the data */
-	nadata->data_pending_len -= count;
-	nadata->data_pos += count;
-	if (ndata->state == UDPN_OPEN && ndata->read_enabled)
-	    goto retry;
+	slot->pos += count;
+    } else if (slot->pos + pktlen < slot->len) {
+	/* On to the next coalesced packet. */
+	slot->pos += pktlen;
     } else {
-	nadata->pending_data_owner = NULL;
-	nadata->data_pending_len = 0;
+	gensio_list_rm(&ndata->pending, &slot->link);
+	udpna_put_slot(nadata, slot);
     }
+    if (ndata->state == UDPN_OPEN && ndata->read_enabled)
+	goto retry;
  out:
     ndata->in_read = false;
     udpna_check_read_state(nadata);
@@ -631,18 +980,6 @@ udpna_deferred_op(struct gensio_runner *runner, void *cbdata)
 
     udpna_lock(nadata);
     nadata->deferred_op_pending = false;
-    if (nadata->pending_data_owner) {
-	struct udpn_data *ndata = nadata->pending_data_owner;
-	if (ndata->deferred_read) {
-	    ndata->deferred_read = false;
-	    if (ndata->read_enabled) {
-		udpn_finish_read(ndata);
-	    } else {
-		/* We started to read, but didn't get to do it. */
-		ndata->in_read = false;
-	    }
-	}
-    }
 
     if (nadata->in_shutdown && !nadata->in_new_connection) {
 	struct gensio_accepter *accepter = nadata->acc;
@@ -681,6 +1018,19 @@ udpn_deferred_op(struct gensio_runner *runner, void *cbdata)
 	udpna_check_read_state(nadata);
     }
 
+    if (ndata->deferred_read) {
+	/* We started to read, we may not get to do it. */
+	ndata->deferred_read = false;
+	ndata->in_read = false;
+    }
+
+    /* Deliver anything that came in before open or while disabled. */
+    if (ndata->state == UDPN_OPEN && ndata->read_enabled && !ndata->in_read &&
+		!gensio_list_empty(&ndata->pending)) {
+	ndata->in_read = true;
+	udpn_finish_read(ndata);
+    }
+
     if (ndata->state == UDPN_IN_CLOSE)
 	udpn_finish_close(nadata, ndata);
     else if (ndata->freed && !ndata->in_close_cb &&
@@ -712,7 +1062,6 @@ udpn_open(struct gensio *io, gensio_done_err open_done, void *open_data)
     } else if (ndata->state == UDPN_CLOSED) {
 	udpn_remove_from_list(&nadata->closed_udpns, ndata);
 	udpn_add_to_list(&nadata->udpns, ndata);
-	udpna_fd_read_disable(nadata);
 	udpn_set_state(ndata, UDPN_IN_OPEN);
 	ndata->open_done = open_done;
 	ndata->open_data = open_data;
@@ -730,26 +1079,20 @@ udpn_start_close(struct udpn_data *ndata,
 {
     struct udpna_data *nadata = ndata->nadata;
 
-    if (nadata->pending_data_owner == ndata) {
-	if (ndata->deferred_read) {
-	    /*
-	     * If there is a read pending on a deferred op, it won't
-	     * get called now that this is closed.  So cancel it so
-	     * the close will finish
-	     */
-	    ndata->deferred_read = false;
-	    ndata->in_read = false;
-	}
-	nadata->pending_data_owner = NULL;
-	nadata->data_pending_len = 0;
+    if (ndata->deferred_read) {
+	/*
+	 * If there is a read pending on a deferred op, it won't
+	 * get called now that this is closed.  So cancel it so
+	 * the close will finish.  Any pending packets are released
+	 * when the close finishes.
+	 */
+	ndata->deferred_read = false;
+	ndata->in_read = false;
     }
     ndata->close_done = close_done;
     ndata->close_data = close_data;
 
-    if (ndata->read_enabled)
-	ndata->read_enabled = false;
-    else
-	udpna_fd_read_enable(nadata);
+    ndata->read_enabled = false;
 
     if (ndata->write_enabled) {
 	ndata->write_enabled = false;
@@ -808,35 +1151,22 @@ udpn_set_read_callback_enable(struct gensio *io, bool enabled)
 {
     struct udpn_data *ndata = gensio_get_gensio_data(io);
     struct udpna_data *nadata = ndata->nadata;
-    bool my_data_pending;
 
     udpna_lock(nadata);
     if (udpn_is_closed(ndata) || ndata->read_enabled == enabled)
 	goto out_unlock;
 
-    if (enabled) {
-	assert(nadata->read_disable_count > 0);
-	nadata->read_disable_count--;
-	i_udp_add_trace(nadata, NULL, 5300 + nadata->read_disable_count,
-			__LINE__);
-    } else {
-	nadata->read_disable_count++;
-	i_udp_add_trace(nadata, NULL, 5400 + nadata->read_disable_count,
-			__LINE__);
-    }
+    /*
+     * The socket is still read while this is disabled, packets for
+     * this gensio queue up until it is enabled or the slots run out.
+     */
     ndata->read_enabled = enabled;
-    my_data_pending = (nadata->data_pending_len &&
-		       nadata->pending_data_owner == ndata);
-    if (ndata->in_read || ndata->state == UDPN_IN_OPEN ||
-		(my_data_pending && !enabled)) {
-	/* Nothing to do. */
-    } else if (enabled && my_data_pending) {
+    if (enabled && !ndata->in_read && ndata->state == UDPN_OPEN &&
+		!gensio_list_empty(&ndata->pending)) {
 	ndata->in_read = true;
 	ndata->deferred_read = true;
 	/* Call the read from the selector to avoid lock nesting issues. */
-	udpna_start_deferred_op(nadata);
-    } else {
-	udpna_check_read_state(nadata);
+	udpn_start_deferred_op(ndata);
     }
  out_unlock:
     udpna_unlock(nadata);
@@ -864,16 +1194,33 @@ udpn_set_write_callback_enable(struct gensio *io, bool enabled)
     udpna_unlock(nadata);
 }
 
+/* Remove all the udpn's packets from the transmit queue. */
+static void
+udpna_tx_drop(struct udpna_data *nadata, struct udpn_data *ndata)
+{
+    unsigned int i, j;
+
+    for (i = 0, j = 0; i < nadata->txq_len; i++) {
+	if (nadata->txq[i].ndata == ndata) {
+	    if (nadata->txq[i].addr)
+		gensio_addr_free(nadata->txq[i].addr);
+	    continue;
+	}
+	nadata->txq[j++] = nadata->txq[i];
+    }
+    nadata->txq_len = j;
+    ndata->tx_queued = 0;
+}
+
 static void
 udpn_disable(struct gensio *io)
 {
     struct udpn_data *ndata = gensio_get_gensio_data(io);
     struct udpna_data *nadata = ndata->nadata;
 
-    if (ndata->read_enabled) {
-	udpna_fd_read_disable(nadata);
-	ndata->read_enabled = false;
-    }
+    ndata->read_enabled = false;
+    udpn_flush_pending(nadata, ndata);
+    udpna_tx_drop(nadata, ndata);
 
     if (ndata->write_enabled) {
 	udpna_fd_write_disable(nadata);
@@ -891,27 +1238,12 @@ static void
 udpn_handle_write_incoming(struct udpna_data *nadata, struct udpn_data *ndata)
 {
     struct gensio *io = ndata->io;
-    int err;
 
-    if (ndata->in_write) {
-	/* Only one write callback at a time. */
-	ndata->write_pending = true;
-	return;
-    }
-    ndata->in_write = true;
- retry:
-    udpna_unlock(nadata);
-    err = gensio_cb(io, GENSIO_EVENT_WRITE_READY, 0, NULL, NULL, NULL);
-    udpna_lock(nadata);
-    if (err)
-	goto out;
-    if (ndata->write_pending) {
-	/* Another write came in while we were unlocked.  Retry. */
-	ndata->write_pending = false;
-	if (ndata->write_enabled)
-	    goto retry;
+    if (ndata->write_enabled) {
+	udpna_unlock(nadata);
+	gensio_cb(io, GENSIO_EVENT_WRITE_READY, 0, NULL, NULL, NULL);
+	udpna_lock(nadata);
     }
- out:
     ndata->in_write = false;
 
     if (ndata->state == UDPN_IN_CLOSE)
@@ -922,6 +1254,7 @@ static void
 udpna_writehandler(struct gensio_iod *iod, void *cbdata)
 {
     struct udpna_data *nadata = cbdata;
+    struct gensio_list wlist;
     struct gensio_link *l;
 
     udpna_lock_and_ref(nadata);
@@ -929,21 +1262,44 @@ udpna_writehandler(struct gensio_iod *iod, void *cbdata)
 	udpna_disable_write(nadata);
 	goto out_unlock;
     }
+    nadata->in_write = true;
 
+    /* Send anything left over from the last time first. */
+    udpna_tx_flush(nadata);
+    if (nadata->txq_len > 0)
+	goto out_done;
+
+    /*
+     * Call every udpn that wants to write, the packets they write
+     * are queued and sent together at the end.  The list can change
+     * while the lock is released for the callbacks, so collect them
+     * first.  Setting in_write keeps them from being freed.
+     */
+    gensio_list_init(&wlist);
     gensio_list_for_each(&nadata->udpns, l) {
 	struct udpn_data *ndata = gensio_link_to_ndata(l);
 
-	if (ndata->write_enabled) {
-	    udpn_handle_write_incoming(nadata, ndata);
-	    /*
-	     * Only handle one per callback, the above call releases
-	     * the lock and can result in the list changing.
-	     */
-	    break;
+	if (ndata->write_enabled && !ndata->in_write) {
+	    ndata->in_write = true;
+	    gensio_list_add_tail(&wlist, &ndata->wlink);
 	}
     }
-    if (nadata->write_enable_count > 0)
+    while (!gensio_list_empty(&wlist)) {
+	struct udpn_data *ndata;
+
+	l = gensio_list_first(&wlist);
+	gensio_list_rm(&wlist, l);
+	ndata = gensio_wlink_to_ndata(l);
+	udpn_handle_write_incoming(nadata, ndata);
+    }
+    udpna_tx_flush(nadata);
+
+ out_done:
+    nadata->in_write = false;
+    if (nadata->write_enable_count > 0 || nadata->txq_len > 0)
 	udpna_enable_write(nadata);
+    else
+	udpna_disable_write(nadata);
  out_unlock:
     udpna_deref_and_unlock(nadata);
 }
@@ -1221,6 +1577,7 @@ udp_alloc_gensio(struct udpna_data *nadata, struct gensio_iod *iod,
 
     ndata->o = nadata->o;
     ndata->nadata = nadata;
+    gensio_list_init(&ndata->pending);
 
     ndata->deferred_op_runner = ndata->o->alloc_runner(ndata->o,
 						       udpn_deferred_op, ndata);
@@ -1250,41 +1607,21 @@ udp_alloc_gensio(struct udpna_data *nadata, struct gensio_iod *iod,
 
     /* Stick it on the end of the list. */
     udpn_add_to_list(starting_list, ndata);
+    udpn_hash_add(nadata, ndata);
     nadata->udpn_count++;
 
     return ndata;
 }
 
+/*
+ * Queue a received packet on the udpn it belongs to, creating a new
+ * udpn if necessary, and deliver it if the udpn can take it now.
+ */
 static void
-udpna_readhandler(struct gensio_iod *iod, void *cbdata)
+udpna_handle_packet(struct udpna_data *nadata, struct gensio_iod *iod,
+		    struct udpna_slot *slot)
 {
-    struct udpna_data *nadata = cbdata;
     struct udpn_data *ndata;
-    gensiods datalen;
-    int err;
-
-    udpna_lock_and_ref(nadata);
-    if (nadata->data_pending_len) {
-	nadata->readhandler_read_disabled = true;
-	udpna_fd_read_disable(nadata);
-	goto out_unlock;
-    }
-
-    err = nadata->o->recvfrom(iod, nadata->read_data, nadata->max_read_size,
-			      &datalen, 0, nadata->curr_recvaddr);
-    if (err) {
-	if (!nadata->is_dummy)
-	    /* Don't log on dummy accepters. */
-	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-			   "Could not accept on UDP: %s",
-			   gensio_err_to_str(err));
-	goto out_unlock;
-    }
-    if (datalen == 0)
-	goto out_unlock;
-
-    nadata->data_pending_len = datalen;
-    nadata->data_pos = 0;
 
     if (nadata->nocon) {
 	if (gensio_list_empty(&nadata->udpns)) {
@@ -1293,30 +1630,32 @@ udpna_readhandler(struct gensio_iod *iod, void *cbdata)
 	    ndata = gensio_link_to_ndata(gensio_list_first(&nadata->udpns));
 	}
     } else {
-	ndata = udpn_find(&nadata->udpns, nadata->curr_recvaddr);
+	ndata = udpn_find(nadata, &nadata->udpns, slot->addr);
     }
     if (ndata) {
 	/* Data belongs to an existing connection. */
-	nadata->pending_data_owner = ndata;
+	gensio_list_add_tail(&ndata->pending, &slot->link);
 	goto got_ndata;
     }
 
     if (nadata->closed || !nadata->enabled) {
-	nadata->data_pending_len = 0;
-	goto out_unlock_enable;
+	udpna_put_slot(nadata, slot);
+	return;
     }
 
     /* New connection. */
-    ndata = udp_alloc_gensio(nadata, iod, nadata->curr_recvaddr,
+    ndata = udp_alloc_gensio(nadata, iod, slot->addr,
 			     NULL, NULL, &nadata->udpns);
-    if (!ndata)
-	goto out_nomem;
+    if (!ndata) {
+	udpna_put_slot(nadata, slot);
+	gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+		       "Out of memory allocating for udp port");
+	return;
+    }
 
     udpn_set_state(ndata, UDPN_OPEN);
-    nadata->read_disable_count++;
-    i_udp_add_trace(nadata, NULL, 5500 + nadata->read_disable_count, __LINE__);
+    gensio_list_add_tail(&ndata->pending, &slot->link);
 
-    nadata->pending_data_owner = ndata;
     nadata->in_new_connection = true;
     ndata->in_read = true;
     udpna_unlock(nadata);
@@ -1336,19 +1675,15 @@ udpna_readhandler(struct gensio_iod *iod, void *cbdata)
     }
     nadata->in_new_connection = false;
 
-    if (ndata->state == UDPN_OPEN) {
-    got_ndata:
-	if (ndata->read_enabled && !ndata->in_read) {
-	    ndata->in_read = true;
-	    udpn_finish_read(ndata);
-	}
-    } else {
-	nadata->data_pending_len = 0;
+ got_ndata:
+    if (ndata->state == UDPN_OPEN && ndata->read_enabled && !ndata->in_read) {
+	ndata->in_read = true;
+	udpn_finish_read(ndata);
     }
 
     if (ndata->state == UDPN_IN_CLOSE) {
 	udpn_finish_close(nadata, ndata);
-	goto out_unlock_enable;
+	return;
     }
 
     if (nadata->in_shutdown) {
@@ -1363,18 +1698,66 @@ udpna_readhandler(struct gensio_iod *iod, void *cbdata)
 	ndata->in_read = false;
     }
     udpna_check_finish_free(nadata);
-    goto out_unlock_enable;
+}
 
- out_nomem:
-    nadata->data_pending_len = 0;
-    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-		   "Out of memory allocating for udp port");
- out_unlock_enable:
-    if (nadata->readhandler_read_disabled) {
-	nadata->readhandler_read_disabled = false;
-	udpna_fd_read_enable(nadata);
+static void
+udpna_readhandler(struct gensio_iod *iod, void *cbdata)
+{
+    struct udpna_data *nadata = cbdata;
+    struct udpna_slot *slots[UDPNA_MAX_BATCH];
+    struct gensio_recv_msg msgs[UDPNA_MAX_BATCH];
+    struct gensio_link *l;
+    unsigned int i, nslots, nrecv = 0;
+    int err;
+
+    udpna_lock_and_ref(nadata);
+    for (nslots = 0; nslots < UDPNA_MAX_BATCH; nslots++) {
+	if (gensio_list_empty(&nadata->free_slots))
+	    break;
+	l = gensio_list_first(&nadata->free_slots);
+	gensio_list_rm(&nadata->free_slots, l);
+	slots[nslots] = gensio_link_to_slot(l);
+	msgs[nslots].buf = slots[nslots]->data;
+	msgs[nslots].buflen = nadata->max_read_size;
+	msgs[nslots].len = 0;
+	msgs[nslots].segsize = 0;
+	msgs[nslots].addr = slots[nslots]->addr;
+    }
+    if (nslots == 0)
+	goto out_check_slots;
+
+    err = gensio_os_recvfrom_multi(iod, msgs, nslots, &nrecv, 0);
+    if (err) {
+	if (!nadata->is_dummy)
+	    /* Don't log on dummy accepters. */
+	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+			   "Could not accept on UDP: %s",
+			   gensio_err_to_str(err));
+	nrecv = 0;
+    }
+
+    /* Return the slots that didn't get anything. */
+    for (i = nrecv; i < nslots; i++)
+	udpna_put_slot(nadata, slots[i]);
+
+    for (i = 0; i < nrecv; i++) {
+	if (msgs[i].len == 0) {
+	    udpna_put_slot(nadata, slots[i]);
+	    continue;
+	}
+	slots[i]->len = msgs[i].len;
+	slots[i]->pos = 0;
+	slots[i]->segsize = msgs[i].segsize;
+	udpna_handle_packet(nadata, iod, slots[i]);
+    }
+
+ out_check_slots:
+    if (gensio_list_empty(&nadata->free_slots) &&
+		!nadata->slots_read_disabled) {
+	/* Everything is queued, wait for the users to catch up. */
+	nadata->slots_read_disabled = true;
+	udpna_fd_read_disable(nadata);
     }
- out_unlock:
     udpna_deref_and_unlock(nadata);
 }
 
@@ -1393,6 +1776,19 @@ udpna_startup(struct gensio_accepter *accepter)
 				   &nadata->fds, &nadata->nr_fds);
 	if (rv)
 	    goto out_unlock;
+
+	if (nadata->gso_size) {
+	    unsigned int i;
+	    gensiods size = sizeof(nadata->gso_size);
+
+	    for (i = 0; i < nadata->nr_fds; i++) {
+		rv = nadata->o->sock_control(nadata->fds[i].iod,
+					     GENSIO_SOCKCTL_SET_GSO,
+					     &nadata->gso_size, &size);
+		if (rv)
+		    goto out_unlock;
+	    }
+	}
     }
 
     nadata->enabled = true;
@@ -1549,9 +1945,9 @@ udpna_str_to_gensio(struct gensio_accepter *accepter, const char *addrstr,
  found:
 
     udpna_lock(nadata);
-    ndata = udpn_find(&nadata->udpns, addr);
+    ndata = udpn_find(nadata, &nadata->udpns, addr);
     if (!ndata)
-	ndata = udpn_find(&nadata->closed_udpns, addr);
+	ndata = udpn_find(nadata, &nadata->closed_udpns, addr);
     if (ndata) {
 	udpna_unlock(nadata);
 	err = GE_EXISTS;
@@ -1639,12 +2035,14 @@ gensio_acc_udp_func(struct gensio_accepter *acc, int func, int val,
 
 static int
 i_udp_gensio_accepter_alloc(const struct gensio_addr *iai,
-			    gensiods max_read_size,
+			    gensiods max_read_size, unsigned int nr_slots,
+			    unsigned int gso_size,
 			    bool reuseaddr, struct gensio_os_funcs *o,
 			    gensio_accepter_event cb, void *user_data,
 			    struct gensio_accepter **accepter)
 {
     struct udpna_data *nadata;
+    unsigned int i;
 
     nadata = o->zalloc(o, sizeof(*nadata));
     if (!nadata)
@@ -1652,7 +2050,10 @@ i_udp_gensio_accepter_alloc(const struct gensio_addr *iai,
     nadata->o = o;
     gensio_list_init(&nadata->udpns);
     gensio_list_init(&nadata->closed_udpns);
+    gensio_list_init(&nadata->free_slots);
     nadata->refcount = 1;
+    /* Clients enable the socket read when they finish opening. */
+    nadata->read_disabled = true;
     if (reuseaddr)
 	nadata->opensock_flags |= GENSIO_OPENSOCK_REUSEADDR;
 
@@ -1661,10 +2062,30 @@ i_udp_gensio_accepter_alloc(const struct gensio_addr *iai,
     if (!nadata->ai && iai) /* Allow a null ai if it was passed in. */
 	goto out_nomem;
 
-    nadata->read_data = o->zalloc(o, max_read_size);
+    nadata->udpn_hash = o->zalloc(o, (sizeof(*nadata->udpn_hash) *
+				      UDPNA_HASH_INIT_SIZE));
+    if (!nadata->udpn_hash)
+	goto out_nomem;
+    nadata->udpn_hash_size = UDPNA_HASH_INIT_SIZE;
+    for (i = 0; i < UDPNA_HASH_INIT_SIZE; i++)
+	gensio_list_init(&nadata->udpn_hash[i]);
+
+    nadata->read_data = o->zalloc(o, max_read_size * nr_slots);
     if (!nadata->read_data)
 	goto out_nomem;
 
+    nadata->slots = o->zalloc(o, sizeof(*nadata->slots) * nr_slots);
+    if (!nadata->slots)
+	goto out_nomem;
+    nadata->nr_slots = nr_slots;
+    for (i = 0; i < nr_slots; i++) {
+	nadata->slots[i].addr = o->addr_alloc_recvfrom(o);
+	if (!nadata->slots[i].addr)
+	    goto out_nomem;
+	nadata->slots[i].data = nadata->read_data + (i * max_read_size);
+	gensio_list_add_tail(&nadata->free_slots, &nadata->slots[i].link);
+    }
+
     nadata->deferred_op_runner = o->alloc_runner(o, udpna_deferred_op, nadata);
     if (!nadata->deferred_op_runner)
 	goto out_nomem;
@@ -1679,10 +2100,6 @@ i_udp_gensio_accepter_alloc(const struct gensio_addr *iai,
     if (!nadata->lock)
 	goto out_nomem;
 
-    nadata->curr_recvaddr = o->addr_alloc_recvfrom(o);
-    if (!nadata->curr_recvaddr)
-	goto out_nomem;
-
     nadata->acc = gensio_acc_data_alloc(o, cb, user_data, gensio_acc_udp_func,
 					NULL, "udp", nadata);
     if (!nadata->acc)
@@ -1690,6 +2107,7 @@ i_udp_gensio_accepter_alloc(const struct gensio_addr *iai,
     gensio_acc_set_is_packet(nadata->acc, true);
 
     nadata->max_read_size = max_read_size;
+    nadata->gso_size = gso_size;
 
     *accepter = nadata->acc;
     return 0;
@@ -1708,7 +2126,7 @@ udp_gensio_accepter_alloc(const void *gdata,
 {
     const struct gensio_addr *iai = gdata;
     gensiods max_read_size = GENSIO_DEFAULT_UDP_BUF_SIZE;
-    unsigned int i;
+    unsigned int i, batch = GENSIO_DEFAULT_UDP_ACC_BATCH, gso = 0;
     bool reuseaddr = false;
     int err, ival;
     GENSIO_DECLARE_PPACCEPTER(p, o, cb, "udp", user_data);
@@ -1716,6 +2134,13 @@ udp_gensio_accepter_alloc(const void *gdata,
     for (i = 0; args && args[i]; i++) {
 	if (gensio_pparm_ds(&p, args[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_uint(&p, args[i], "batch", &batch) > 0) {
+	    if (batch < 1 || batch > GENSIO_MAX_UDP_BATCH)
+		return GE_INVAL;
+	    continue;
+	}
+	if (gensio_pparm_uint(&p, args[i], "gso", &gso) > 0)
+	    continue;
 	gensio_pparm_unknown_parm(&p, args[i]);
 	return GE_INVAL;
     }
@@ -1725,8 +2150,15 @@ udp_gensio_accepter_alloc(const void *gdata,
 	return err;
     reuseaddr = ival;
 
-    return i_udp_gensio_accepter_alloc(iai, max_read_size, reuseaddr,
-				       o, cb, user_data, accepter);
+    /* Coalesced packets can be up to 64k, so the buffers must hold that. */
+    if (gso && max_read_size < GENSIO_DEFAULT_UDP_BUF_SIZE) {
+	gensio_pparm_log(&p, "gso requires readbuf of at least %d",
+			 GENSIO_DEFAULT_UDP_BUF_SIZE);
+	return GE_INVAL;
+    }
+
+    return i_udp_gensio_accepter_alloc(iai, max_read_size, batch, gso,
+				       reuseaddr, o, cb, user_data, accepter);
 }
 
 static int
@@ -1763,7 +2195,7 @@ udp_gensio_alloc(const void *gdata, const char * const args[],
     int err, ival;
     struct gensio_iod *new_iod;
     gensiods max_read_size = GENSIO_DEFAULT_UDP_BUF_SIZE, size;
-    unsigned int i, setup;
+    unsigned int i, setup, batch = GENSIO_DEFAULT_UDP_BATCH, gso = 0;
     bool nocon = false, mcast_loop_set = false, mcast_loop = true;
     bool reuseaddr = false;
     unsigned int mttl;
@@ -1818,6 +2250,15 @@ udp_gensio_alloc(const void *gdata, const char * const args[],
 	}
 	if (gensio_pparm_bool(&p, args[i], "nocon", &nocon) > 0)
 	    continue;
+	if (gensio_pparm_uint(&p, args[i], "batch", &batch) > 0) {
+	    if (batch < 1 || batch > GENSIO_MAX_UDP_BATCH) {
+		err = GE_INVAL;
+		goto parm_err;
+	    }
+	    continue;
+	}
+	if (gensio_pparm_uint(&p, args[i], "gso", &gso) > 0)
+	    continue;
 	if (gensio_pparm_uint(&p, args[i], "mttl", &mttl) > 0) {
 	    if (mttl < 1 || mttl > 255) {
 		err = GE_INVAL;
@@ -1840,6 +2281,16 @@ udp_gensio_alloc(const void *gdata, const char * const args[],
 	return err;
     }
 
+    if (gso && max_read_size < GENSIO_DEFAULT_UDP_BUF_SIZE) {
+	gensio_pparm_log(&p, "gso requires readbuf of at least %d",
+			 GENSIO_DEFAULT_UDP_BUF_SIZE);
+	if (laddr)
+	    gensio_addr_free(laddr);
+	if (mcast)
+	    gensio_addr_free(mcast);
+	return GE_INVAL;
+    }
+
     err = o->socket_open(o, addr, GENSIO_NET_PROTOCOL_UDP, &new_iod);
     if (err) {
 	if (laddr)
@@ -1887,6 +2338,15 @@ udp_gensio_alloc(const void *gdata, const char * const args[],
 	}
     }
 
+    if (gso) {
+	size = sizeof(gso);
+	err = o->sock_control(new_iod, GENSIO_SOCKCTL_SET_GSO, &gso, &size);
+	if (err) {
+	    o->close(&new_iod);
+	    return err;
+	}
+    }
+
     if (mttl > 1) {
 	size = sizeof(mttl);
 	err = o->sock_control(new_iod, GENSIO_SOCKCTL_SET_MCAST_TTL,
@@ -1898,8 +2358,8 @@ udp_gensio_alloc(const void *gdata, const char * const args[],
     }
 
     /* Allocate a dummy network accepter. */
-    err = i_udp_gensio_accepter_alloc(NULL, max_read_size, reuseaddr, o,
-				      NULL, NULL, &accepter);
+    err = i_udp_gensio_accepter_alloc(NULL, max_read_size, batch, gso,
+				      reuseaddr, o, NULL, NULL, &accepter);
     if (err) {
 	o->close(&new_iod);
 	return err;
@@ -5,6 +5,10 @@
  *  SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#ifdef linux
+#define _GNU_SOURCE /* Get cpu_set_t and pthread_setaffinity_np(). */
+#endif
+
 #include "config.h"
 #include <string.h>
 #include <errno.h>
@@ -32,8 +36,43 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#ifdef linux
+#include <sys/syscall.h>
+#endif
 #include "errtrig.h"
 
+/*
+ * A group of os funcs, each with its own selector.  The group is
+ * refcounted as a whole using the refcount in reactor 0, and all the
+ * reactors share reactor 0's memory tracking so memory and iods can
+ * move between them.
+ */
+struct gensio_reactors {
+    unsigned int count;
+    unsigned int next;
+    struct gensio_os_funcs *o[];
+};
+
+/* See GENSIO_CONTROL_SET_MEM_LIMITS. */
+struct gensio_mem_budget {
+    gensiods soft_limit;
+    gensiods hard_limit;
+    gensiods in_use;
+    gensiods peak;
+    uint64_t soft_limit_hits;
+    uint64_t hard_limit_failures;
+    bool hard_logged;
+
+    /*
+     * Things waiting for in_use to go back to soft_limit, see
+     * gensio_os_mem_wait().  nwaiters is checked without the lock so
+     * uncharges don't have to take it if nothing is waiting.
+     */
+    lock_type wait_lock;
+    struct gensio_list waiters;
+    unsigned int nwaiters;
+};
+
 struct gensio_data {
     struct selector_s *sel;
     unsigned int flags;
@@ -43,6 +82,20 @@ struct gensio_data {
     int wake_sig;
     struct gensio_os_proc_data *pdata;
     struct gensio_memtrack *mtrack;
+    struct gensio_mempool *mempool;
+    struct gensio_reactors *reactors;
+
+    /* See GENSIO_CONTROL_SET_BUSY_POLL. */
+    unsigned int spin_max;
+    unsigned int spin_cur;
+    unsigned int sock_busy_poll;
+    uint64_t spins;
+    uint64_t spin_hits;
+    uint64_t spin_misses;
+
+    /* Reactors all use reactor 0's budget. */
+    struct gensio_mem_budget *budget;
+    struct gensio_mem_budget budget_data;
 };
 
 static void *
@@ -50,6 +103,9 @@ gensio_unix_zalloc(struct gensio_os_funcs *o, gensiods size)
 {
     struct gensio_data *d = o->user_data;
     TRACE_MEM;
+
+    if (d->mempool)
+	return gensio_mempool_zalloc(d->mempool, size);
     return gensio_i_zalloc(d->mtrack, size,
 			   TRACE_MEM_CALLERS, TRACE_MEM_CALLERS_SIZE);
 }
@@ -59,7 +115,230 @@ gensio_unix_free(struct gensio_os_funcs *o, void *v)
 {
     struct gensio_data *d = o->user_data;
     TRACE_MEM;
-    gensio_i_free(d->mtrack, v, TRACE_MEM_CALLERS, TRACE_MEM_CALLERS_SIZE);
+
+    if (d->mempool)
+	gensio_mempool_zfree(d->mempool, v);
+    else
+	gensio_i_free(d->mtrack, v, TRACE_MEM_CALLERS,
+		      TRACE_MEM_CALLERS_SIZE);
+}
+
+static int
+gensio_unix_mem_charge(struct gensio_os_funcs *o, gensiods *count,
+		       gensiods size)
+{
+    struct gensio_data *d = o->user_data;
+    struct gensio_mem_budget *b = d->budget;
+    gensiods hard, in_use, peak;
+
+    in_use = __atomic_add_fetch(&b->in_use, size, __ATOMIC_RELAXED);
+    hard = __atomic_load_n(&b->hard_limit, __ATOMIC_RELAXED);
+    if (hard && in_use > hard) {
+	__atomic_sub_fetch(&b->in_use, size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&b->hard_limit_failures, 1, __ATOMIC_RELAXED);
+	/* Only log once each time the limit is reached. */
+	if (!__atomic_exchange_n(&b->hard_logged, true, __ATOMIC_RELAXED))
+	    gensio_log(o, GENSIO_LOG_ERR,
+		       "Memory hard limit of %lu bytes reached",
+		       (unsigned long) hard);
+	return GE_MEMLIMIT;
+    }
+
+    peak = __atomic_load_n(&b->peak, __ATOMIC_RELAXED);
+    while (in_use > peak) {
+	if (__atomic_compare_exchange_n(&b->peak, &peak, in_use, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    break;
+    }
+
+    if (count)
+	__atomic_add_fetch(count, size, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static bool
+gensio_mem_budget_over_soft(struct gensio_mem_budget *b)
+{
+    gensiods soft = __atomic_load_n(&b->soft_limit, __ATOMIC_SEQ_CST);
+
+    return soft && __atomic_load_n(&b->in_use, __ATOMIC_SEQ_CST) > soft;
+}
+
+/*
+ * Dequeue the waiters under the lock and call them after it is
+ * released, so ready doesn't run with the wait lock held.
+ */
+static void
+gensio_mem_budget_wake(struct gensio_mem_budget *b)
+{
+    struct gensio_link *l, *l2;
+    struct gensio_os_mem_waiter *w;
+    struct gensio_list ready;
+
+    gensio_list_init(&ready);
+    LOCK(&b->wait_lock);
+    if (!gensio_mem_budget_over_soft(b)) {
+	gensio_list_for_each_safe(&b->waiters, l, l2) {
+	    w = gensio_container_of(l, struct gensio_os_mem_waiter, link);
+	    gensio_list_rm(&b->waiters, l);
+	    w->queued = false;
+	    __atomic_sub_fetch(&b->nwaiters, 1, __ATOMIC_SEQ_CST);
+	    gensio_list_add_tail(&ready, l);
+	}
+    }
+    UNLOCK(&b->wait_lock);
+
+    gensio_list_for_each_safe(&ready, l, l2) {
+	w = gensio_container_of(l, struct gensio_os_mem_waiter, link);
+	gensio_list_rm(&ready, l);
+	w->ready(w);
+    }
+}
+
+static void
+gensio_unix_mem_uncharge(struct gensio_os_funcs *o, gensiods *count,
+			 gensiods size)
+{
+    struct gensio_data *d = o->user_data;
+    struct gensio_mem_budget *b = d->budget;
+
+    __atomic_sub_fetch(&b->in_use, size, __ATOMIC_SEQ_CST);
+    if (count)
+	__atomic_sub_fetch(count, size, __ATOMIC_RELAXED);
+    if (!gensio_mem_budget_over_soft(b)) {
+	__atomic_store_n(&b->hard_logged, false, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&b->nwaiters, __ATOMIC_SEQ_CST))
+	    gensio_mem_budget_wake(b);
+    }
+}
+
+static bool
+gensio_unix_mem_over_soft_limit(struct gensio_os_funcs *o)
+{
+    struct gensio_data *d = o->user_data;
+    struct gensio_mem_budget *b = d->budget;
+    gensiods soft = __atomic_load_n(&b->soft_limit, __ATOMIC_RELAXED);
+
+    if (!soft || __atomic_load_n(&b->in_use, __ATOMIC_RELAXED) <= soft)
+	return false;
+    __atomic_add_fetch(&b->soft_limit_hits, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static bool
+gensio_unix_mem_wait(struct gensio_os_funcs *o, struct gensio_os_mem_waiter *w)
+{
+    struct gensio_data *d = o->user_data;
+    struct gensio_mem_budget *b = d->budget;
+    bool rv = false;
+
+    LOCK(&b->wait_lock);
+    /*
+     * Count the waiter before checking the budget, an uncharge
+     * subtracts before checking nwaiters, so one of the two will
+     * see the other.
+     */
+    __atomic_add_fetch(&b->nwaiters, 1, __ATOMIC_SEQ_CST);
+    if (gensio_mem_budget_over_soft(b)) {
+	gensio_list_add_tail(&b->waiters, &w->link);
+	w->queued = true;
+	rv = true;
+    } else {
+	__atomic_sub_fetch(&b->nwaiters, 1, __ATOMIC_SEQ_CST);
+    }
+    UNLOCK(&b->wait_lock);
+
+    return rv;
+}
+
+static bool
+gensio_unix_mem_wait_cancel(struct gensio_os_funcs *o,
+			    struct gensio_os_mem_waiter *w)
+{
+    struct gensio_data *d = o->user_data;
+    struct gensio_mem_budget *b = d->budget;
+    bool rv;
+
+    LOCK(&b->wait_lock);
+    rv = w->queued;
+    if (rv) {
+	gensio_list_rm(&b->waiters, &w->link);
+	w->queued = false;
+	__atomic_sub_fetch(&b->nwaiters, 1, __ATOMIC_SEQ_CST);
+    }
+    UNLOCK(&b->wait_lock);
+
+    return rv;
+}
+
+/*
+ * Poll without blocking for up to the current spin time.  Returns > 0
+ * if something was handled, 0 if nothing happened and the caller
+ * should block, and < 0 on error with errno set.  rtv (if not NULL)
+ * has the time spent subtracted from it.
+ */
+static int
+gensio_unix_busy_poll(struct gensio_data *d, sel_send_sig_cb send_sig,
+		      long thread_id, void *cb_data, struct timeval *rtv,
+		      bool intr, sigset_t *sigmask)
+{
+    unsigned int budget = __atomic_load_n(&d->spin_cur, __ATOMIC_RELAXED);
+    unsigned int max, min;
+    struct timeval start, now, zero;
+    uint64_t spent, limit = budget;
+    int rv;
+
+    if (!budget)
+	return 0;
+
+    if (rtv) {
+	if (rtv->tv_sec == 0 && rtv->tv_usec < limit)
+	    limit = rtv->tv_usec;
+    }
+
+    __atomic_fetch_add(&d->spins, 1, __ATOMIC_RELAXED);
+    sel_get_monotonic_time(&start);
+    do {
+	zero.tv_sec = 0;
+	zero.tv_usec = 0;
+	if (intr)
+	    rv = sel_select_intr_sigmask(d->sel, send_sig, thread_id, cb_data,
+					 &zero, sigmask);
+	else
+	    rv = sel_select(d->sel, send_sig, thread_id, cb_data, &zero);
+	sel_get_monotonic_time(&now);
+	spent = ((uint64_t) (now.tv_sec - start.tv_sec)) * 1000000
+	    + now.tv_usec - start.tv_usec;
+    } while (rv == 0 && spent < limit);
+
+    if (rtv) {
+	now.tv_sec = spent / 1000000;
+	now.tv_usec = spent % 1000000;
+	if (timercmp(rtv, &now, >))
+	    timersub(rtv, &now, rtv);
+	else
+	    timerclear(rtv);
+    }
+
+    max = __atomic_load_n(&d->spin_max, __ATOMIC_RELAXED);
+    if (rv == 0) {
+	__atomic_fetch_add(&d->spin_misses, 1, __ATOMIC_RELAXED);
+	min = max / 16;
+	if (min == 0)
+	    min = 1;
+	budget /= 2;
+	if (budget < min)
+	    budget = min;
+    } else {
+	if (rv > 0)
+	    __atomic_fetch_add(&d->spin_hits, 1, __ATOMIC_RELAXED);
+	budget = max;
+    }
+    /* If busy polling was turned off while spinning, leave it off. */
+    if (max)
+	__atomic_store_n(&d->spin_cur, budget, __ATOMIC_RELAXED);
+
+    return rv;
 }
 
 static void
@@ -119,9 +398,16 @@ init_mutex(unsigned int flags, pthread_mutex_t *mutex)
     return 0;
 }
 
+/* A pool of selector wakeups for threads waiting on a waiter. */
+struct waiter_wakeup {
+    sel_wakeup_t *wakeup;
+    struct waiter_wakeup *next;
+};
+
 struct waiter_data {
     pthread_t tid;
     int wake_sig;
+    struct waiter_wakeup *wakeup; /* If NULL, use wake_sig. */
     unsigned int count;
     struct waiter_data *prev;
     struct waiter_data *next;
@@ -134,6 +420,7 @@ typedef struct waiter_s {
     unsigned int count;
     pthread_mutex_t lock;
     struct waiter_data wts;
+    struct waiter_wakeup *wakeups;
 } waiter_t;
 
 static waiter_t *
@@ -159,6 +446,13 @@ free_waiter(waiter_t *waiter)
 {
     assert(waiter);
     assert(waiter->wts.next == waiter->wts.prev);
+    while (waiter->wakeups) {
+	struct waiter_wakeup *ww = waiter->wakeups;
+
+	waiter->wakeups = ww->next;
+	sel_free_wakeup(ww->wakeup);
+	waiter->o->free(waiter->o, ww);
+    }
     pthread_mutex_destroy(&waiter->lock);
     waiter->o->free(waiter->o, waiter);
 }
@@ -171,6 +465,36 @@ wake_thread_send_sig_waiter(long thread_id, void *cb_data)
     pthread_kill(w->tid, w->wake_sig);
 }
 
+/*
+ * Get a wakeup for a thread to wait on.  Returns NULL if the selector
+ * isn't using wakeup fds or one can't be allocated, the thread will
+ * be woken with a signal then.  Must be called with the waiter lock
+ * held, but may release it.
+ */
+static struct waiter_wakeup *
+get_waiter_wakeup(waiter_t *waiter)
+{
+    struct gensio_os_funcs *o = waiter->o;
+    struct waiter_wakeup *ww = waiter->wakeups;
+
+    if (ww) {
+	waiter->wakeups = ww->next;
+	return ww;
+    }
+
+    if (!sel_get_wakeup(waiter->sel))
+	return NULL;
+
+    pthread_mutex_unlock(&waiter->lock);
+    ww = o->zalloc(o, sizeof(*ww));
+    if (ww && sel_alloc_wakeup(waiter->sel, &ww->wakeup)) {
+	o->free(o, ww);
+	ww = NULL;
+    }
+    pthread_mutex_lock(&waiter->lock);
+    return ww;
+}
+
 static void
 i_wake_waiter(waiter_t *waiter, unsigned int count)
 {
@@ -191,7 +515,10 @@ i_wake_waiter(waiter_t *waiter, unsigned int count)
 		sel_wake_one(waiter->sel, (long) w->tid,
 			     wake_thread_send_sig_waiter, w);
 #else
-		pthread_kill(w->tid, w->wake_sig);
+		if (w->wakeup)
+		    sel_wakeup_send((long) w->tid, w->wakeup->wakeup);
+		else
+		    pthread_kill(w->tid, w->wake_sig);
 #endif
 	    }
 	}
@@ -207,6 +534,8 @@ i_wait_for_waiter_timeout(waiter_t *waiter, unsigned int count,
 {
     struct waiter_data w;
     struct timeval tv, *rtv;
+    sel_send_sig_cb send_sig = wake_thread_send_sig_waiter;
+    void *send_data = &w;
     int err = 0;
 
     w.tid = pthread_self();
@@ -216,6 +545,11 @@ i_wait_for_waiter_timeout(waiter_t *waiter, unsigned int count,
     w.count = count;
 
     pthread_mutex_lock(&waiter->lock);
+    w.wakeup = get_waiter_wakeup(waiter);
+    if (w.wakeup) {
+	send_sig = sel_wakeup_send;
+	send_data = w.wakeup->wakeup;
+    }
     waiter->wts.next->prev = &w;
     w.next = waiter->wts.next;
     waiter->wts.next = &w;
@@ -234,13 +568,16 @@ i_wait_for_waiter_timeout(waiter_t *waiter, unsigned int count,
     }
     while (w.count > 0) {
 	pthread_mutex_unlock(&waiter->lock);
-	if (intr)
-	    err = sel_select_intr_sigmask(waiter->sel,
-					  wake_thread_send_sig_waiter,
-					  (long) w.tid, &w, rtv, sigmask);
-	else
-	    err = sel_select(waiter->sel, wake_thread_send_sig_waiter,
-			     (long) w.tid, &w, rtv);
+	err = gensio_unix_busy_poll(waiter->o->user_data, send_sig,
+				    (long) w.tid, send_data, rtv, intr,
+				    sigmask);
+	if (err == 0 && intr)
+	    err = sel_select_intr_sigmask(waiter->sel, send_sig,
+					  (long) w.tid, send_data, rtv,
+					  sigmask);
+	else if (err == 0)
+	    err = sel_select(waiter->sel, send_sig, (long) w.tid, send_data,
+			     rtv);
 	if (err < 0)
 	    err = errno;
 	else if (err == 0)
@@ -264,6 +601,10 @@ i_wait_for_waiter_timeout(waiter_t *waiter, unsigned int count,
 	 */
 	i_wake_waiter(waiter, count - w.count);
     }
+    if (w.wakeup) {
+	w.wakeup->next = waiter->wakeups;
+	waiter->wakeups = w.wakeup;
+    }
     pthread_mutex_unlock(&waiter->lock);
 
     return err;
@@ -314,10 +655,12 @@ i_wait_for_waiter_timeout(waiter_t *waiter, unsigned int count,
 
     rtv = gensio_time_to_timeval(&tv, timeout);
     while (waiter->count < count) {
-	if (intr)
+	err = gensio_unix_busy_poll(waiter->o->user_data, 0, 0, NULL, rtv,
+				    intr, sigmask);
+	if (err == 0 && intr)
 	    err = sel_select_intr_sigmask(waiter->sel, 0, 0, NULL, rtv,
 					  sigmask);
-	else
+	else if (err == 0)
 	    err = sel_select(waiter->sel, 0, 0, NULL, rtv);
 	if (err < 0) {
 	    err = errno;
@@ -727,6 +1070,20 @@ gensio_unix_start_timer_abs(struct gensio_timer *timer, gensio_time *timeout)
     return gensio_os_err_to_err(timer->f, rv);
 }
 
+static int
+gensio_unix_start_timer_slack(struct gensio_timer *timer, gensio_time *timeout,
+			      gensio_time *slack)
+{
+    struct timeval tv, stv = { 0, 0 };
+    int rv;
+
+    sel_get_monotonic_time(&tv);
+    add_to_timeval(&tv, timeout);
+    add_to_timeval(&stv, slack);
+    rv = sel_start_timer_slack(timer->sel_timer, &tv, &stv);
+    return gensio_os_err_to_err(timer->f, rv);
+}
+
 static int
 gensio_unix_stop_timer(struct gensio_timer *timer)
 {
@@ -928,13 +1285,27 @@ gensio_unix_service(struct gensio_os_funcs *f, gensio_time *timeout)
 {
     struct gensio_data *d = f->user_data;
     struct wait_data w;
+    sel_wakeup_t *wakeup = sel_get_wakeup(d->sel);
     struct timeval tv, *rtv;
     int err;
 
     w.id = pthread_self();
     w.wake_sig = d->wake_sig;
     rtv = gensio_time_to_timeval(&tv, timeout);
-    err = sel_select_intr(d->sel, wake_thread_send_sig, (long) w.id, &w, rtv);
+    if (wakeup) {
+	/* Any servicing thread will do, use the shared wakeup. */
+	err = gensio_unix_busy_poll(d, sel_wakeup_send, (long) w.id, wakeup,
+				    rtv, true, NULL);
+	if (err == 0)
+	    err = sel_select_intr(d->sel, sel_wakeup_send, (long) w.id, wakeup,
+				  rtv);
+    } else {
+	err = gensio_unix_busy_poll(d, wake_thread_send_sig, (long) w.id, &w,
+				    rtv, true, NULL);
+	if (err == 0)
+	    err = sel_select_intr(d->sel, wake_thread_send_sig, (long) w.id,
+				  &w, rtv);
+    }
     if (err < 0)
 	err = gensio_os_err_to_err(f, errno);
     else if (err == 0)
@@ -954,7 +1325,9 @@ gensio_unix_service(struct gensio_os_funcs *f, gensio_time *timeout)
     int err;
 
     rtv = gensio_time_to_timeval(&tv, timeout);
-    err = sel_select_intr(d->sel, NULL, 0, NULL, rtv);
+    err = gensio_unix_busy_poll(d, NULL, 0, NULL, rtv, true, NULL);
+    if (err == 0)
+	err = sel_select_intr(d->sel, NULL, 0, NULL, rtv);
     if (err < 0)
 	err = gensio_os_err_to_err(f, errno);
     else if (err == 0)
@@ -985,6 +1358,9 @@ gensio_unix_get_funcs(struct gensio_os_funcs *f)
 {
     struct gensio_data *d = f->user_data;
 
+    if (d->reactors)
+	d = d->reactors->o[0]->user_data;
+
     LOCK(&d->reflock);
     assert(d->refcount > 0);
     d->refcount++;
@@ -992,10 +1368,34 @@ gensio_unix_get_funcs(struct gensio_os_funcs *f)
     return f;
 }
 
+static void
+i_gensio_unix_free_funcs(struct gensio_os_funcs *f, bool free_mtrack)
+{
+    struct gensio_data *d = f->user_data;
+
+    gensio_stdsock_cleanup(f);
+    if (free_mtrack) {
+	gensio_memtrack_cleanup(d->mtrack);
+	gensio_mempool_free(d->mempool);
+    }
+    if (d->freesel)
+	sel_free_selector(d->sel);
+    LOCK_DESTROY(&d->budget_data.wait_lock);
+    free(f->user_data);
+    free(f);
+}
+
 static void
 gensio_unix_free_funcs(struct gensio_os_funcs *f)
 {
     struct gensio_data *d = f->user_data;
+    struct gensio_reactors *r = d->reactors;
+    unsigned int i;
+
+    if (r) {
+	f = r->o[0];
+	d = f->user_data;
+    }
 
     LOCK(&defos_lock);
     LOCK(&d->reflock);
@@ -1012,12 +1412,25 @@ gensio_unix_free_funcs(struct gensio_os_funcs *f)
 	defoshnd = NULL;
     UNLOCK(&defos_lock);
 
-    gensio_stdsock_cleanup(f);
-    gensio_memtrack_cleanup(d->mtrack);
-    if (d->freesel)
-	sel_free_selector(d->sel);
-    free(f->user_data);
-    free(f);
+    if (r) {
+	for (i = r->count - 1; i > 0; i--)
+	    i_gensio_unix_free_funcs(r->o[i], false);
+	free(r);
+    }
+    i_gensio_unix_free_funcs(f, true);
+}
+
+static struct gensio_os_funcs *
+gensio_unix_get_reactor(struct gensio_os_funcs *f, unsigned int idx)
+{
+    struct gensio_data *d = f->user_data;
+    struct gensio_reactors *r = d->reactors;
+
+    if (!r)
+	return f;
+    if (idx == GENSIO_OS_REACTOR_NEXT)
+	idx = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED);
+    return r->o[idx % r->count];
 }
 
 static lock_type once_lock = LOCK_INITIALIZER;
@@ -1161,6 +1574,22 @@ gensio_unix_release_iod(struct gensio_iod *iiod)
     o->free(o, iod);
 }
 
+static int
+gensio_unix_iod_set_reactor(struct gensio_iod *iiod,
+			    struct gensio_os_funcs *to)
+{
+    struct gensio_iod_unix *iod = i_to_sel(iiod);
+    struct gensio_data *fd = iod->r.f->user_data, *td = to->user_data;
+
+    if (!fd->reactors || fd->reactors != td->reactors)
+	return GE_INVAL;
+    /* Files have a runner and lock on the old reactor. */
+    if (iod->handlers_set || iod->type == GENSIO_IOD_FILE)
+	return GE_INUSE;
+    iod->r.f = to;
+    return 0;
+}
+
 static int
 gensio_unix_iod_get_type(struct gensio_iod *iiod)
 {
@@ -1197,6 +1626,20 @@ do {								\
     rv = gensio_os_err_to_err(o, err);				\
 } while(0)
 
+/*
+ * A read or write came up short, see GENSIO_IOD_CONTROL_DRAINED.
+ * Datagram sockets use the socket calls, so this is only a stream.
+ */
+static void
+gensio_unix_drained(struct gensio_iod_unix *iod, gensiods *rcount,
+		    gensiods len, int write)
+{
+    struct gensio_data *d = iod->r.f->user_data;
+
+    if (rcount && *rcount < len && iod->handlers_set)
+	sel_fd_drained(d->sel, iod->fd, write);
+}
+
 static int
 gensio_unix_write(struct gensio_iod *iiod,
 		  const struct gensio_sg *sg, gensiods sglen,
@@ -1204,6 +1647,7 @@ gensio_unix_write(struct gensio_iod *iiod,
 {
     struct gensio_iod_unix *iod = i_to_sel(iiod);
     struct gensio_os_funcs *o = iiod->f;
+    gensiods i, len = 0;
     ssize_t rv;
 
     if (do_errtrig())
@@ -1217,6 +1661,11 @@ gensio_unix_write(struct gensio_iod *iiod,
  retry:
     rv = writev(iod->fd, (struct iovec *) sg, sglen);
     ERRHANDLE();
+    if (!rv) {
+	for (i = 0; i < sglen; i++)
+	    len += sg[i].buflen;
+	gensio_unix_drained(iod, rcount, len, 1);
+    }
     return rv;
 }
 
@@ -1239,6 +1688,8 @@ gensio_unix_read(struct gensio_iod *iiod,
  retry:
     rv = read(iod->fd, buf, buflen);
     ERRHANDLE();
+    if (!rv)
+	gensio_unix_drained(iod, rcount, buflen, 0);
     return rv;
 }
 
@@ -1516,6 +1967,30 @@ gensio_unix_iod_control(struct gensio_iod *iiod, int op, bool get, intptr_t val)
 {
     struct gensio_iod_unix *iod = i_to_sel(iiod);
 
+    if (op == GENSIO_IOD_CONTROL_DRAINED) {
+	struct gensio_data *d = iiod->f->user_data;
+
+	if (get)
+	    return GE_NOTSUP;
+	if (iod->handlers_set)
+	    sel_fd_drained(d->sel, iod->fd, val);
+	return 0;
+    }
+
+    if (op == GENSIO_IOD_CONTROL_ERRQUEUE) {
+	struct gensio_data *d = iiod->f->user_data;
+	int rv;
+
+	if (get)
+	    return GE_NOTSUP;
+	if (!iod->handlers_set)
+	    return GE_NOTREADY;
+	rv = sel_set_fd_errqueue(d->sel, iod->fd, val);
+	if (rv == ENOSYS)
+	    return GE_NOTSUP;
+	return gensio_os_err_to_err(iiod->f, rv);
+    }
+
     if (iod->type == GENSIO_IOD_SOCKET) {
 	if (op != GENSIO_IOD_CONTROL_SOCKINFO)
 	    return GE_NOTSUP;
@@ -1597,22 +2072,160 @@ gensio_unix_get_random(struct gensio_os_funcs *o,
     return gensio_os_err_to_err(o, rv);
 }
 
+static void
+stats_hist_copy(struct gensio_os_stats_hist *dst, struct sel_stats_hist *src)
+{
+    unsigned int i;
+
+    dst->count = src->count;
+    dst->total = src->total;
+    dst->max = src->max;
+    for (i = 0; i < GENSIO_OS_STATS_HIST_BUCKETS; i++) {
+	if (i < SEL_STATS_HIST_BUCKETS)
+	    dst->buckets[i] = src->buckets[i];
+	else
+	    dst->buckets[i] = 0;
+    }
+}
+
 static int
 gensio_unix_control(struct gensio_os_funcs *o, int func, void *data,
 		    gensiods *datalen)
 {
     struct gensio_data *d = o->user_data;
+    struct gensio_os_stats *ostats;
+    struct sel_stats stats;
+    struct gensio_os_busy_poll *bp;
+    struct gensio_os_mem_usage *mu;
+    unsigned int i;
 
     switch (func) {
     case GENSIO_CONTROL_SET_PROC_DATA:
 	d->pdata = data;
 	return 0;
 
+    case GENSIO_CONTROL_ENABLE_STATS:
+	if (!datalen || *datalen < sizeof(int))
+	    return GE_INVAL;
+	sel_set_stats_enabled(d->sel, *((int *) data));
+	return 0;
+
+    case GENSIO_CONTROL_GET_STATS:
+	if (!datalen || *datalen < sizeof(*ostats))
+	    return GE_INVAL;
+	ostats = data;
+	sel_get_stats(d->sel, &stats);
+	stats_hist_copy(&ostats->loop_time, &stats.loop_time);
+	stats_hist_copy(&ostats->fd_handler_time, &stats.fd_handler_time);
+	stats_hist_copy(&ostats->timer_handler_time, &stats.timer_handler_time);
+	stats_hist_copy(&ostats->runner_time, &stats.runner_time);
+	stats_hist_copy(&ostats->timer_lateness, &stats.timer_lateness);
+	stats_hist_copy(&ostats->runner_queue_depth,
+			&stats.runner_queue_depth);
+	*datalen = sizeof(*ostats);
+	return 0;
+
+    case GENSIO_CONTROL_GET_MEMPOOL_STATS:
+	if (!d->mempool)
+	    return GE_NOTSUP;
+	if (!datalen || *datalen < sizeof(struct gensio_os_mempool_stats))
+	    return GE_INVAL;
+	gensio_mempool_get_stats(d->mempool, data);
+	*datalen = sizeof(struct gensio_os_mempool_stats);
+	return 0;
+
+    case GENSIO_CONTROL_SET_MEM_LIMITS:
+	if (!datalen || *datalen < sizeof(*mu))
+	    return GE_INVAL;
+	mu = data;
+	__atomic_store_n(&d->budget->soft_limit, mu->soft_limit,
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&d->budget->hard_limit, mu->hard_limit,
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&d->budget->peak,
+			 __atomic_load_n(&d->budget->in_use, __ATOMIC_RELAXED),
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&d->budget->soft_limit_hits, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->budget->hard_limit_failures, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->budget->hard_logged, false, __ATOMIC_RELAXED);
+	/* The soft limit may have gone up, let waiters try again. */
+	if (__atomic_load_n(&d->budget->nwaiters, __ATOMIC_SEQ_CST))
+	    gensio_mem_budget_wake(d->budget);
+	*datalen = sizeof(*mu);
+	return 0;
+
+    case GENSIO_CONTROL_DISABLE_MMSG:
+	if (d->reactors) {
+	    for (i = 0; i < d->reactors->count; i++) {
+		d->reactors->o[i]->recvfrom_multi = NULL;
+		d->reactors->o[i]->sendto_multi = NULL;
+	    }
+	} else {
+	    o->recvfrom_multi = NULL;
+	    o->sendto_multi = NULL;
+	}
+	return 0;
+
+    case GENSIO_CONTROL_GET_MEM_USAGE:
+	if (!datalen || *datalen < sizeof(*mu))
+	    return GE_INVAL;
+	mu = data;
+	mu->soft_limit = __atomic_load_n(&d->budget->soft_limit,
+					 __ATOMIC_RELAXED);
+	mu->hard_limit = __atomic_load_n(&d->budget->hard_limit,
+					 __ATOMIC_RELAXED);
+	mu->in_use = __atomic_load_n(&d->budget->in_use, __ATOMIC_RELAXED);
+	mu->peak = __atomic_load_n(&d->budget->peak, __ATOMIC_RELAXED);
+	mu->soft_limit_hits = __atomic_load_n(&d->budget->soft_limit_hits,
+					      __ATOMIC_RELAXED);
+	mu->hard_limit_failures =
+	    __atomic_load_n(&d->budget->hard_limit_failures, __ATOMIC_RELAXED);
+	*datalen = sizeof(*mu);
+	return 0;
+
+    case GENSIO_CONTROL_SET_BUSY_POLL:
+	if (!datalen || *datalen < sizeof(*bp))
+	    return GE_INVAL;
+	bp = data;
+	__atomic_store_n(&d->spin_max, bp->spin_usecs, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->spin_cur, bp->spin_usecs, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->sock_busy_poll, bp->sock_usecs,
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&d->spins, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->spin_hits, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->spin_misses, 0, __ATOMIC_RELAXED);
+	*datalen = sizeof(*bp);
+	return 0;
+
+    case GENSIO_CONTROL_GET_BUSY_POLL:
+	if (!datalen || *datalen < sizeof(*bp))
+	    return GE_INVAL;
+	bp = data;
+	bp->spin_usecs = __atomic_load_n(&d->spin_max, __ATOMIC_RELAXED);
+	bp->sock_usecs = __atomic_load_n(&d->sock_busy_poll, __ATOMIC_RELAXED);
+	bp->cur_spin_usecs = __atomic_load_n(&d->spin_cur, __ATOMIC_RELAXED);
+	bp->spins = __atomic_load_n(&d->spins, __ATOMIC_RELAXED);
+	bp->hits = __atomic_load_n(&d->spin_hits, __ATOMIC_RELAXED);
+	bp->misses = __atomic_load_n(&d->spin_misses, __ATOMIC_RELAXED);
+	*datalen = sizeof(*bp);
+	return 0;
+
     default:
 	return GE_NOTSUP;
     }
 }
 
+/* Get a byte count from the environment, 0 if it is not set. */
+static gensiods
+gensio_unix_env_size(const char *name)
+{
+    const char *s = getenv(name);
+
+    if (!s)
+	return 0;
+    return strtoul(s, NULL, 0);
+}
+
 static struct gensio_os_funcs *
 gensio_unix_alloc_sel(struct selector_s *sel, int wake_sig, unsigned int flags)
 {
@@ -1642,6 +2255,15 @@ gensio_unix_alloc_sel(struct selector_s *sel, int wake_sig, unsigned int flags)
     d->sel = sel;
     d->wake_sig = wake_sig;
     d->mtrack = gensio_memtrack_alloc();
+    /* The memory tracker needs to see every allocation. */
+    if (!d->mtrack && ((flags & GENSIO_OS_FUNCS_FLAG_MEMPOOL) ||
+		       getenv("GENSIO_MEMPOOL")))
+	d->mempool = gensio_mempool_alloc();
+    d->budget = &d->budget_data;
+    d->budget->soft_limit = gensio_unix_env_size("GENSIO_MEM_SOFT_LIMIT");
+    d->budget->hard_limit = gensio_unix_env_size("GENSIO_MEM_HARD_LIMIT");
+    LOCK_INIT(&d->budget->wait_lock);
+    gensio_list_init(&d->budget->waiters);
 
     o->zalloc = gensio_unix_zalloc;
     o->free = gensio_unix_free;
@@ -1659,6 +2281,7 @@ gensio_unix_alloc_sel(struct selector_s *sel, int wake_sig, unsigned int flags)
     o->free_timer = gensio_unix_free_timer;
     o->start_timer = gensio_unix_start_timer;
     o->start_timer_abs = gensio_unix_start_timer_abs;
+    o->start_timer_slack = gensio_unix_start_timer_slack;
     o->stop_timer = gensio_unix_stop_timer;
     o->stop_timer_with_done = gensio_unix_stop_timer_with_done;
     o->alloc_runner = gensio_unix_alloc_runner;
@@ -1698,6 +2321,13 @@ gensio_unix_alloc_sel(struct selector_s *sel, int wake_sig, unsigned int flags)
     o->get_random = gensio_unix_get_random;
     o->iod_control = gensio_unix_iod_control;
     o->control = gensio_unix_control;
+    o->get_reactor = gensio_unix_get_reactor;
+    o->iod_set_reactor = gensio_unix_iod_set_reactor;
+    o->mem_charge = gensio_unix_mem_charge;
+    o->mem_uncharge = gensio_unix_mem_uncharge;
+    o->mem_over_soft_limit = gensio_unix_mem_over_soft_limit;
+    o->mem_wait = gensio_unix_mem_wait;
+    o->mem_wait_cancel = gensio_unix_mem_wait_cancel;
 
     gensio_addr_addrinfo_set_os_funcs(o);
     if (gensio_stdsock_set_os_funcs(o)) {
@@ -2236,15 +2866,125 @@ struct gensio_thread {
 #ifdef USE_PTHREADS
     pthread_t id;
 #endif
+    int numa_node;
     void (*start_func)(void *data);
     void *data;
 };
 
+#if defined(USE_PTHREADS) && defined(HAVE_PTHREAD_SETAFFINITY_NP) && \
+	defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP) && defined(CPU_SET)
+#define GENSIO_HAVE_CPU_AFFINITY
+#endif
+
+#ifdef GENSIO_HAVE_CPU_AFFINITY
+#define GENSIO_MAX_NUMA_NODES 1024
+
+/*
+ * Get the CPUs on a NUMA node from sysfs.  The list there is in the
+ * form "0-3,8,10-11".
+ */
+static int
+gensio_numa_node_cpus(int node, cpu_set_t *cpus)
+{
+    char fname[100], buf[1024], *s, *end;
+    unsigned long start, last;
+    FILE *f;
+
+    snprintf(fname, sizeof(fname),
+	     "/sys/devices/system/node/node%d/cpulist", node);
+    f = fopen(fname, "r");
+    if (!f)
+	return GE_NOTFOUND;
+    s = fgets(buf, sizeof(buf), f);
+    fclose(f);
+    if (!s)
+	return GE_NOTFOUND;
+
+    CPU_ZERO(cpus);
+    while (*s && *s != '\n') {
+	start = strtoul(s, &end, 10);
+	if (end == s)
+	    return GE_INVAL;
+	last = start;
+	s = end;
+	if (*s == '-') {
+	    s++;
+	    last = strtoul(s, &end, 10);
+	    if (end == s)
+		return GE_INVAL;
+	    s = end;
+	}
+	for (; start <= last && start < CPU_SETSIZE; start++)
+	    CPU_SET(start, cpus);
+	if (*s == ',')
+	    s++;
+    }
+    return 0;
+}
+
+/*
+ * Convert attr to a CPU set.  limit is set to false if the thread
+ * should be allowed to run anywhere.
+ */
+static int
+gensio_thread_attr_cpus(const struct gensio_thread_attr *attr,
+			cpu_set_t *cpus, bool *limit)
+{
+    unsigned int i;
+    int rv;
+
+    *limit = false;
+    if (attr->numa_node >= GENSIO_MAX_NUMA_NODES)
+	return GE_INVAL;
+
+    CPU_ZERO(cpus);
+    if (attr->num_cpus) {
+	for (i = 0; i < attr->num_cpus; i++) {
+	    if (attr->cpus[i] >= CPU_SETSIZE)
+		return GE_INVAL;
+	    CPU_SET(attr->cpus[i], cpus);
+	}
+	*limit = true;
+    } else if (attr->numa_node >= 0) {
+	rv = gensio_numa_node_cpus(attr->numa_node, cpus);
+	if (rv)
+	    return rv;
+	/* Memory-only nodes have no CPUs, don't limit in that case. */
+	*limit = CPU_COUNT(cpus) > 0;
+    }
+    return 0;
+}
+
+/*
+ * Prefer memory from the given node for the calling thread.  This is
+ * only a preference, and kernels without NUMA support will fail it,
+ * so errors are ignored.
+ */
+static void
+gensio_thread_set_mempolicy(int node)
+{
+#if defined(linux) && defined(SYS_set_mempolicy)
+    unsigned long mask[GENSIO_MAX_NUMA_NODES / (sizeof(unsigned long) * 8)];
+    unsigned int bits = sizeof(unsigned long) * 8;
+
+    if (node < 0)
+	return;
+    memset(mask, 0, sizeof(mask));
+    mask[node / bits] |= 1UL << (node % bits);
+    /* 1 is MPOL_PREFERRED. */
+    syscall(SYS_set_mempolicy, 1, mask, GENSIO_MAX_NUMA_NODES + 1);
+#endif
+}
+#endif /* GENSIO_HAVE_CPU_AFFINITY */
+
 static void *
 gensio_os_thread_func(void *info)
 {
     struct gensio_thread *tid = info;
 
+#ifdef GENSIO_HAVE_CPU_AFFINITY
+    gensio_thread_set_mempolicy(tid->numa_node);
+#endif
     tid->start_func(tid->data);
     return NULL;
 }
@@ -2253,29 +2993,95 @@ int
 gensio_os_new_thread(struct gensio_os_funcs *o,
 		     void (*start_func)(void *data), void *data,
 		     struct gensio_thread **thread_id)
+{
+    return gensio_os_new_thread_attr(o, start_func, data, NULL, thread_id);
+}
+
+int
+gensio_os_new_thread_attr(struct gensio_os_funcs *o,
+			  void (*start_func)(void *data), void *data,
+			  const struct gensio_thread_attr *attr,
+			  struct gensio_thread **thread_id)
 {
 #ifdef USE_PTHREADS
     struct gensio_thread *tid;
+    pthread_attr_t *pattrp = NULL;
     int rv;
+#ifdef GENSIO_HAVE_CPU_AFFINITY
+    pthread_attr_t pattr;
+    cpu_set_t cpus;
+    bool limit = false;
+
+    if (attr) {
+	rv = gensio_thread_attr_cpus(attr, &cpus, &limit);
+	if (rv)
+	    return rv;
+    }
+#else
+    if (attr && (attr->num_cpus || attr->numa_node >= 0))
+	return GE_NOTSUP;
+#endif
 
     tid = o->zalloc(o, sizeof(*tid));
     if (!tid)
 	return GE_NOMEM;
     tid->o = o;
+    tid->numa_node = attr ? attr->numa_node : -1;
     tid->start_func = start_func;
     tid->data = data;
-    rv = pthread_create(&tid->id, NULL, gensio_os_thread_func, tid);
-    if (rv) {
-	o->free(o, tid);
-	return gensio_os_err_to_err(o, rv);
+#ifdef GENSIO_HAVE_CPU_AFFINITY
+    if (limit) {
+	pattrp = &pattr;
+	pthread_attr_init(pattrp);
+	rv = pthread_attr_setaffinity_np(pattrp, sizeof(cpus), &cpus);
+	if (rv)
+	    goto out_err;
     }
+#endif
+    rv = pthread_create(&tid->id, pattrp, gensio_os_thread_func, tid);
+    if (rv)
+	goto out_err;
+    if (pattrp)
+	pthread_attr_destroy(pattrp);
     *thread_id = tid;
     return 0;
+
+ out_err:
+    if (pattrp)
+	pthread_attr_destroy(pattrp);
+    o->free(o, tid);
+    return gensio_os_err_to_err(o, rv);
 #else
     return GE_NOTSUP;
 #endif
 }
 
+int
+gensio_os_thread_set_attr(struct gensio_os_funcs *o,
+			  const struct gensio_thread_attr *attr)
+{
+#ifdef GENSIO_HAVE_CPU_AFFINITY
+    cpu_set_t cpus;
+    bool limit;
+    int rv;
+
+    rv = gensio_thread_attr_cpus(attr, &cpus, &limit);
+    if (rv)
+	return rv;
+    if (limit) {
+	rv = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if (rv)
+	    return gensio_os_err_to_err(o, rv);
+    }
+    gensio_thread_set_mempolicy(attr->numa_node);
+    return 0;
+#else
+    if (attr->num_cpus || attr->numa_node >= 0)
+	return GE_NOTSUP;
+    return 0;
+#endif
+}
+
 int gensio_os_wait_thread(struct gensio_thread *tid)
 {
 #ifdef USE_PTHREADS
@@ -2378,14 +3184,16 @@ defsel_unlock(sel_lock_t *l)
 
 static int
 i_gensio_unix_funcs_alloc(struct selector_s *sel, int wake_sig,
-			  unsigned int flags,
+			  unsigned int flags, bool use_uring,
 			  struct gensio_os_funcs **ro)
 {
     struct gensio_os_funcs *o;
     bool freesel = false;
     int rv;
 
-    if (flags & ~GENSIO_OS_FUNCS_FLAG_PRIO_INHERIT)
+    if (flags & ~(GENSIO_OS_FUNCS_FLAG_PRIO_INHERIT |
+		  GENSIO_OS_FUNCS_FLAG_MEMPOOL |
+		  GENSIO_OS_FUNCS_FLAG_TIMER_WHEEL))
 	return GE_NOTSUP;
 
 #ifndef USE_PTHREADS
@@ -2406,8 +3214,31 @@ i_gensio_unix_funcs_alloc(struct selector_s *sel, int wake_sig,
 	if (rv)
 	    return GE_NOMEM;
 	freesel = true;
+
+	/* No timers have been started yet, so this can't fail with EBUSY. */
+	if ((flags & GENSIO_OS_FUNCS_FLAG_TIMER_WHEEL) ||
+		getenv("GENSIO_TIMER_WHEEL")) {
+	    rv = sel_use_timer_wheel(sel);
+	    if (rv) {
+		sel_free_selector(sel);
+		return GE_NOMEM;
+	    }
+	}
     }
 
+    /* If io_uring is not available, this just keeps using epoll. */
+    if (use_uring)
+	sel_use_io_uring(sel);
+
+#ifdef USE_PTHREADS
+    /*
+     * Wake threads with eventfds if we can, signals are the fallback
+     * (for select() and io_uring).
+     */
+    if (freesel)
+	sel_use_wakeup_fds(sel);
+#endif
+
     o = gensio_unix_alloc_sel(sel, wake_sig, flags);
     if (o) {
 	struct gensio_data *d = o->user_data;
@@ -2425,7 +3256,63 @@ int
 gensio_unix_funcs_alloc(struct selector_s *sel, int wake_sig,
 			struct gensio_os_funcs **ro)
 {
-    return i_gensio_unix_funcs_alloc(sel, wake_sig, 0, ro);
+    return i_gensio_unix_funcs_alloc(sel, wake_sig, 0, false, ro);
+}
+
+int
+gensio_uring_funcs_alloc(struct selector_s *sel, int wake_sig,
+			 struct gensio_os_funcs **ro)
+{
+    return i_gensio_unix_funcs_alloc(sel, wake_sig, 0, true, ro);
+}
+
+int
+gensio_unix_funcs_alloc_reactors(unsigned int count, int wake_sig,
+				 struct gensio_os_funcs **ro)
+{
+    struct gensio_reactors *r;
+    struct gensio_data *d0, *d;
+    unsigned int i;
+    int rv;
+
+    if (count == 0)
+	return GE_INVAL;
+
+    r = malloc(sizeof(*r) + count * sizeof(r->o[0]));
+    if (!r)
+	return GE_NOMEM;
+    memset(r, 0, sizeof(*r) + count * sizeof(r->o[0]));
+
+    for (i = 0; i < count; i++) {
+	rv = i_gensio_unix_funcs_alloc(NULL, wake_sig, 0, false, &r->o[i]);
+	if (!rv && !r->o[i])
+	    rv = GE_NOMEM;
+	if (rv)
+	    goto out_err;
+    }
+
+    d0 = r->o[0]->user_data;
+    for (i = 0; i < count; i++) {
+	d = r->o[i]->user_data;
+	if (i > 0) {
+	    gensio_memtrack_cleanup(d->mtrack);
+	    d->mtrack = d0->mtrack;
+	    gensio_mempool_free(d->mempool);
+	    d->mempool = d0->mempool;
+	    d->budget = d0->budget;
+	}
+	d->reactors = r;
+    }
+    r->count = count;
+
+    *ro = r->o[0];
+    return 0;
+
+ out_err:
+    while (i > 0)
+	i_gensio_unix_free_funcs(r->o[--i], true);
+    free(r);
+    return rv;
 }
 
 struct gensio_os_funcs *
@@ -2478,10 +3365,11 @@ gensio_valloc_os_funcs(int wake_sig, struct gensio_os_funcs **o,
     if (wake_sig == GENSIO_OS_FUNCS_DEFAULT_THREAD_SIGNAL)
 	wake_sig = SIGUSR1;
 
-    if (flags)
+    if (flags & ~(GENSIO_OS_FUNCS_FLAG_MEMPOOL |
+		  GENSIO_OS_FUNCS_FLAG_TIMER_WHEEL))
 	return GE_NOTSUP;
 
-    return gensio_unix_funcs_alloc(NULL, wake_sig, o);
+    return i_gensio_unix_funcs_alloc(NULL, wake_sig, flags, false, o);
 }
 
 int
@@ -4214,31 +4214,100 @@ gensio_os_thread_func(LPVOID info)
     return 0;
 }
 
+/*
+ * Convert attr to an affinity mask, 0 means run anywhere.  Windows
+ * allocates memory from the node the thread is running on, so only
+ * the affinity is needed to get NUMA locality.
+ */
+static int
+gensio_thread_attr_mask(const struct gensio_thread_attr *attr,
+			DWORD_PTR *rmask)
+{
+    DWORD_PTR mask = 0;
+    ULONGLONG nmask;
+    unsigned int i;
+
+    if (attr->num_cpus) {
+	for (i = 0; i < attr->num_cpus; i++) {
+	    if (attr->cpus[i] >= sizeof(mask) * 8)
+		return GE_INVAL;
+	    mask |= ((DWORD_PTR) 1) << attr->cpus[i];
+	}
+    } else if (attr->numa_node >= 0) {
+	if (attr->numa_node > 255)
+	    return GE_INVAL;
+	if (!GetNumaNodeProcessorMask((UCHAR) attr->numa_node, &nmask))
+	    return GE_NOTFOUND;
+	mask = (DWORD_PTR) nmask;
+    }
+    *rmask = mask;
+    return 0;
+}
+
 int
 gensio_os_new_thread(struct gensio_os_funcs *o,
 		     void (*start_func)(void *data), void *data,
 		     struct gensio_thread **thread_id)
+{
+    return gensio_os_new_thread_attr(o, start_func, data, NULL, thread_id);
+}
+
+int
+gensio_os_new_thread_attr(struct gensio_os_funcs *o,
+			  void (*start_func)(void *data), void *data,
+			  const struct gensio_thread_attr *attr,
+			  struct gensio_thread **thread_id)
 {
     struct gensio_thread *tid;
+    DWORD_PTR mask = 0;
     int rv;
 
+    if (attr) {
+	rv = gensio_thread_attr_mask(attr, &mask);
+	if (rv)
+	    return rv;
+    }
+
     tid = o->zalloc(o, sizeof(*tid));
     if (!tid)
 	return GE_NOMEM;
     tid->o = o;
     tid->start_func = start_func;
     tid->data = data;
-    tid->handle = CreateThread(NULL, 0, gensio_os_thread_func, tid, 0,
-			       &tid->tid);
+    tid->handle = CreateThread(NULL, 0, gensio_os_thread_func, tid,
+			       CREATE_SUSPENDED, &tid->tid);
     if (!tid->handle) {
 	rv = gensio_os_err_to_err(o, GetLastError());
 	o->free(o, tid);
 	return rv;
     }
+    if (mask && !SetThreadAffinityMask(tid->handle, mask)) {
+	rv = gensio_os_err_to_err(o, GetLastError());
+	TerminateThread(tid->handle, 0);
+	CloseHandle(tid->handle);
+	o->free(o, tid);
+	return rv;
+    }
+    ResumeThread(tid->handle);
     *thread_id = tid;
     return 0;
 }
 
+int
+gensio_os_thread_set_attr(struct gensio_os_funcs *o,
+			  const struct gensio_thread_attr *attr)
+{
+    DWORD_PTR mask;
+    int rv;
+
+    rv = gensio_thread_attr_mask(attr, &mask);
+    if (rv)
+	return rv;
+    if (mask && !SetThreadAffinityMask(GetCurrentThread(), mask))
+	return gensio_os_err_to_err(o, GetLastError());
+    return 0;
+}
+
 int gensio_os_wait_thread(struct gensio_thread *tid)
 {
     WaitForSingleObject(tid->handle, INFINITE);
@@ -25,8 +25,22 @@
 #include <syslog.h>
 #include <string.h>
 #include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/resource.h>
 #ifdef HAVE_EPOLL_PWAIT
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#define SEL_HAVE_URING
+#endif
 #else
 #define EPOLL_CTL_ADD 0
 #define EPOLL_CTL_DEL 0
@@ -70,6 +84,13 @@ typedef struct fd_state_s
     sel_runner_t      done_runner;
     int               tmp_fd;
     void              *done_cbdata;
+#ifdef HAVE_EPOLL_PWAIT
+    /* For edge-triggered mode, see process_events_et(). */
+    int               in_handler;
+    uint32_t          pending_events;
+    /* POLLIN/POLLOUT, see sel_fd_drained(). */
+    short             drained;
+#endif
 } fd_state_t;
 
 /* The control structure for each file descriptor. */
@@ -80,9 +101,6 @@ typedef struct fd_control_s
        deletion. */
     fd_state_t       *state;
 
-    /* Link in the hash list. */
-    struct fd_control_s *next;
-
     /* Handlers for various events on an fd. */
     void             *data; /* Passed to the handlers */
     sel_fd_handler_t handle_read;
@@ -99,6 +117,28 @@ typedef struct fd_control_s
 #ifdef HAVE_EPOLL_PWAIT
     /* See the comment in process_fds_epoll() on the use of this. */
     uint32_t saved_events;
+
+    /* See sel_set_fd_errqueue(). */
+    char errqueue;
+
+    /*
+     * Incremented every time the handlers for this fd are replaced or
+     * cleared.  Used to detect stale events in a batch from epoll.
+     */
+    unsigned long del_gen;
+#endif
+
+#ifdef SEL_HAVE_URING
+    /*
+     * For io_uring, if a poll is outstanding for this fd, the events
+     * it is waiting for, and the token to tell its completion from
+     * an old poll's completion.
+     */
+    int uring_armed;
+    uint32_t uring_events;
+    uint32_t uring_token;
+    /* The poll couldn't be updated, see uring_retry(). */
+    int uring_retry;
 #endif
 } fd_control_t;
 
@@ -131,6 +171,10 @@ typedef struct heap_val_s
 
     sel_timeout_handler_t done_handler;
     void *done_cb_data;
+
+    /* Where the timer is if the timer wheel is in use. */
+    struct sel_timer_s *wheel_next, *wheel_prev;
+    unsigned int wheel_slot;
 } heap_val_t;
 
 typedef struct theap_s theap_t;
@@ -167,6 +211,251 @@ heap_cmp_key(heap_val_t *v1, heap_val_t *v2)
 
 #include "heap.h"
 
+/*
+ * Hierarchical timer wheel, an alternative to the heap for selectors
+ * with lots of timers, see sel_use_timer_wheel().  Time is kept in
+ * 1ms ticks of the monotonic clock.  Each level has 64 slots, and
+ * each slot of a level covers 64 times the time of a slot of the
+ * level below it.  Timers far in the future sit in a coarse slot
+ * and are moved ("cascaded") down the levels as time gets close to
+ * them, so adding and removing a timer are O(1).
+ *
+ * "base" is the next tick that has not been processed.  A timer
+ * expiring at tick t is put into level L if t - base is less than
+ * 64^(L+1), in slot (t >> 6L) & 63.  A slot at level L > 0 is
+ * cascaded when the base reaches the start of its range, at that
+ * point all its timers go to lower levels.  Timers that are due are
+ * moved to the expired list and run from there.
+ */
+#define SEL_WHEEL_BITS		6
+#define SEL_WHEEL_SLOTS		(1 << SEL_WHEEL_BITS)
+#define SEL_WHEEL_MASK		(SEL_WHEEL_SLOTS - 1)
+#define SEL_WHEEL_LEVELS	6
+#define SEL_WHEEL_EXPIRED	(SEL_WHEEL_LEVELS * SEL_WHEEL_SLOTS)
+
+struct sel_wheel_list_s
+{
+    sel_timer_t *first;
+    sel_timer_t *last;
+};
+
+struct sel_wheel_s
+{
+    uint64_t base;
+
+    /* A bit is set in here for each non-empty slot in a level. */
+    uint64_t used[SEL_WHEEL_LEVELS];
+
+    struct sel_wheel_list_s slots[SEL_WHEEL_LEVELS][SEL_WHEEL_SLOTS];
+
+    /* Timers that are due to be run. */
+    struct sel_wheel_list_s expired;
+};
+
+static uint64_t
+wheel_timeval_to_tick(const struct timeval *tv, int round_up)
+{
+    uint64_t tick = ((uint64_t) tv->tv_sec) * 1000;
+
+    if (round_up)
+	return tick + (tv->tv_usec + 999) / 1000;
+    return tick + tv->tv_usec / 1000;
+}
+
+static void
+wheel_tick_to_timeval(uint64_t tick, struct timeval *tv)
+{
+    tv->tv_sec = tick / 1000;
+    tv->tv_usec = (tick % 1000) * 1000;
+}
+
+static struct sel_wheel_list_s *
+wheel_list(struct sel_wheel_s *w, unsigned int slot)
+{
+    if (slot == SEL_WHEEL_EXPIRED)
+	return &w->expired;
+    return &w->slots[slot / SEL_WHEEL_SLOTS][slot % SEL_WHEEL_SLOTS];
+}
+
+static void
+wheel_list_append(struct sel_wheel_s *w, unsigned int slot,
+		  sel_timer_t *timer)
+{
+    struct sel_wheel_list_s *list = wheel_list(w, slot);
+
+    timer->val.wheel_slot = slot;
+    timer->val.wheel_next = NULL;
+    timer->val.wheel_prev = list->last;
+    if (list->last)
+	list->last->val.wheel_next = timer;
+    else
+	list->first = timer;
+    list->last = timer;
+    if (slot != SEL_WHEEL_EXPIRED)
+	w->used[slot / SEL_WHEEL_SLOTS] |=
+	    ((uint64_t) 1) << (slot % SEL_WHEEL_SLOTS);
+}
+
+static void
+wheel_remove(struct sel_wheel_s *w, sel_timer_t *timer)
+{
+    unsigned int slot = timer->val.wheel_slot;
+    struct sel_wheel_list_s *list = wheel_list(w, slot);
+
+    if (timer->val.wheel_prev)
+	timer->val.wheel_prev->val.wheel_next = timer->val.wheel_next;
+    else
+	list->first = timer->val.wheel_next;
+    if (timer->val.wheel_next)
+	timer->val.wheel_next->val.wheel_prev = timer->val.wheel_prev;
+    else
+	list->last = timer->val.wheel_prev;
+    timer->val.wheel_next = NULL;
+    timer->val.wheel_prev = NULL;
+    if (!list->first && slot != SEL_WHEEL_EXPIRED)
+	w->used[slot / SEL_WHEEL_SLOTS] &=
+	    ~(((uint64_t) 1) << (slot % SEL_WHEEL_SLOTS));
+}
+
+static void
+wheel_add(struct sel_wheel_s *w, sel_timer_t *timer)
+{
+    uint64_t tick = wheel_timeval_to_tick(&timer->val.timeout, 1);
+    uint64_t delta;
+    unsigned int level;
+
+    if (tick < w->base) {
+	wheel_list_append(w, SEL_WHEEL_EXPIRED, timer);
+	return;
+    }
+
+    delta = tick - w->base;
+    for (level = 0; level < SEL_WHEEL_LEVELS - 1; level++) {
+	if (delta < ((uint64_t) 1) << (SEL_WHEEL_BITS * (level + 1)))
+	    break;
+    }
+    if (level == SEL_WHEEL_LEVELS - 1) {
+	uint64_t max = (((uint64_t) 1) << (SEL_WHEEL_BITS * SEL_WHEEL_LEVELS))
+	    - 1;
+
+	/* Way out there (years), it will be cascaded again later. */
+	if (delta > max)
+	    tick = w->base + max;
+    }
+
+    wheel_list_append(w, (level * SEL_WHEEL_SLOTS +
+			  ((tick >> (SEL_WHEEL_BITS * level))
+			   & SEL_WHEEL_MASK)),
+		      timer);
+}
+
+/*
+ * Find the next tick at or after the base where something has to be
+ * done, either a level 0 slot expiring or a slot at a higher level
+ * being cascaded.  Returns false if the wheel is empty.
+ */
+static bool
+wheel_next_tick(struct sel_wheel_s *w, uint64_t *rtick)
+{
+    unsigned int level, shift;
+    uint64_t unit, tick, best = 0;
+    bool found = false;
+
+    for (level = 0; level < SEL_WHEEL_LEVELS; level++) {
+	uint64_t used = w->used[level];
+
+	if (!used)
+	    continue;
+
+	shift = SEL_WHEEL_BITS * level;
+	/* The first slot boundary at this level at or after the base. */
+	unit = (w->base + (((uint64_t) 1) << shift) - 1) >> shift;
+	while (used) {
+	    unsigned int slot = __builtin_ctzll(used);
+
+	    used &= used - 1;
+	    tick = (unit + ((slot - unit) & SEL_WHEEL_MASK)) << shift;
+	    if (!found || tick < best) {
+		best = tick;
+		found = true;
+	    }
+	}
+    }
+
+    *rtick = best;
+    return found;
+}
+
+/* Move the timers in a higher level slot down to lower levels. */
+static void
+wheel_cascade(struct sel_wheel_s *w, unsigned int level)
+{
+    unsigned int slot = ((w->base >> (SEL_WHEEL_BITS * level))
+			 & SEL_WHEEL_MASK);
+    struct sel_wheel_list_s *list = &w->slots[level][slot];
+    sel_timer_t *timer = list->first;
+
+    list->first = NULL;
+    list->last = NULL;
+    w->used[level] &= ~(((uint64_t) 1) << slot);
+    while (timer) {
+	sel_timer_t *next = timer->val.wheel_next;
+
+	wheel_add(w, timer);
+	timer = next;
+    }
+}
+
+/*
+ * Process everything up to the given tick, moving all due timers to
+ * the expired list.
+ */
+static void
+wheel_advance(struct sel_wheel_s *w, uint64_t now)
+{
+    uint64_t tick;
+    unsigned int level, slot;
+    struct sel_wheel_list_s *list;
+
+    while (w->base <= now) {
+	if (!wheel_next_tick(w, &tick) || tick > now) {
+	    w->base = now + 1;
+	    break;
+	}
+	w->base = tick;
+
+	for (level = 1; level < SEL_WHEEL_LEVELS; level++) {
+	    if (w->base & ((((uint64_t) 1) << (SEL_WHEEL_BITS * level)) - 1))
+		break;
+	}
+	/* Cascade from the top down so timers can fall more than one level. */
+	while (--level > 0)
+	    wheel_cascade(w, level);
+
+	slot = w->base & SEL_WHEEL_MASK;
+	list = &w->slots[0][slot];
+	if (list->first) {
+	    sel_timer_t *timer = list->first;
+
+	    while (timer) {
+		timer->val.wheel_slot = SEL_WHEEL_EXPIRED;
+		timer = timer->val.wheel_next;
+	    }
+	    if (w->expired.last) {
+		w->expired.last->val.wheel_next = list->first;
+		list->first->val.wheel_prev = w->expired.last;
+	    } else {
+		w->expired.first = list->first;
+	    }
+	    w->expired.last = list->last;
+	    list->first = NULL;
+	    list->last = NULL;
+	    w->used[0] &= ~(((uint64_t) 1) << slot);
+	}
+	w->base++;
+    }
+}
+
 /* Used to build a list of threads that may need to be woken if a
    timer on the top of the heap changes, or an FD is added/removed.
    See i_wake_sel_thread() for more info. */
@@ -190,8 +479,14 @@ typedef struct sel_wait_list_s
 
 struct selector_s
 {
-    /* This is an hash table of file descriptors. */
-    fd_control_t *fds[FD_SETSIZE];
+    /*
+     * File descriptors, indexed by the fd.  This is grown as larger
+     * fds are added, see grow_fds().  Entries are never freed until
+     * the selector is freed, so an fd_control_t pointer stays good
+     * even if the table is reallocated.
+     */
+    fd_control_t **fds;
+    unsigned int fds_size;
 
     /* If something is deleted, we increment this count.  This way when
        a select/epoll returns a non-timeout, we know that we need to ignore
@@ -203,19 +498,60 @@ struct selector_s
     /* The timer heap. */
     theap_t timer_heap;
 
+    /* If set, timers are kept in this instead of the heap. */
+    struct sel_wheel_s *timer_wheel;
+
     /* This is a list of items waiting to be woken up because they are
        sitting in a select.  See i_wake_sel_thread() for more info. */
     sel_wait_list_t wait_list;
 
     void *timer_lock;
 
-    sel_runner_t *runner_head;
-    sel_runner_t *runner_tail;
+    /*
+     * Runners waiting to be run.  This is a lock-free stack, sel_run()
+     * pushes onto it and process_runners() takes the whole thing at
+     * once and reverses it to run them in order.
+     */
+    sel_runner_t *runner_list;
+
+    /* See sel_set_stats_enabled(). */
+    int stats_enabled;
+    struct sel_stats stats;
 
     int wake_sig;
 
 #ifdef HAVE_EPOLL_PWAIT
     int epollfd;
+
+    /* Maximum number of events to fetch from epoll in one call. */
+    unsigned int epoll_batch;
+
+    /* Register fds with EPOLLET instead of EPOLLONESHOT. */
+    int edge_triggered;
+
+    /*
+     * The fd whose handlers this thread is running in edge-triggered
+     * mode, see process_events_et().
+     */
+#ifdef USE_PTHREADS
+    pthread_key_t et_running_key;
+    int et_running_key_set;
+#else
+    struct et_running_s *et_running;
+#endif
+
+    /*
+     * If set, the shared eventfd in the epoll set for waking threads,
+     * see sel_use_wakeup_fds().  wakeups is the list of per-thread
+     * wakeups, protected by the timer lock.
+     */
+    sel_wakeup_t *wakeup;
+    sel_wakeup_t *wakeups;
+#endif
+
+#ifdef SEL_HAVE_URING
+    /* If set, use io_uring polls instead of epoll. */
+    struct sel_uring_s *uring;
 #endif
     sel_lock_t *(*sel_lock_alloc)(void *cb_data);
     void (*sel_lock_free)(sel_lock_t *);
@@ -350,9 +686,19 @@ static void
 wake_timer_sel_thread(struct selector_s *sel, volatile sel_timer_t *old_top,
 		      struct timeval *new_timeout)
 {
-    if (old_top != theap_get_top(&sel->timer_heap))
+    if (sel->timer_wheel) {
+	struct timeval tv;
+
+	/*
+	 * There is no top with the wheel.  Threads only get woken
+	 * if they are waiting past the tick the timer expires on.
+	 */
+	wheel_tick_to_timeval(wheel_timeval_to_tick(new_timeout, 1), &tv);
+	i_wake_sel_thread(sel, &tv);
+    } else if (old_top != theap_get_top(&sel->timer_heap)) {
 	/* If the top value changed, restart the waiting threads if required. */
 	i_wake_sel_thread(sel, new_timeout);
+    }
 }
 
 /* Wait list management.  These *must* be called with the timer list
@@ -398,6 +744,321 @@ init_fd(fd_control_t *fd)
     fd->except_enabled = 0;
 }
 
+#ifdef SEL_HAVE_URING
+/*
+ * io_uring poll handling.  Instead of epoll, each fd that has
+ * something enabled has a one-shot IORING_OP_POLL_ADD outstanding on
+ * the ring, which works much like EPOLLONESHOT.  The advantage is
+ * that arming a poll is just an entry on the submission queue, so all
+ * the rearms after a batch of events can be submitted with one system
+ * call, and the wait is a single io_uring_enter() call.  This is only
+ * a replacement for epoll, the handlers still do their reads, writes
+ * and accepts with normal system calls.
+ *
+ * The ring is protected by the fd lock.  Threads wait on the ring
+ * without the lock, and completions are copied out under the lock,
+ * so only one thread will handle a completion.
+ *
+ * If submitting fails, the sqes stay on the submission queue.  If the
+ * queue is full and an sqe can't be added, the fd is marked with
+ * uring_retry and its update is done again later.  Both are retried
+ * before a thread waits on the ring, see uring_retry().
+ */
+#define SEL_URING_SQ_ENTRIES 1024
+#define SEL_URING_CQ_ENTRIES 16384
+#define SEL_URING_RETRY_NSEC 10000000
+
+struct sel_uring_s
+{
+    int fd;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int sq_entries;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Number of sqes queued that have not been submitted yet. */
+    unsigned int to_submit;
+
+    /* Don't submit when an sqe is added, the caller will do it. */
+    int defer_submit;
+
+    /* Number of fds with uring_retry set. */
+    unsigned int retries;
+};
+
+static int
+uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+	    unsigned int flags, void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		   arg, argsz);
+}
+
+static void
+uring_free(struct sel_uring_s *u)
+{
+    if (u->sqes)
+	munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring && u->cq_ring != u->sq_ring)
+	munmap(u->cq_ring, u->cq_ring_size);
+    if (u->sq_ring)
+	munmap(u->sq_ring, u->sq_ring_size);
+    if (u->fd >= 0)
+	close(u->fd);
+    free(u);
+}
+
+static int
+uring_alloc(struct sel_uring_s **ru)
+{
+    struct sel_uring_s *u;
+    struct io_uring_params p;
+    int rv;
+
+    u = sel_alloc(sizeof(*u));
+    if (!u)
+	return ENOMEM;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = SEL_URING_CQ_ENTRIES;
+    u->fd = syscall(__NR_io_uring_setup, SEL_URING_SQ_ENTRIES, &p);
+    if (u->fd < 0) {
+	rv = errno;
+	goto out_err;
+    }
+
+    /*
+     * We need the wait timeout and sigmask in io_uring_enter() (the
+     * equivalent of epoll_pwait()), and we can't lose completions.
+     */
+    if (!(p.features & IORING_FEAT_EXT_ARG) ||
+		!(p.features & IORING_FEAT_NODROP)) {
+	rv = ENOSYS;
+	goto out_err;
+    }
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (u->cq_ring_size > u->sq_ring_size)
+	    u->sq_ring_size = u->cq_ring_size;
+	u->cq_ring_size = u->sq_ring_size;
+    }
+
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+	u->sq_ring = NULL;
+	rv = errno;
+	goto out_err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	u->cq_ring = u->sq_ring;
+    } else {
+	u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+	if (u->cq_ring == MAP_FAILED) {
+	    u->cq_ring = NULL;
+	    rv = errno;
+	    goto out_err;
+	}
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+	u->sqes = NULL;
+	rv = errno;
+	goto out_err;
+    }
+
+    u->sq_head = (unsigned int *) ((char *) u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned int *) ((char *) u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned int *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *) ((char *) u->sq_ring + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned int *) ((char *) u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned int *) ((char *) u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned int *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) ((char *) u->cq_ring + p.cq_off.cqes);
+
+    *ru = u;
+    return 0;
+
+ out_err:
+    uring_free(u);
+    return rv;
+}
+
+/*
+ * Submit all queued sqes.  Must be called with the fd lock held.
+ * Returns an errno on failure, the unsubmitted sqes stay queued.
+ */
+static int
+uring_submit(struct sel_uring_s *u)
+{
+    int rv;
+
+    while (u->to_submit) {
+	rv = uring_enter(u->fd, u->to_submit, 0, 0, NULL, 0);
+	if (rv < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return errno;
+	}
+	if (rv == 0)
+	    return EAGAIN;
+	u->to_submit -= rv;
+    }
+    return 0;
+}
+
+/*
+ * Must be called with the fd lock held.  Returns NULL if the
+ * submission queue is full and can't be submitted.
+ */
+static struct io_uring_sqe *
+uring_get_sqe(struct sel_uring_s *u)
+{
+    unsigned int head, tail = *u->sq_tail, idx;
+    struct io_uring_sqe *sqe;
+
+    head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= u->sq_entries) {
+	uring_submit(u);
+	head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= u->sq_entries)
+	    return NULL;
+    }
+    idx = tail & *u->sq_mask;
+    sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void
+uring_put_sqe(struct sel_uring_s *u)
+{
+    __atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+}
+
+static uint64_t
+uring_user_data(fd_control_t *fdc)
+{
+    /* Zero is used for poll removes, so the token is never zero. */
+    return ((uint64_t) fdc->uring_token << 32) | (uint32_t) fdc->fd;
+}
+
+static int
+uring_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
+{
+    struct sel_uring_s *u = sel->uring;
+    struct io_uring_sqe *sqe;
+    uint32_t events = 0;
+
+    if (op != EPOLL_CTL_DEL) {
+	/* See handle_epoll_event() on saved_events. */
+	if (fdc->saved_events) {
+	    if (fdc->read_enabled || fdc->except_enabled)
+		fdc->saved_events = 0;
+	} else if (fdc->write_enabled) {
+	    events |= POLLOUT;
+	}
+	if (!fdc->saved_events) {
+	    if (fdc->read_enabled)
+		events |= POLLIN;
+	    if (fdc->except_enabled)
+		events |= POLLPRI;
+	}
+    }
+
+    if (fdc->uring_armed && fdc->uring_events == events)
+	return 0;
+
+    if (fdc->uring_armed) {
+	sqe = uring_get_sqe(u);
+	if (!sqe)
+	    goto out_retry;
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = uring_user_data(fdc);
+	uring_put_sqe(u);
+	fdc->uring_armed = 0;
+    }
+
+    if (events) {
+	fdc->uring_token++;
+	if (fdc->uring_token == 0)
+	    fdc->uring_token++;
+	sqe = uring_get_sqe(u);
+	if (!sqe)
+	    goto out_retry;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fdc->fd;
+	sqe->poll32_events = events;
+	sqe->user_data = uring_user_data(fdc);
+	uring_put_sqe(u);
+	fdc->uring_armed = 1;
+	fdc->uring_events = events;
+    }
+
+    if (!u->defer_submit && uring_submit(u))
+	/* Wake the waiters so they retry it. */
+	return 1;
+
+    return 0;
+
+ out_retry:
+    if (!fdc->uring_retry) {
+	fdc->uring_retry = 1;
+	u->retries++;
+    }
+    return 1;
+}
+
+/*
+ * Redo the fd updates that couldn't get an sqe and submit whatever is
+ * queued.  Must be called with the fd lock held.  Returns true if
+ * something is still waiting.
+ */
+static bool
+uring_retry(struct selector_s *sel)
+{
+    struct sel_uring_s *u = sel->uring;
+    unsigned int i;
+    fd_control_t *fdc;
+
+    u->defer_submit = 1;
+    for (i = 0; u->retries && i < sel->fds_size; i++) {
+	fdc = sel->fds[i];
+	if (!fdc || !fdc->uring_retry)
+	    continue;
+	fdc->uring_retry = 0;
+	u->retries--;
+	uring_update_fd(sel, fdc, fdc->state ? EPOLL_CTL_MOD : EPOLL_CTL_DEL);
+    }
+    u->defer_submit = 0;
+    uring_submit(u);
+    return u->retries || u->to_submit;
+}
+#endif
+
 #ifdef HAVE_EPOLL_PWAIT
 static int
 sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
@@ -405,13 +1066,32 @@ sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
     struct epoll_event event;
     int rv;
 
+#ifdef SEL_HAVE_URING
+    if (sel->uring)
+	return uring_update_fd(sel, fdc, op);
+#endif
     if (sel->epollfd < 0)
 	return 1;
 
     memset(&event, 0, sizeof(event));
-    event.events = EPOLLONESHOT;
     event.data.fd = fdc->fd;
-    if (fdc->saved_events) {
+    if (sel->edge_triggered) {
+	/*
+	 * In edge-triggered mode the fd is not disarmed when an event
+	 * comes in, so this only needs to be done when the enables
+	 * change.
+	 */
+	event.events = EPOLLET;
+	if (op != EPOLL_CTL_DEL) {
+	    if (fdc->read_enabled)
+		event.events |= EPOLLIN | EPOLLHUP;
+	    if (fdc->write_enabled)
+		event.events |= EPOLLOUT;
+	    if (fdc->except_enabled)
+		event.events |= EPOLLERR | EPOLLPRI;
+	}
+    } else if (fdc->saved_events) {
+	event.events = EPOLLONESHOT;
 	if (op == EPOLL_CTL_DEL)
 	    return 0;
 	if (!fdc->read_enabled && !fdc->except_enabled)
@@ -422,13 +1102,16 @@ sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
 	    event.events |= EPOLLIN | EPOLLHUP;
 	if (fdc->except_enabled)
 	    event.events |= EPOLLERR | EPOLLPRI;
-    } else if (op != EPOLL_CTL_DEL) {
-	if (fdc->read_enabled)
-	    event.events |= EPOLLIN | EPOLLHUP;
-	if (fdc->write_enabled)
-	    event.events |= EPOLLOUT;
-	if (fdc->except_enabled)
-	    event.events |= EPOLLERR | EPOLLPRI;
+    } else {
+	event.events = EPOLLONESHOT;
+	if (op != EPOLL_CTL_DEL) {
+	    if (fdc->read_enabled)
+		event.events |= EPOLLIN | EPOLLHUP;
+	    if (fdc->write_enabled)
+		event.events |= EPOLLOUT;
+	    if (fdc->except_enabled)
+		event.events |= EPOLLERR | EPOLLPRI;
+	}
     }
     /* This should only fail due to system problems, and if that's the case,
        well, we should probably terminate. */
@@ -461,11 +1144,47 @@ finish_oldstate(sel_runner_t *runner, void *cbdata)
 static fd_control_t *
 get_fd(struct selector_s *sel, int fd)
 {
-    fd_control_t *fdc = sel->fds[fd % FD_SETSIZE];
+    if ((unsigned int) fd >= sel->fds_size)
+	return NULL;
+    return sel->fds[fd];
+}
 
-    while (fdc && fdc->fd != fd)
-	fdc = fdc->next;
-    return fdc;
+#define SEL_FDS_MIN_SIZE 64
+
+/*
+ * Make sure the fd table can hold the given fd.  The table is doubled
+ * until it fits, but not past the process' file limit unless the fd
+ * is above that (the limit can be raised while running).  Must be
+ * called with sel fd lock held.
+ */
+static int
+grow_fds(struct selector_s *sel, int fd)
+{
+    fd_control_t **new_fds;
+    unsigned int new_size = sel->fds_size;
+    struct rlimit lim;
+
+    if ((unsigned int) fd < sel->fds_size)
+	return 0;
+
+    if (new_size < SEL_FDS_MIN_SIZE)
+	new_size = SEL_FDS_MIN_SIZE;
+    while (new_size <= (unsigned int) fd)
+	new_size *= 2;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY &&
+		lim.rlim_cur < new_size && lim.rlim_cur > (rlim_t) fd)
+	new_size = lim.rlim_cur;
+
+    new_fds = sel_alloc(new_size * sizeof(*new_fds));
+    if (!new_fds)
+	return ENOMEM;
+    if (sel->fds) {
+	memcpy(new_fds, sel->fds, sel->fds_size * sizeof(*new_fds));
+	free(sel->fds);
+    }
+    sel->fds = new_fds;
+    sel->fds_size = new_size;
+    return 0;
 }
 
 static void
@@ -510,6 +1229,11 @@ sel_set_fd_handlers(struct selector_s *sel,
     sel_fd_lock(sel);
     fdc = get_fd(sel, fd);
     if (!fdc) {
+	if (grow_fds(sel, fd)) {
+	    sel_fd_unlock(sel);
+	    free(state);
+	    return ENOMEM;
+	}
 	fdc = sel_alloc(sizeof(*fdc));
 	if (!fdc) {
 	    sel_fd_unlock(sel);
@@ -517,9 +1241,7 @@ sel_set_fd_handlers(struct selector_s *sel,
 	    return ENOMEM;
 	}
 	fdc->fd = fd;
-	/* Add it to the list. */
-	fdc->next = sel->fds[fd % FD_SETSIZE];
-	sel->fds[fd % FD_SETSIZE] = fdc;
+	sel->fds[fd] = fdc;
     }
 
     if (fdc->state) {
@@ -528,6 +1250,7 @@ sel_set_fd_handlers(struct selector_s *sel,
 	added = 0;
 #ifdef HAVE_EPOLL_PWAIT
 	fdc->saved_events = 0;
+	fdc->del_gen++;
 #endif
 	sel->fd_del_count++;
     }
@@ -536,6 +1259,9 @@ sel_set_fd_handlers(struct selector_s *sel,
     fdc->handle_read = read_handler;
     fdc->handle_write = write_handler;
     fdc->handle_except = except_handler;
+#ifdef HAVE_EPOLL_PWAIT
+    fdc->errqueue = 0;
+#endif
 
     if (added) {
 	/* Move maxfd up if necessary. */
@@ -579,6 +1305,8 @@ i_sel_clear_fd_handler(struct selector_s *sel, int fd, int rpt)
 	sel_update_fd(sel, fdc, EPOLL_CTL_DEL);
 #ifdef HAVE_EPOLL_PWAIT
 	fdc->saved_events = 0;
+	fdc->errqueue = 0;
+	fdc->del_gen++;
 #endif
 	sel->fd_del_count++;
     }
@@ -778,15 +1506,115 @@ add_timeval(struct timeval *dest,
     }
 }
 
-int
-sel_alloc_timer(struct selector_s     *sel,
-		sel_timeout_handler_t handler,
-		void                  *user_data,
-		sel_timer_t           **new_timer)
+/*
+ * Add and remove timers from the heap or the timer wheel, whichever
+ * is in use.  These must be called with the timer lock held.
+ */
+static void
+sel_timer_queue_add(struct selector_s *sel, sel_timer_t *timer)
 {
-    sel_timer_t *timer;
+    if (sel->timer_wheel)
+	wheel_add(sel->timer_wheel, timer);
+    else
+	theap_add(&sel->timer_heap, timer);
+    timer->val.in_heap = 1;
+}
 
-    timer = sel_alloc(sizeof(*timer));
+static void
+sel_timer_queue_remove(struct selector_s *sel, sel_timer_t *timer)
+{
+    if (sel->timer_wheel)
+	wheel_remove(sel->timer_wheel, timer);
+    else
+	theap_remove(&sel->timer_heap, timer);
+    timer->val.in_heap = 0;
+}
+
+/* Return the first timer that is due at time now, or NULL if none. */
+static sel_timer_t *
+sel_timer_queue_get_due(struct selector_s *sel, struct timeval *now)
+{
+    sel_timer_t *timer;
+
+    if (sel->timer_wheel) {
+	wheel_advance(sel->timer_wheel, wheel_timeval_to_tick(now, 0));
+	return sel->timer_wheel->expired.first;
+    }
+
+    timer = theap_get_top(&sel->timer_heap);
+    if (timer && cmp_timeval(now, &timer->val.timeout) >= 0)
+	return timer;
+    return NULL;
+}
+
+/*
+ * Get the time the next timer needs to be handled.  For the wheel
+ * this may be earlier than the timer, if it needs to be cascaded.
+ * Returns false if there are no timers.
+ */
+static bool
+sel_timer_queue_next(struct selector_s *sel, struct timeval *next)
+{
+    sel_timer_t *timer;
+
+    if (sel->timer_wheel) {
+	uint64_t tick;
+
+	if (sel->timer_wheel->expired.first) {
+	    *next = sel->timer_wheel->expired.first->val.timeout;
+	    return true;
+	}
+	if (!wheel_next_tick(sel->timer_wheel, &tick))
+	    return false;
+	wheel_tick_to_timeval(tick, next);
+	return true;
+    }
+
+    timer = theap_get_top(&sel->timer_heap);
+    if (!timer)
+	return false;
+    *next = timer->val.timeout;
+    return true;
+}
+
+int
+sel_use_timer_wheel(struct selector_s *sel)
+{
+    struct sel_wheel_s *w;
+    struct timeval now;
+    int rv = 0;
+
+    w = sel_alloc(sizeof(*w));
+    if (!w)
+	return ENOMEM;
+    sel_get_monotonic_time(&now);
+    w->base = wheel_timeval_to_tick(&now, 0);
+
+    sel_timer_lock(sel);
+    if (sel->timer_wheel)
+	goto out_unlock; /* Already using it, nothing to do. */
+    rv = EBUSY;
+    if (theap_get_top(&sel->timer_heap))
+	goto out_unlock;
+    rv = 0;
+    sel->timer_wheel = w;
+    w = NULL;
+ out_unlock:
+    sel_timer_unlock(sel);
+    if (w)
+	free(w);
+    return rv;
+}
+
+int
+sel_alloc_timer(struct selector_s     *sel,
+		sel_timeout_handler_t handler,
+		void                  *user_data,
+		sel_timer_t           **new_timer)
+{
+    sel_timer_t *timer;
+
+    timer = sel_alloc(sizeof(*timer));
     if (!timer)
 	return ENOMEM;
     memset(timer, 0, sizeof(*timer));
@@ -814,10 +1642,8 @@ sel_stop_timer_i(struct selector_s *sel, sel_timer_t *timer)
      * is used to signal a timer restart on return from a timer
      * handler.)  So make sure it's not in the heap.
      */
-    if (timer->val.in_heap) {
-	theap_remove(&sel->timer_heap, timer);
-	timer->val.in_heap = 0;
-    }
+    if (timer->val.in_heap)
+	sel_timer_queue_remove(sel, timer);
     timer->val.stopped = 1;
 
     return rv;
@@ -842,9 +1668,52 @@ sel_free_timer(sel_timer_t *timer)
     return 0;
 }
 
+static uint64_t
+timeval_to_usec(const struct timeval *tv)
+{
+    return ((uint64_t) tv->tv_sec) * 1000000 + tv->tv_usec;
+}
+
+/*
+ * Pick when a timer with slack actually goes off, somewhere between
+ * timeout and timeout + slack.  If the selector is already going to
+ * wake up in that window, use that time.  Otherwise use the time in
+ * the window that is a multiple of the largest power of two
+ * microseconds, so timers with overlapping windows tend to land on
+ * the same time and get handled in one wakeup.  Must be called with
+ * the timer lock held.
+ */
+static void
+sel_timer_coalesce(struct selector_s *sel, struct timeval *timeout,
+		   struct timeval *slack, struct timeval *expiry)
+{
+    struct timeval next;
+    uint64_t start, end, t, gran;
+
+    start = timeval_to_usec(timeout);
+    end = start + timeval_to_usec(slack);
+
+    if (sel_timer_queue_next(sel, &next)) {
+	t = timeval_to_usec(&next);
+	if (t >= start && t <= end) {
+	    *expiry = next;
+	    return;
+	}
+    }
+
+    /* The largest power of two that is guaranteed to be in the window. */
+    gran = ((uint64_t) 1) << (63 - __builtin_clzll(end - start + 1));
+    if ((end / (gran * 2)) * (gran * 2) >= start)
+	gran *= 2;
+    t = (end / gran) * gran;
+    expiry->tv_sec = t / 1000000;
+    expiry->tv_usec = t % 1000000;
+}
+
 int
-sel_start_timer(sel_timer_t    *timer,
-		struct timeval *timeout)
+sel_start_timer_slack(sel_timer_t    *timer,
+		      struct timeval *timeout,
+		      struct timeval *slack)
 {
     struct selector_s *sel = timer->val.sel;
     volatile sel_timer_t *old_top;
@@ -857,22 +1726,30 @@ sel_start_timer(sel_timer_t    *timer,
 
     old_top = theap_get_top(&sel->timer_heap);
 
-    timer->val.timeout = *timeout;
+    if (slack && (slack->tv_sec || slack->tv_usec))
+	sel_timer_coalesce(sel, timeout, slack, &timer->val.timeout);
+    else
+	timer->val.timeout = *timeout;
 
-    if (!timer->val.in_handler) {
+    if (!timer->val.in_handler)
 	/* Wait until the handler returns to start the timer. */
-	theap_add(&sel->timer_heap, timer);
-	timer->val.in_heap = 1;
-    }
+	sel_timer_queue_add(sel, timer);
     timer->val.stopped = 0;
 
-    wake_timer_sel_thread(sel, old_top, timeout);
+    wake_timer_sel_thread(sel, old_top, &timer->val.timeout);
 
     sel_timer_unlock(sel);
 
     return 0;
 }
 
+int
+sel_start_timer(sel_timer_t    *timer,
+		struct timeval *timeout)
+{
+    return sel_start_timer_slack(timer, timeout, NULL);
+}
+
 int
 sel_stop_timer(sel_timer_t *timer)
 {
@@ -913,13 +1790,10 @@ sel_stop_timer_with_done(sel_timer_t *timer,
      * heap with an immediate timeout so it will be processed now.
      */
     timer->val.in_handler = 1;
-    if (timer->val.in_heap) {
-	theap_remove(&sel->timer_heap, timer);
-	timer->val.in_heap = 0;
-    }
+    if (timer->val.in_heap)
+	sel_timer_queue_remove(sel, timer);
     sel_get_monotonic_time(&timer->val.timeout);
-    theap_add(&sel->timer_heap, timer);
-    timer->val.in_heap = 1;
+    sel_timer_queue_add(sel, timer);
 
  out_unlock:
     sel_timer_unlock(sel);
@@ -936,6 +1810,76 @@ sel_get_monotonic_time(struct timeval *tv)
     tv->tv_usec = (ts.tv_nsec + 500) / 1000;
 }
 
+/*
+ * Statistics.  These are updated from multiple threads with atomics
+ * and no lock, the values are independent so they can be slightly
+ * off from each other.
+ */
+static inline bool
+sel_stats_on(struct selector_s *sel)
+{
+    return __atomic_load_n(&sel->stats_enabled, __ATOMIC_RELAXED);
+}
+
+static uint64_t
+sel_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+sel_stats_add(struct sel_stats_hist *h, uint64_t val)
+{
+    unsigned int bucket = 0;
+    uint64_t max;
+
+    if (val)
+	bucket = 64 - __builtin_clzll(val);
+    if (bucket >= SEL_STATS_HIST_BUCKETS)
+	bucket = SEL_STATS_HIST_BUCKETS - 1;
+
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total, val, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (val > max) {
+	if (__atomic_compare_exchange_n(&h->max, &max, val, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    break;
+    }
+}
+
+/* Add the time since start to the histogram, return the current time. */
+static uint64_t
+sel_stats_add_time(struct sel_stats_hist *h, uint64_t start)
+{
+    uint64_t now = sel_stats_now();
+
+    sel_stats_add(h, now - start);
+    return now;
+}
+
+void
+sel_set_stats_enabled(struct selector_s *sel, int enable)
+{
+    if (enable && !sel_stats_on(sel))
+	memset(&sel->stats, 0, sizeof(sel->stats));
+    __atomic_store_n(&sel->stats_enabled, !!enable, __ATOMIC_RELAXED);
+}
+
+void
+sel_get_stats(struct selector_s *sel, struct sel_stats *stats)
+{
+    uint64_t *src = (uint64_t *) &sel->stats, *dst = (uint64_t *) stats;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(*stats) / sizeof(uint64_t); i++)
+	dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
 /*
  * Process timers on selector.  The timeout is always set, to a very
  * long value if no timers are waiting.  Note that this *must* be
@@ -948,14 +1892,13 @@ process_timers(struct selector_s       *sel,
 	       volatile struct timeval *timeout,
 	       struct timeval          *abstime)
 {
-    struct timeval now;
+    struct timeval now, next;
     sel_timer_t    *timer;
 
-    timer = theap_get_top(&sel->timer_heap);
     sel_get_monotonic_time(&now);
-    while (timer && cmp_timeval(&now, &timer->val.timeout) >= 0) {
-	theap_remove(&(sel->timer_heap), timer);
-	timer->val.in_heap = 0;
+    timer = sel_timer_queue_get_due(sel, &now);
+    while (timer) {
+	sel_timer_queue_remove(sel, timer);
 	timer->val.stopped = 1;
 
 	/*
@@ -966,7 +1909,17 @@ process_timers(struct selector_s       *sel,
 	if (!timer->val.in_handler) {
 	    timer->val.in_handler = 1;
 	    sel_timer_unlock(sel);
-	    timer->val.handler(sel, timer, timer->val.user_data);
+	    if (sel_stats_on(sel)) {
+		uint64_t start = sel_stats_now();
+		uint64_t due = timeval_to_usec(&timer->val.timeout);
+
+		sel_stats_add(&sel->stats.timer_lateness,
+			      start > due ? start - due : 0);
+		timer->val.handler(sel, timer, timer->val.user_data);
+		sel_stats_add_time(&sel->stats.timer_handler_time, start);
+	    } else {
+		timer->val.handler(sel, timer, timer->val.user_data);
+	    }
 	    sel_timer_lock(sel);
 	}
 	(*count)++;
@@ -983,13 +1936,11 @@ process_timers(struct selector_s       *sel,
 	timer->val.in_handler = 0;
 	if (timer->val.freed)
 	    free(timer);
-	else if (!timer->val.stopped) {
+	else if (!timer->val.stopped)
 	    /* We were restarted while in the handler. */
-	    theap_add(&sel->timer_heap, timer);
-	    timer->val.in_heap = 1;
-	}
+	    sel_timer_queue_add(sel, timer);
 
-	timer = theap_get_top(&sel->timer_heap);
+	timer = sel_timer_queue_get_due(sel, &now);
     }
 
     if (*count) {
@@ -997,11 +1948,9 @@ process_timers(struct selector_s       *sel,
 	timeout->tv_sec = 0;
 	timeout->tv_usec = 0;
 	*abstime = now;
-    } else if (timer) {
-	diff_timeval((struct timeval *) timeout,
-		     (struct timeval *) &timer->val.timeout,
-		     &now);
-	*abstime = timer->val.timeout;
+    } else if (sel_timer_queue_next(sel, &next)) {
+	diff_timeval((struct timeval *) timeout, &next, &now);
+	*abstime = next;
     } else {
 	/* No timers, just set a long time. */
 	timeout->tv_sec = 100000;
@@ -1028,14 +1977,8 @@ sel_alloc_runner(struct selector_s *sel, sel_runner_t **new_runner)
 int
 sel_free_runner(sel_runner_t *runner)
 {
-    struct selector_s *sel = runner->sel;
-
-    sel_timer_lock(sel);
-    if (runner->in_use) {
-	sel_timer_unlock(sel);
+    if (__atomic_load_n(&runner->in_use, __ATOMIC_ACQUIRE))
 	return EBUSY;
-    }
-    sel_timer_unlock(sel);
     free(runner);
     return 0;
 }
@@ -1044,57 +1987,115 @@ int
 sel_run(sel_runner_t *runner, sel_runner_func_t func, void *cb_data)
 {
     struct selector_s *sel = runner->sel;
+    sel_runner_t *head;
+    int in_use = 0;
 
-    sel_timer_lock(sel);
-    if (runner->in_use) {
-	sel_timer_unlock(sel);
+    if (!__atomic_compare_exchange_n(&runner->in_use, &in_use, 1, false,
+				     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
 	return EBUSY;
-    }
 
     runner->func = func;
     runner->cb_data = cb_data;
-    runner->next = NULL;
-    runner->in_use = 1;
 
-    if (sel->runner_tail) {
-	sel->runner_tail->next = runner;
-	sel->runner_tail = runner;
-    } else {
-	sel->runner_head = runner;
-	sel->runner_tail = runner;
+    head = __atomic_load_n(&sel->runner_list, __ATOMIC_RELAXED);
+    do {
+	runner->next = head;
+    } while (!__atomic_compare_exchange_n(&sel->runner_list, &head, runner,
+					  true, __ATOMIC_RELEASE,
+					  __ATOMIC_RELAXED));
+
+    /*
+     * Make sure someone is awake to run the runner.  If the list
+     * wasn't empty, whoever added the first one has already done
+     * that and the runners will all be taken together.
+     */
+    if (!head) {
+	sel_timer_lock(sel);
+	i_sel_wake_first(sel);
+	sel_timer_unlock(sel);
     }
-    /* Make sure someone is awake to run the runner. */
-    i_sel_wake_first(sel);
-    sel_timer_unlock(sel);
     return 0;
 }
 
+static bool
+sel_runners_pending(struct selector_s *sel)
+{
+    return __atomic_load_n(&sel->runner_list, __ATOMIC_RELAXED) != NULL;
+}
+
+/*
+ * Run all the pending runners.  This must be called with the timer
+ * lock held, it is released while the runners run.
+ */
 static unsigned int
 process_runners(struct selector_s *sel)
 {
-    sel_runner_t *runner = sel->runner_head, *next_runner;
-    int count = 0;
+    sel_runner_t *runner, *next_runner, *list = NULL;
+    int count = 0, depth = 0;
+    bool stats = sel_stats_on(sel);
+    uint64_t start = 0;
+
+    if (!sel_runners_pending(sel))
+	return 0;
+
+    runner = __atomic_exchange_n(&sel->runner_list, NULL, __ATOMIC_ACQUIRE);
 
-    sel->runner_head = NULL;
-    sel->runner_tail = NULL;
+    /* It's a stack, reverse it so they run in the order they were added. */
+    while (runner) {
+	next_runner = runner->next;
+	runner->next = list;
+	list = runner;
+	runner = next_runner;
+	depth++;
+    }
+
+    sel_timer_unlock(sel);
+    if (stats) {
+	sel_stats_add(&sel->stats.runner_queue_depth, depth);
+	start = sel_stats_now();
+    }
+    runner = list;
     while (runner) {
 	sel_runner_func_t func;
 	void *cb_data;
 
 	next_runner = runner->next;
-	runner->in_use = 0;
 	func = runner->func;
 	cb_data = runner->cb_data;
-	sel_timer_unlock(sel);
+	/* Once this is cleared the runner can be added again. */
+	__atomic_store_n(&runner->in_use, 0, __ATOMIC_RELEASE);
 	func(runner, cb_data);
+	if (stats)
+	    start = sel_stats_add_time(&sel->stats.runner_time, start);
 	count++;
-	sel_timer_lock(sel);
 	runner = next_runner;
     }
+    sel_timer_lock(sel);
 
     return count;
 }
 
+/*
+ * Release a use of the fd state.  If it was deleted while in use,
+ * finish the delete.  Must be called with the fd lock held.
+ */
+static void
+put_fd_state(struct selector_s *sel, fd_control_t *fdc, fd_state_t *state,
+	     void *data)
+{
+    state->use_count--;
+    if (state->deleted && state->use_count == 0) {
+	if (fdc->state == state)
+	    fdc->state = NULL;
+	if (state->done) {
+	    sel_fd_unlock(sel);
+	    state->done(fdc->fd, data);
+	    sel_fd_lock(sel);
+	}
+	free(state);
+    }
+}
+
 static void
 handle_selector_call(struct selector_s *sel, fd_control_t *fdc,
 		     volatile fd_set *fdset, int enabled,
@@ -1125,18 +2126,16 @@ handle_selector_call(struct selector_s *sel, fd_control_t *fdc,
 	return;
     state->use_count++;
     sel_fd_unlock(sel);
-    handler(fdc->fd, data);
-    sel_fd_lock(sel);
-    state->use_count--;
-    if (state->deleted && state->use_count == 0) {
-	fdc->state = NULL;
-	if (state->done) {
-	    sel_fd_unlock(sel);
-	    state->done(fdc->fd, data);
-	    sel_fd_lock(sel);
-	}
-	free(state);
+    if (sel_stats_on(sel)) {
+	uint64_t start = sel_stats_now();
+
+	handler(fdc->fd, data);
+	sel_stats_add_time(&sel->stats.fd_handler_time, start);
+    } else {
+	handler(fdc->fd, data);
     }
+    sel_fd_lock(sel);
+    put_fd_state(sel, fdc, state, data);
 }
 
 static void
@@ -1161,7 +2160,8 @@ setup_my_sigmask(sigset_t *sigmask, sigset_t *isigmask)
 static int
 process_fds(struct selector_s *sel,
 	    sel_wait_list_t *item,
-	    sigset_t *isigmask)
+	    sigset_t *isigmask,
+	    uint64_t *woke)
 {
     fd_set      tmp_read_set;
     fd_set      tmp_write_set;
@@ -1188,6 +2188,8 @@ process_fds(struct selector_s *sel,
 		  &tmp_write_set,
 		  &tmp_except_set,
 		  (struct timespec *) &item->wait_time, &sigmask);
+    if (woke)
+	*woke = sel_stats_now();
     if (err < 0) {
 	if (errno == EBADF || errno == EBADFD)
 	    /* We raced, just retry it. */
@@ -1225,40 +2227,17 @@ process_fds(struct selector_s *sel,
 }
 
 #ifdef HAVE_EPOLL_PWAIT
-static int
-process_fds_epoll(struct selector_s *sel, struct timespec *tstimeout,
-		  sigset_t *isigmask)
+static void
+handle_epoll_event(struct selector_s *sel, fd_control_t *fdc,
+		   uint32_t events)
 {
-    int rv;
-    struct epoll_event event;
-    int timeout;
-    sigset_t sigmask;
-    fd_control_t *fdc;
-    unsigned long entry_fd_del_count = sel->fd_del_count;
-
-    setup_my_sigmask(&sigmask, isigmask);
-
-    if (tstimeout->tv_sec > 600)
-	 /* Don't wait over 10 minutes, to work around an old epoll bug
-	    and avoid issues with timeout overflowing on 64-bit systems,
-	    which is much larger that 10 minutes, but who cares. */
-	timeout = 600 * 1000;
-    else
-	timeout = ((tstimeout->tv_sec * 1000) +
-		   (tstimeout->tv_nsec + 999999) / 1000000);
-
-    sigdelset(&sigmask, sel->wake_sig);
-    rv = epoll_pwait(sel->epollfd, &event, 1, timeout, &sigmask);
-    if (rv <= 0)
-	return rv;
-
-    sel_fd_lock(sel);
-    valid_fd(sel, event.data.fd, &fdc);
-    if (entry_fd_del_count != sel->fd_del_count)
-	/* Something was deleted from the FD set, don't process this as it
-	   may be from the old fd wakeup. */
-	goto rearm;
-    if (event.events & (EPOLLHUP | EPOLLERR)) {
+    if ((events & (EPOLLHUP | EPOLLERR)) == EPOLLERR && fdc->errqueue &&
+		fdc->except_enabled) {
+	/*
+	 * Just something on the error queue, see sel_set_fd_errqueue().
+	 * The except handler will read it, so leave the fd alone.
+	 */
+    } else if (events & (EPOLLHUP | EPOLLERR)) {
 	/*
 	 * The crazy people that designed epoll made it so that EPOLLHUP
 	 * and EPOLLERR always wake it up, even if they are not set.  That
@@ -1270,65 +2249,911 @@ process_fds_epoll(struct selector_s *sel, struct timespec *tstimeout,
 	 * by hand.
 	 */
 	sel_update_fd(sel, fdc, EPOLL_CTL_DEL);
-	fdc->saved_events = event.events & (EPOLLHUP | EPOLLERR);
+	fdc->saved_events = events & (EPOLLHUP | EPOLLERR);
 	/*
 	 * Have it handle read data, too, so if there is a pending
 	 * error it will get handled.
 	 */
-	event.events |= EPOLLIN;
+	events |= EPOLLIN;
     }
-    if (event.events & (EPOLLIN | EPOLLHUP))
+    if (events & (EPOLLIN | EPOLLHUP))
 	handle_selector_call(sel, fdc, NULL, fdc->read_enabled,
 			     fdc->handle_read);
-    if (event.events & EPOLLOUT)
+    if (events & EPOLLOUT)
 	handle_selector_call(sel, fdc, NULL, fdc->write_enabled,
 			     fdc->handle_write);
-    if (event.events & (EPOLLPRI | EPOLLERR))
+    if (events & (EPOLLPRI | EPOLLERR))
 	handle_selector_call(sel, fdc, NULL, fdc->except_enabled,
 			     fdc->handle_except);
-
- rearm:
-    /* Rearm the event.  Remember it could have been deleted in the handler. */
-    if (fdc->state)
-	sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
-    sel_fd_unlock(sel);
-
-    return rv;
 }
 
-int
-sel_setup_forked_process(struct selector_s *sel)
+/*
+ * Edge-triggered handling.  An fd is not disarmed when an event comes
+ * in, so another thread may get an event for an fd while a handler
+ * is running on it.  The in_handler flag in the fd state keeps the
+ * handlers for an fd on one thread.  Events that come in while it is
+ * set are stored in pending_events and the thread running the
+ * handlers picks them up.
+ *
+ * Handlers do not necessarily read or write until the fd would
+ * block, so after a handler returns the fd may still be ready and
+ * there will be no new edge to report it.  If the os handler called
+ * sel_fd_drained() from the handler, the read or write came up short
+ * and the next edge will report it.  Otherwise, if the handler is
+ * still enabled, the fd is modified in epoll, which makes epoll check
+ * it and report it again if it is still ready.  Handlers that didn't
+ * run don't need that, their edge is still pending in epoll.
+ *
+ * sel_fd_drained() is called from the handler on the thread running
+ * it, so it finds the fd state through a per-thread pointer instead
+ * of taking the fd lock to look it up.  Only the thread that set
+ * in_handler touches the drained flags.
+ */
+typedef struct et_running_s
 {
-    int i;
-
-    /*
-     * More epoll stupidity.  In a forked process we must create a new
-     * epoll because the epoll state is shared between a parent and a
-     * child.  If it worked like it should, each epoll instance would
-     * be independent.  If you don't do this, disabling an fd in the
-     * child disables the parent, too, and vice versa.
-     */
-    close(sel->epollfd);
-    sel->epollfd = epoll_create(32768);
-    if (sel->epollfd == -1) {
-	return errno;
-    }
+    int fd;
+    fd_state_t *state;
+} et_running_t;
 
-    for (i = 0; i <= sel->maxfd; i++) {
-	fd_control_t *fdc = sel->fds[i];
-	if (fdc && fdc->state)
-	    sel_update_fd(sel, fdc, EPOLL_CTL_ADD);
-    }
-    return 0;
+static et_running_t *
+et_get_running(struct selector_s *sel)
+{
+#ifdef USE_PTHREADS
+    return pthread_getspecific(sel->et_running_key);
+#else
+    return sel->et_running;
+#endif
 }
+
+static void
+et_set_running(struct selector_s *sel, et_running_t *r)
+{
+#ifdef USE_PTHREADS
+    pthread_setspecific(sel->et_running_key, r);
 #else
-int
-sel_setup_forked_process(struct selector_s *sel)
+    sel->et_running = r;
+#endif
+}
+
+static short
+et_poll_events(fd_control_t *fdc)
 {
-    /* Nothing to do. */
-    return 0;
+    short events = 0;
+
+    if (fdc->read_enabled)
+	events |= POLLIN;
+    if (fdc->write_enabled)
+	events |= POLLOUT;
+    if (fdc->except_enabled)
+	events |= POLLPRI;
+    return events;
+}
+
+static uint32_t
+et_poll_to_epoll(short revents)
+{
+    uint32_t events = 0;
+
+    if (revents & POLLIN)
+	events |= EPOLLIN;
+    if (revents & POLLOUT)
+	events |= EPOLLOUT;
+    if (revents & POLLPRI)
+	events |= EPOLLPRI;
+    if (revents & POLLHUP)
+	events |= EPOLLHUP;
+    if (revents & POLLERR)
+	events |= EPOLLERR;
+    return events;
+}
+
+/*
+ * Must be called with the fd lock held and in_handler set.  Returns
+ * the POLLxxx bits for the handlers that were run.
+ */
+static short
+et_run_handlers(struct selector_s *sel, fd_control_t *fdc, fd_state_t *state,
+		uint32_t events)
+{
+    et_running_t running, *old_running;
+    short run, ran = 0;
+
+    running.fd = fdc->fd;
+    running.state = state;
+    old_running = et_get_running(sel);
+    et_set_running(sel, &running);
+    while (events && !state->deleted) {
+	/*
+	 * EPOLLHUP and EPOLLERR are always reported, but with edge
+	 * triggering they are only reported once, so we can just
+	 * ignore them if nothing is enabled to handle them.  Have the
+	 * read handler handle them so a pending error gets handled.
+	 */
+	if (events & (EPOLLHUP | EPOLLERR))
+	    events |= EPOLLIN;
+	run = 0;
+	if (events & EPOLLIN)
+	    run |= POLLIN;
+	if (events & EPOLLOUT)
+	    run |= POLLOUT;
+	if (events & (EPOLLPRI | EPOLLERR))
+	    run |= POLLPRI;
+	state->drained &= ~run;
+	ran |= run;
+	if (events & EPOLLIN)
+	    handle_selector_call(sel, fdc, NULL, fdc->read_enabled,
+				 fdc->handle_read);
+	if (events & EPOLLOUT)
+	    handle_selector_call(sel, fdc, NULL, fdc->write_enabled,
+				 fdc->handle_write);
+	if (events & (EPOLLPRI | EPOLLERR))
+	    handle_selector_call(sel, fdc, NULL, fdc->except_enabled,
+				 fdc->handle_except);
+	events = state->pending_events;
+	state->pending_events = 0;
+    }
+    et_set_running(sel, old_running);
+    return ran;
+}
+
+/* Must be called with the fd lock held. */
+static void
+process_events_et(struct selector_s *sel, struct epoll_event *events,
+		  unsigned long *del_gens, int count, int stale)
+{
+    fd_control_t *fdc;
+    fd_state_t *state;
+    void *data;
+    short ran;
+    int i;
+
+    for (i = 0; i < count; i++) {
+	valid_fd(sel, events[i].data.fd, &fdc);
+	state = fdc->state;
+	if (!state)
+	    continue;
+	if (state->in_handler) {
+	    /* Another thread is handling it, let it do the work. */
+	    state->pending_events |= events[i].events;
+	    continue;
+	}
+
+	state->use_count++;
+	state->in_handler = 1;
+	data = fdc->data;
+	/*
+	 * If the event may be from an old fd, we can't drop it like
+	 * the oneshot code does because it won't be reported again.
+	 * Just have epoll check it again.
+	 */
+	if (!stale && del_gens[i] == fdc->del_gen) {
+	    ran = et_run_handlers(sel, fdc, state, events[i].events);
+	} else {
+	    ran = POLLIN | POLLOUT | POLLPRI;
+	    state->drained = 0;
+	}
+	if (!state->deleted && fdc->state == state &&
+		et_poll_events(fdc) & ran & ~state->drained)
+	    /* Modifying it makes epoll check it and report it if ready. */
+	    sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
+	state->in_handler = 0;
+	put_fd_state(sel, fdc, state, data);
+    }
+}
+
+/*
+ * Wakeups.  The shared wakeup is an eventfd in the main epoll set, so
+ * writing it wakes one of the threads waiting in epoll.  A per-thread
+ * wakeup has its own epoll set holding its eventfd and the main epoll
+ * fd, the thread waits on that so it can be woken by itself.  The
+ * eventfds are edge-triggered so each write causes one wakeup.
+ */
+struct sel_wakeup_s
+{
+    struct selector_s *sel;
+    int efd;
+    int epfd; /* -1 for the shared wakeup. */
+    struct sel_wakeup_s *next, *prev;
+};
+
+static int
+wakeup_epoll_add(int epfd, int fd, uint32_t events)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) == -1)
+	return errno;
+    return 0;
+}
+
+static void
+wakeup_close(sel_wakeup_t *w)
+{
+    if (w->epfd >= 0)
+	close(w->epfd);
+    if (w->efd >= 0)
+	close(w->efd);
+    w->epfd = -1;
+    w->efd = -1;
+}
+
+static int
+wakeup_open(struct selector_s *sel, sel_wakeup_t *w, bool shared)
+{
+    int rv;
+
+    w->epfd = -1;
+    w->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->efd == -1)
+	return errno;
+
+    if (shared) {
+	rv = wakeup_epoll_add(sel->epollfd, w->efd, EPOLLIN | EPOLLET);
+    } else {
+	w->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (w->epfd == -1) {
+	    rv = errno;
+	    goto out_err;
+	}
+	rv = wakeup_epoll_add(w->epfd, w->efd, EPOLLIN | EPOLLET);
+	if (!rv)
+	    rv = wakeup_epoll_add(w->epfd, sel->epollfd, EPOLLIN);
+    }
+ out_err:
+    if (rv)
+	wakeup_close(w);
+    return rv;
+}
+
+static void
+wakeup_drain(sel_wakeup_t *w)
+{
+    uint64_t val;
+
+    if (read(w->efd, &val, sizeof(val)) == -1) {
+	/* Nothing to do, it's just a wakeup. */
+    }
+}
+
+/*
+ * Remove any events for the shared wakeup from the list of events.
+ * Returns the new number of events.
+ */
+static int
+wakeup_filter_shared(struct selector_s *sel, struct epoll_event *events,
+		     int count, int *woken)
+{
+    int i, j;
+
+    if (!sel->wakeup)
+	return count;
+
+    for (i = 0, j = 0; i < count; i++) {
+	if (events[i].data.fd == sel->wakeup->efd) {
+	    wakeup_drain(sel->wakeup);
+	    *woken = 1;
+	} else {
+	    if (i != j)
+		events[j] = events[i];
+	    j++;
+	}
+    }
+    return j;
+}
+
+static int
+epoll_timeout_ms(struct timespec *tstimeout)
+{
+    if (tstimeout->tv_sec > 600)
+	 /* Don't wait over 10 minutes, to work around an old epoll bug
+	    and avoid issues with timeout overflowing on 64-bit systems,
+	    which is much larger that 10 minutes, but who cares. */
+	return 600 * 1000;
+    return ((tstimeout->tv_sec * 1000) +
+	    (tstimeout->tv_nsec + 999999) / 1000000);
+}
+
+/*
+ * Wait on a per-thread wakeup's epoll set.  If the main epoll set has
+ * something, fetch the events from it.  Another thread may have
+ * taken them first, in that case go back to waiting.
+ */
+static int
+wakeup_wait_private(struct selector_s *sel, sel_wakeup_t *w,
+		    struct epoll_event *events, struct timespec *tstimeout,
+		    sigset_t *sigmask, int *woken)
+{
+    struct epoll_event wevents[2];
+    struct timespec end, now;
+    int rv, i, have_events;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += tstimeout->tv_sec;
+    end.tv_nsec += tstimeout->tv_nsec;
+    if (end.tv_nsec >= 1000000000) {
+	end.tv_nsec -= 1000000000;
+	end.tv_sec++;
+    }
+
+    for (;;) {
+	if (sigmask)
+	    rv = epoll_pwait(w->epfd, wevents, 2, epoll_timeout_ms(tstimeout),
+			     sigmask);
+	else
+	    rv = epoll_wait(w->epfd, wevents, 2, epoll_timeout_ms(tstimeout));
+	if (rv <= 0)
+	    return rv;
+
+	have_events = 0;
+	for (i = 0; i < rv; i++) {
+	    if (wevents[i].data.fd == w->efd) {
+		wakeup_drain(w);
+		*woken = 1;
+	    } else {
+		have_events = 1;
+	    }
+	}
+	rv = 0;
+	if (have_events) {
+	    rv = epoll_wait(sel->epollfd, events, sel->epoll_batch, 0);
+	    if (rv < 0)
+		return rv;
+	    rv = wakeup_filter_shared(sel, events, rv, woken);
+	}
+	if (rv > 0 || *woken)
+	    return rv;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec > end.tv_sec ||
+		(now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec))
+	    return 0;
+	tstimeout->tv_sec = end.tv_sec - now.tv_sec;
+	tstimeout->tv_nsec = end.tv_nsec - now.tv_nsec;
+	if (tstimeout->tv_nsec < 0) {
+	    tstimeout->tv_nsec += 1000000000;
+	    tstimeout->tv_sec--;
+	}
+    }
+}
+
+static int
+process_fds_epoll(struct selector_s *sel, struct timespec *tstimeout,
+		  sigset_t *isigmask, sel_wakeup_t *wakeup, uint64_t *woke)
+{
+    int rv, i;
+    struct epoll_event events[SEL_MAX_EPOLL_BATCH];
+    unsigned long del_gens[SEL_MAX_EPOLL_BATCH];
+    sigset_t sigmask;
+    fd_control_t *fdc;
+    unsigned long entry_fd_del_count = sel->fd_del_count;
+    int stale, woken = 0;
+
+    if (wakeup && wakeup->epfd >= 0) {
+	rv = wakeup_wait_private(sel, wakeup, events, tstimeout, isigmask,
+				 &woken);
+    } else if (wakeup) {
+	/*
+	 * No signals are used for waking, so no need to mess with the
+	 * signal mask unless the user asked for it.
+	 */
+	if (isigmask)
+	    rv = epoll_pwait(sel->epollfd, events, sel->epoll_batch,
+			     epoll_timeout_ms(tstimeout), isigmask);
+	else
+	    rv = epoll_wait(sel->epollfd, events, sel->epoll_batch,
+			    epoll_timeout_ms(tstimeout));
+    } else {
+	setup_my_sigmask(&sigmask, isigmask);
+	sigdelset(&sigmask, sel->wake_sig);
+	rv = epoll_pwait(sel->epollfd, events, sel->epoll_batch,
+			 epoll_timeout_ms(tstimeout), &sigmask);
+    }
+    if (woke)
+	*woke = sel_stats_now();
+    if (rv > 0)
+	rv = wakeup_filter_shared(sel, events, rv, &woken);
+    if (rv == 0 && woken) {
+	/* Report a wakeup like a signal would. */
+	errno = EINTR;
+	return -1;
+    }
+    if (rv <= 0)
+	return rv;
+
+    sel_fd_lock(sel);
+    /*
+     * If something was deleted from the FD set while we were waiting,
+     * we can't tell which events are from the old fd, so don't
+     * process any of them, just rearm them.
+     */
+    stale = entry_fd_del_count != sel->fd_del_count;
+
+    /*
+     * Every fd we got is disarmed because of EPOLLONESHOT, so no
+     * other thread can get it until we rearm it.  But a handler for
+     * an earlier event in the batch may delete (and possibly re-add)
+     * an fd later in the batch, so remember where each fd was at and
+     * ignore events on ones that have changed.
+     */
+    for (i = 0; i < rv; i++) {
+	valid_fd(sel, events[i].data.fd, &fdc);
+	del_gens[i] = fdc->del_gen;
+    }
+
+    if (sel->edge_triggered) {
+	process_events_et(sel, events, del_gens, rv, stale);
+	goto out_unlock;
+    }
+
+    for (i = 0; i < rv; i++) {
+	valid_fd(sel, events[i].data.fd, &fdc);
+	if (!stale && del_gens[i] == fdc->del_gen)
+	    handle_epoll_event(sel, fdc, events[i].events);
+
+	/*
+	 * Rearm the event.  Remember it could have been deleted in
+	 * the handler.
+	 */
+	if (fdc->state)
+	    sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
+    }
+ out_unlock:
+    sel_fd_unlock(sel);
+
+    return rv;
 }
-#endif
+
+int
+sel_set_epoll_batch(struct selector_s *sel, unsigned int count)
+{
+    if (count == 0 || count > SEL_MAX_EPOLL_BATCH)
+	return EINVAL;
+    sel->epoll_batch = count;
+    return 0;
+}
+
+/* Must be called with the fd lock held. */
+static int
+sel_fds_in_use(struct selector_s *sel)
+{
+    unsigned int i;
+
+    for (i = 0; i < sel->fds_size; i++) {
+	if (sel->fds[i] && sel->fds[i]->state)
+	    return 1;
+    }
+    return 0;
+}
+
+int
+sel_set_edge_triggered(struct selector_s *sel, int enable)
+{
+    int rv = 0;
+
+    if (sel->epollfd < 0)
+	return ENOSYS;
+#ifdef SEL_HAVE_URING
+    if (sel->uring)
+	return ENOSYS;
+#endif
+
+    sel_fd_lock(sel);
+    if (sel_fds_in_use(sel)) {
+	rv = EBUSY;
+	goto out_unlock;
+    }
+#ifdef USE_PTHREADS
+    if (enable && !sel->et_running_key_set) {
+	rv = pthread_key_create(&sel->et_running_key, NULL);
+	if (rv)
+	    goto out_unlock;
+	sel->et_running_key_set = 1;
+    }
+#endif
+    sel->edge_triggered = !!enable;
+ out_unlock:
+    sel_fd_unlock(sel);
+    return rv;
+}
+
+int
+sel_set_fd_errqueue(struct selector_s *sel, int fd, int enable)
+{
+    fd_control_t *fdc;
+    int rv = 0;
+
+    if (sel->epollfd < 0)
+	return ENOSYS;
+
+    sel_fd_lock(sel);
+    fdc = get_fd(sel, fd);
+    if (!fdc || !fdc->state)
+	rv = EBADF;
+    else
+	fdc->errqueue = !!enable;
+    sel_fd_unlock(sel);
+    return rv;
+}
+
+void
+sel_fd_drained(struct selector_s *sel, int fd, int write)
+{
+    et_running_t *running;
+
+    if (!sel->edge_triggered)
+	return;
+
+    /* See process_events_et(), no lock is needed here. */
+    running = et_get_running(sel);
+    if (running && running->fd == fd)
+	running->state->drained |= write ? POLLOUT : POLLIN;
+}
+
+int
+sel_use_wakeup_fds(struct selector_s *sel)
+{
+    sel_wakeup_t *w;
+    int rv = 0;
+
+    if (sel->epollfd < 0)
+	return ENOSYS;
+#ifdef SEL_HAVE_URING
+    if (sel->uring)
+	return ENOSYS;
+#endif
+
+    sel_timer_lock(sel);
+    if (sel->wakeup)
+	goto out_unlock;
+    w = calloc(1, sizeof(*w));
+    if (!w) {
+	rv = ENOMEM;
+	goto out_unlock;
+    }
+    w->sel = sel;
+    rv = wakeup_open(sel, w, true);
+    if (rv)
+	free(w);
+    else
+	sel->wakeup = w;
+ out_unlock:
+    sel_timer_unlock(sel);
+    return rv;
+}
+
+sel_wakeup_t *
+sel_get_wakeup(struct selector_s *sel)
+{
+    return sel->wakeup;
+}
+
+int
+sel_alloc_wakeup(struct selector_s *sel, sel_wakeup_t **new_wakeup)
+{
+    sel_wakeup_t *w;
+    int rv;
+
+    if (!sel->wakeup)
+	return ENOSYS;
+
+    w = calloc(1, sizeof(*w));
+    if (!w)
+	return ENOMEM;
+    w->sel = sel;
+    rv = wakeup_open(sel, w, false);
+    if (rv) {
+	free(w);
+	return rv;
+    }
+
+    sel_timer_lock(sel);
+    w->next = sel->wakeups;
+    if (w->next)
+	w->next->prev = w;
+    sel->wakeups = w;
+    sel_timer_unlock(sel);
+
+    *new_wakeup = w;
+    return 0;
+}
+
+void
+sel_free_wakeup(sel_wakeup_t *w)
+{
+    struct selector_s *sel = w->sel;
+
+    sel_timer_lock(sel);
+    if (w->next)
+	w->next->prev = w->prev;
+    if (w->prev)
+	w->prev->next = w->next;
+    else
+	sel->wakeups = w->next;
+    sel_timer_unlock(sel);
+
+    wakeup_close(w);
+    free(w);
+}
+
+void
+sel_wakeup_send(long thread_id, void *cb_data)
+{
+    sel_wakeup_t *w = cb_data;
+    uint64_t val = 1;
+
+    if (write(w->efd, &val, sizeof(val)) == -1) {
+	/* Counter overflow or bad fd, nothing to do about it. */
+    }
+}
+
+#ifdef SEL_HAVE_URING
+static int
+process_fds_uring(struct selector_s *sel, struct timespec *tstimeout,
+		  sigset_t *isigmask, uint64_t *woke)
+{
+    struct sel_uring_s *u = sel->uring;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    struct io_uring_cqe cqes[SEL_MAX_EPOLL_BATCH];
+    unsigned int head, tail, count = 0, i;
+    sigset_t sigmask;
+    fd_control_t *fdc;
+    int rv;
+
+    setup_my_sigmask(&sigmask, isigmask);
+    sigdelset(&sigmask, sel->wake_sig);
+
+    ts.tv_sec = tstimeout->tv_sec;
+    ts.tv_nsec = tstimeout->tv_nsec;
+    if (u->retries || u->to_submit) {
+	sel_fd_lock(sel);
+	if (uring_retry(sel) &&
+		(ts.tv_sec > 0 || ts.tv_nsec > SEL_URING_RETRY_NSEC)) {
+	    /* Don't wait long, so it gets retried soon. */
+	    ts.tv_sec = 0;
+	    ts.tv_nsec = SEL_URING_RETRY_NSEC;
+	}
+	sel_fd_unlock(sel);
+    }
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask = (uintptr_t) &sigmask;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uintptr_t) &ts;
+    rv = uring_enter(u->fd, 0, 1,
+		     IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		     &arg, sizeof(arg));
+    if (woke)
+	*woke = sel_stats_now();
+    if (rv < 0) {
+	if (errno == ETIME)
+	    return 0;
+	/* EBUSY means completions are backed up, go get them. */
+	if (errno != EBUSY)
+	    return -1;
+    }
+
+    sel_fd_lock(sel);
+    /*
+     * Copy the completions out so other threads can get the rest
+     * while we are in handlers.
+     */
+    head = *u->cq_head;
+    tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && count < sel->epoll_batch)
+	cqes[count++] = u->cqes[head++ & *u->cq_mask];
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+    for (i = 0; i < count; i++) {
+	if (!cqes[i].user_data)
+	    /* Completion of a poll remove. */
+	    continue;
+	fdc = get_fd(sel, (int) (uint32_t) cqes[i].user_data);
+	/*
+	 * The token changes every time a poll is added and the fd is
+	 * disarmed when a handler is cleared, so this catches
+	 * completions from deleted fds and cancelled polls.
+	 */
+	if (!fdc || !fdc->uring_armed ||
+		uring_user_data(fdc) != cqes[i].user_data)
+	    continue;
+	fdc->uring_armed = 0;
+
+	if (cqes[i].res > 0)
+	    handle_epoll_event(sel, fdc, et_poll_to_epoll(cqes[i].res));
+
+	/*
+	 * Rearm the poll.  Remember it could have been deleted in the
+	 * handler.  All the rearms are submitted together below.
+	 */
+	if (fdc->state) {
+	    u->defer_submit = 1;
+	    sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
+	    u->defer_submit = 0;
+	}
+    }
+    /* If this fails, it's retried before the next wait. */
+    uring_submit(u);
+    sel_fd_unlock(sel);
+
+    /*
+     * Another thread may have taken the completions, but we didn't
+     * time out, so report that something happened.
+     */
+    return count ? count : 1;
+}
+
+/* Must be called with the fd lock held. */
+static int
+uring_rearm_all(struct selector_s *sel)
+{
+    unsigned int i;
+    int rv;
+
+    rv = uring_alloc(&sel->uring);
+    if (rv)
+	return rv;
+    for (i = 0; i < sel->fds_size; i++) {
+	fd_control_t *fdc = sel->fds[i];
+
+	if (fdc) {
+	    fdc->uring_armed = 0;
+	    fdc->uring_retry = 0;
+	    if (fdc->state)
+		sel_update_fd(sel, fdc, EPOLL_CTL_ADD);
+	}
+    }
+    return 0;
+}
+
+int
+sel_use_io_uring(struct selector_s *sel)
+{
+    int rv = 0;
+
+    if (sel->epollfd < 0)
+	return ENOSYS;
+
+    sel_fd_lock(sel);
+    if (sel->uring)
+	goto out_unlock;
+    if (sel->edge_triggered || sel->wakeup || sel_fds_in_use(sel))
+	rv = EBUSY;
+    else
+	rv = uring_alloc(&sel->uring);
+ out_unlock:
+    sel_fd_unlock(sel);
+    return rv;
+}
+#else
+int
+sel_use_io_uring(struct selector_s *sel)
+{
+    return ENOSYS;
+}
+#endif
+
+int
+sel_setup_forked_process(struct selector_s *sel)
+{
+    int i;
+
+    /*
+     * More epoll stupidity.  In a forked process we must create a new
+     * epoll because the epoll state is shared between a parent and a
+     * child.  If it worked like it should, each epoll instance would
+     * be independent.  If you don't do this, disabling an fd in the
+     * child disables the parent, too, and vice versa.
+     */
+    close(sel->epollfd);
+    sel->epollfd = epoll_create(32768);
+    if (sel->epollfd == -1) {
+	return errno;
+    }
+
+    /* The eventfds and per-thread epolls are shared, too. */
+    if (sel->wakeup) {
+	sel_wakeup_t *w;
+	int rv;
+
+	wakeup_close(sel->wakeup);
+	rv = wakeup_open(sel, sel->wakeup, true);
+	if (rv)
+	    return rv;
+	for (w = sel->wakeups; w; w = w->next) {
+	    wakeup_close(w);
+	    rv = wakeup_open(sel, w, false);
+	    if (rv)
+		return rv;
+	}
+    }
+
+#ifdef SEL_HAVE_URING
+    /* Same thing for io_uring, the rings are shared with the parent. */
+    if (sel->uring) {
+	uring_free(sel->uring);
+	sel->uring = NULL;
+	return uring_rearm_all(sel);
+    }
+#endif
+
+    for (i = 0; i <= sel->maxfd && (unsigned int) i < sel->fds_size; i++) {
+	fd_control_t *fdc = sel->fds[i];
+	if (fdc && fdc->state)
+	    sel_update_fd(sel, fdc, EPOLL_CTL_ADD);
+    }
+    return 0;
+}
+#else
+int
+sel_setup_forked_process(struct selector_s *sel)
+{
+    /* Nothing to do. */
+    return 0;
+}
+
+int
+sel_set_epoll_batch(struct selector_s *sel, unsigned int count)
+{
+    if (count == 0 || count > SEL_MAX_EPOLL_BATCH)
+	return EINVAL;
+    /* No epoll, nothing to batch. */
+    return 0;
+}
+
+int
+sel_set_edge_triggered(struct selector_s *sel, int enable)
+{
+    return ENOSYS;
+}
+
+int
+sel_set_fd_errqueue(struct selector_s *sel, int fd, int enable)
+{
+    return ENOSYS;
+}
+
+void
+sel_fd_drained(struct selector_s *sel, int fd, int write)
+{
+}
+
+int
+sel_use_io_uring(struct selector_s *sel)
+{
+    return ENOSYS;
+}
+
+int
+sel_use_wakeup_fds(struct selector_s *sel)
+{
+    return ENOSYS;
+}
+
+sel_wakeup_t *
+sel_get_wakeup(struct selector_s *sel)
+{
+    return NULL;
+}
+
+int
+sel_alloc_wakeup(struct selector_s *sel, sel_wakeup_t **new_wakeup)
+{
+    return ENOSYS;
+}
+
+void
+sel_free_wakeup(sel_wakeup_t *w)
+{
+}
+
+void
+sel_wakeup_send(long thread_id, void *cb_data)
+{
+}
+#endif
 
 int
 sel_select_intr_sigmask(struct selector_s *sel,
@@ -1344,17 +3169,22 @@ sel_select_intr_sigmask(struct selector_s *sel,
     unsigned int    count;
     struct timeval  end = { 0, 0 }, now;
     int user_timeout = 0;
+    bool stats = sel_stats_on(sel);
+    uint64_t start = 0, woke = 0, busy = 0;
 
     if (timeout) {
 	sel_get_monotonic_time(&now);
 	add_timeval(&end, &now, timeout);
     }
 
+    if (stats)
+	start = sel_stats_now();
+
     sel_timer_lock(sel);
     count = process_runners(sel);
     process_timers(sel, &count, &tmp_timeout, &wake_time);
 
-    if (count == 0 && !sel->runner_head) {
+    if (count == 0 && !sel_runners_pending(sel)) {
 	/* Didn't do anything and no runners waiting, wait for something. */
 	if (timeout) {
 	    if (cmp_timeval(&tmp_timeout, timeout) >= 0) {
@@ -1372,14 +3202,29 @@ sel_select_intr_sigmask(struct selector_s *sel,
 			  &wake_time);
 	sel_timer_unlock(sel);
 
+	if (stats) {
+	    /* Don't count the time spent waiting. */
+	    busy = sel_stats_now() - start;
+	    woke = start + busy;
+	}
+
+#ifdef SEL_HAVE_URING
+	if (sel->uring)
+	    err = process_fds_uring(sel,
+				    (struct timespec *) &wait_entry.wait_time,
+				    sigmask, stats ? &woke : NULL);
+	else
+#endif
 #ifdef HAVE_EPOLL_PWAIT
 	if (sel->epollfd >= 0)
 	    err = process_fds_epoll(sel,
 				    (struct timespec *) &wait_entry.wait_time,
-				    sigmask);
+				    sigmask,
+				    send_sig == sel_wakeup_send ? cb_data : NULL,
+				    stats ? &woke : NULL);
 	else
 #endif
-	    err = process_fds(sel, &wait_entry, sigmask);
+	    err = process_fds(sel, &wait_entry, sigmask, stats ? &woke : NULL);
 
 	old_errno = errno;
 
@@ -1410,8 +3255,12 @@ sel_select_intr_sigmask(struct selector_s *sel,
 	 * we timed out we want to alert the user of that.
 	 */
 	process_runners(sel);
+    } else {
+	woke = start;
     }
     sel_timer_unlock(sel);
+    if (stats)
+	sel_stats_add(&sel->stats.loop_time, busy + sel_stats_now() - woke);
     if (timeout) {
 	sel_get_monotonic_time(&now);
 	diff_timeval(timeout, &end, &now);
@@ -1511,8 +3360,6 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
     FD_ZERO((fd_set *) (fd_set *) &sel->write_set);
     FD_ZERO((fd_set *) (fd_set *) &sel->except_set);
 
-    memset(sel->fds, 0, sizeof(sel->fds));
-
     theap_init(&sel->timer_heap);
 
     if (sel->sel_lock_alloc) {
@@ -1548,6 +3395,7 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
     }
 
 #ifdef HAVE_EPOLL_PWAIT
+    sel->epoll_batch = 1;
     sel->epollfd = epoll_create(32768);
     if (sel->epollfd == -1)
 	syslog(LOG_ERR, "Unable to set up epoll, falling back to select: %m");
@@ -1578,20 +3426,46 @@ sel_free_selector(struct selector_s *sel)
 	free(elem);
 	elem = theap_get_top(&(sel->timer_heap));
     }
+    if (sel->timer_wheel) {
+	struct sel_wheel_s *w = sel->timer_wheel;
+
+	for (i = 0; i <= SEL_WHEEL_EXPIRED; i++) {
+	    while ((elem = wheel_list(w, i)->first)) {
+		wheel_remove(w, elem);
+		free(elem);
+	    }
+	}
+	free(w);
+    }
 #ifdef HAVE_EPOLL_PWAIT
+    while (sel->wakeups)
+	sel_free_wakeup(sel->wakeups);
+    if (sel->wakeup) {
+	wakeup_close(sel->wakeup);
+	free(sel->wakeup);
+    }
     if (sel->epollfd >= 0)
 	close(sel->epollfd);
+#ifdef USE_PTHREADS
+    if (sel->et_running_key_set)
+	pthread_key_delete(sel->et_running_key);
 #endif
-    for (i = 0; i < FD_SETSIZE; i++) {
-	while (sel->fds[i]) {
-	    fd_control_t *fdc = sel->fds[i];
+#endif
+#ifdef SEL_HAVE_URING
+    if (sel->uring)
+	uring_free(sel->uring);
+#endif
+    for (i = 0; i < sel->fds_size; i++) {
+	fd_control_t *fdc = sel->fds[i];
 
-	    sel->fds[i] = fdc->next;
+	if (fdc) {
 	    if (fdc->state)
 		free(fdc->state);
 	    free(fdc);
 	}
     }
+    if (sel->fds)
+	free(sel->fds);
     if (sel->fd_lock)
 	sel->sel_lock_free(sel->fd_lock);
     if (sel->timer_lock)
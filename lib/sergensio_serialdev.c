@@ -745,8 +745,11 @@ serialdev_timeout(struct gensio_timer *t, void *cb_data)
  out_restart:
     if (sdata->modemstate_mask) {
 	gensio_time timeout = {1, 0};
+	gensio_time slack = {0, 250000000};
 
-	sdata->o->start_timer(sdata->timer, &timeout);
+	/* Polling, so it doesn't need to be exact. */
+	gensio_os_funcs_start_timer_slack(sdata->o, sdata->timer,
+					  &timeout, &slack);
     }
 
     sterm_lock(sdata);
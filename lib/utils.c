@@ -658,7 +658,8 @@ static const char *gensio_errs[] = {
     /*  39 */	 "Unable to find a valid name on the name server",
     /*  40 */	 "Serious name server failure",
     /*  41 */	 "Invalid name server information",
-    /*  42 */	 "Network address for the given name is not available"
+    /*  42 */	 "Network address for the given name is not available",
+    /*  43 */	 "Memory limit reached"
 };
 const int errno_len = sizeof(gensio_errs) / sizeof(char *);
 
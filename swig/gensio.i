@@ -364,6 +364,13 @@ struct waiter { };
     ~gensio_os_funcs() {
 	check_os_funcs_free(self);
     }
+
+    /* See GENSIO_CONTROL_DISABLE_MMSG. */
+    void disable_mmsg() {
+	int rv = self->control(self, GENSIO_CONTROL_DISABLE_MMSG, NULL, NULL);
+
+	err_handle("disable_mmsg", rv);
+    }
 }
 
 %constant int GE_NOTSUP = GE_NOTSUP;
@@ -428,6 +435,7 @@ struct waiter { };
 %constant int GENSIO_CONTROL_SER_FLUSH = GENSIO_CONTROL_SER_FLUSH;
 %constant int GENSIO_CONTROL_SER_SEND_BREAK = GENSIO_CONTROL_SER_SEND_BREAK;
 %constant int GENSIO_CONTROL_SER_LINESTATE = GENSIO_CONTROL_SER_LINESTATE;
+%constant int GENSIO_CONTROL_MEM_USAGE = GENSIO_CONTROL_MEM_USAGE;
 
 /* Keep the async control number in a different range, just to be safe. */
 %constant int GENSIO_ACONTROL_SER_BAUD = GENSIO_ACONTROL_SER_BAUD;
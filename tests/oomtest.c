@@ -39,7 +39,7 @@
 
 struct oom_tests {
     char *connecter;
-    const char *accepter;
+    char *accepter;
     bool (*check_if_present)(struct gensio_os_funcs *o, struct oom_tests *test);
     void (*end_test_suite)(struct gensio_os_funcs *o, struct oom_tests *test);
     int (*start_test)(struct gensio_os_funcs *o, struct oom_tests *test);
@@ -47,6 +47,7 @@ struct oom_tests {
     bool check_done;
     bool check_value;
     bool free_connecter;
+    bool free_accepter;
     bool conacc;
 
     /* Some tests can keep going on a failure under certain circumstances. */
@@ -82,7 +83,13 @@ static bool debug;
 static unsigned int num_extra_threads = 3;
 static bool use_glib = false;
 static bool use_tcl = false;
+static bool use_uring = false;
+static bool use_timer_wheel = false;
+static bool use_mempool = false;
+static bool no_mmsg = false;
+static const char *memchk_str = "GENSIO_MEMTRACK=abort";
 static const char *os_func_str = "";
+static char os_func_buf[50];
 
 struct gensio_os_proc_data *proc_data;
 
@@ -229,6 +236,66 @@ check_sctp_present(struct gensio_os_funcs *o, struct oom_tests *test)
 #endif
 }
 
+static bool
+check_udp_gso_present(struct gensio_os_funcs *o, struct oom_tests *test)
+{
+    struct gensio_accepter *acc;
+    bool rv;
+
+    /* GSO support isn't known until the socket is set up. */
+    if (str_to_gensio_accepter(test->accepter, o, NULL, NULL, &acc))
+	return false;
+    rv = gensio_acc_startup(acc) == 0;
+    if (rv)
+	gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    if (!rv)
+	printf("udp GSO is not available, skipping udp gso test\n");
+    return rv;
+}
+
+/*
+ * reuseport=2 needs a real port, the accepter has a %s for it.  Get
+ * one from the OS, then make sure the OS does SO_REUSEPORT.
+ */
+static bool
+check_reuseport_present(struct gensio_os_funcs *o, struct oom_tests *test)
+{
+    struct gensio_accepter *acc;
+    char port[20];
+    gensiods size = sizeof(port);
+    int rv;
+
+    rv = str_to_gensio_accepter("tcp,localhost,0", o, NULL, NULL, &acc);
+    if (rv)
+	return false;
+    rv = gensio_acc_startup(acc);
+    if (!rv) {
+	strcpy(port, "0");
+	rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+				GENSIO_ACC_CONTROL_LPORT, port, &size);
+	gensio_acc_shutdown_s(acc);
+    }
+    gensio_acc_free(acc);
+    if (rv)
+	return false;
+
+    test->accepter = gensio_alloc_sprintf(o, test->accepter, port);
+    if (!test->accepter)
+	return false;
+    test->free_accepter = true;
+
+    if (str_to_gensio_accepter(test->accepter, o, NULL, NULL, &acc))
+	return false;
+    rv = gensio_acc_startup(acc);
+    if (!rv)
+	gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    if (rv)
+	printf("SO_REUSEPORT is not available, skipping reuseport test\n");
+    return rv == 0;
+}
+
 static bool
 get_echo_dev(struct gensio_os_funcs *o, const char *testname,
 	     const char *str, char **newstr)
@@ -817,6 +884,24 @@ struct oom_tests oom_tests[] = {
       /* In this tests some errors will not result in a failure. */
       .allow_no_err_on_trig = true,
     },
+    { "udp(batch=16),ipv4,localhost,", "udp(batch=16),ipv4,0",
+      /* In this tests some errors will not result in a failure. */
+      .allow_no_err_on_trig = true,
+      .max_io_size = 2000
+    },
+    { "udp(gso=1000),ipv4,localhost,", "udp(gso=1000),ipv4,0",
+      .check_if_present = check_udp_gso_present,
+      /* In this tests some errors will not result in a failure. */
+      .allow_no_err_on_trig = true,
+      .max_io_size = 2000
+    },
+    { "tcp,localhost,", "tcp(acceptbatch=1),0",
+      .allow_no_err_on_trig = true,
+    },
+    { "tcp,localhost,", "tcp(reuseport=2),localhost,%s",
+      .check_if_present = check_reuseport_present,
+      .allow_no_err_on_trig = true,
+    },
     { NULL }
 };
 
@@ -2006,8 +2091,8 @@ run_oom_acc_test(struct oom_tests *test, long count, int *exitcode,
 static void
 print_test(struct oom_tests *test, char *tstr, bool close_acc, long count)
 {
-    printf("testing(%s %s) GENSIO_ERRTRIG_TEST=%ld GENSIO_MEMTRACK=abort '%s' '%s'\n",
-	   tstr, close_acc ? "sc" : "cc", count,
+    printf("testing(%s %s) GENSIO_ERRTRIG_TEST=%ld %s '%s' '%s'\n",
+	   tstr, close_acc ? "sc" : "cc", count, memchk_str,
 	   test->accepter, test->connecter);
     fflush(stdout);
 }
@@ -2315,12 +2400,46 @@ main(int argc, char *argv[])
 	    use_glib = true;
 	} else if (strcmp(argv[i], "--tcl") == 0) {
 	    use_tcl = true;
+	} else if (strcmp(argv[i], "--uring") == 0) {
+	    use_uring = true;
+	} else if (strcmp(argv[i], "--timer-wheel") == 0) {
+	    use_timer_wheel = true;
+	} else if (strcmp(argv[i], "--mempool") == 0) {
+	    use_mempool = true;
+	} else if (strcmp(argv[i], "--no-mmsg") == 0) {
+	    no_mmsg = true;
 	} else {
 	    fprintf(stderr, "Unknown argument: '%s'\n", argv[i]);
 	    exit(1);
 	}
     }
 
+    if (use_mempool) {
+	/*
+	 * The pool is not used with memory tracking, have it check for
+	 * leaks itself instead.
+	 */
+	rv = gensio_os_env_set("GENSIO_MEMTRACK", NULL);
+	if (!rv)
+	    rv = gensio_os_env_set("GENSIO_MEMPOOL", "abort");
+	if (rv) {
+	    fprintf(stderr, "Unable to set GENSIO_MEMPOOL: %s",
+		    gensio_err_to_str(rv));
+	    exit(1);
+	}
+	memchk_str = "GENSIO_MEMPOOL=abort";
+    }
+
+    if (use_timer_wheel) {
+	/* Set in the environment so gensiot uses it, too. */
+	rv = gensio_os_env_set("GENSIO_TIMER_WHEEL", "1");
+	if (rv) {
+	    fprintf(stderr, "Unable to set GENSIO_TIMER_WHEEL: %s",
+		    gensio_err_to_str(rv));
+	    exit(1);
+	}
+    }
+
     if (use_glib) {
 #ifndef HAVE_GLIB
 	fprintf(stderr, "glib specified, but glib OS handler not available.\n");
@@ -2340,6 +2459,14 @@ main(int argc, char *argv[])
 	num_extra_threads = 0;
 	os_func_str = " --tcl";
 	rv = gensio_tcl_funcs_alloc(&o);
+#endif
+    } else if (use_uring) {
+#ifdef _WIN32
+	fprintf(stderr, "io_uring is not available on Windows.\n");
+	exit(1);
+#else
+	os_func_str = " --uring";
+	rv = gensio_uring_funcs_alloc(NULL, GENSIO_DEF_WAKE_SIG, &o);
 #endif
     } else {
 	rv = gensio_alloc_os_funcs(GENSIO_DEF_WAKE_SIG, &o, 0);
@@ -2351,6 +2478,19 @@ main(int argc, char *argv[])
     }
     gensio_os_funcs_set_vlog(o, do_vlog);
 
+    if (no_mmsg) {
+	rv = o->control(o, GENSIO_CONTROL_DISABLE_MMSG, NULL, NULL);
+	if (rv) {
+	    fprintf(stderr, "Could not disable mmsg: %s\n",
+		    gensio_err_to_str(rv));
+	    exit(1);
+	}
+	/* Have gensiot do the same. */
+	snprintf(os_func_buf, sizeof(os_func_buf), "%s --no-mmsg",
+		 os_func_str);
+	os_func_str = os_func_buf;
+    }
+
     rv = gensio_os_proc_setup(o, &proc_data);
     if (rv) {
 	fprintf(stderr, "Error setting up process data: %s\n",
@@ -2449,6 +2589,8 @@ main(int argc, char *argv[])
     for (i = 0; oom_tests[i].connecter; i++) {
 	if (oom_tests[i].free_connecter)
 	    gensio_os_funcs_zfree(o, oom_tests[i].connecter);
+	if (oom_tests[i].free_accepter)
+	    gensio_os_funcs_zfree(o, oom_tests[i].accepter);
     }
 
     printf("Got %ld errors, skipped %ld tests\n", errcount, skipcount);
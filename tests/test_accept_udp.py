@@ -13,5 +13,18 @@ TestAccept(o, "udp,ipv4,localhost,", "udp,localhost,0",
            do_test, io1_dummy_write = "A",
            expected_raddr = "ipv4,127.0.0.1,",
            expected_acc_laddr = "ipv4,127.0.0.1,")
+
+print("Test accept udp with batching")
+TestAccept(o, "udp(batch=16),ipv4,localhost,", "udp(batch=16),localhost,0",
+           do_small_test, io1_dummy_write = "A")
+
+print("Test accept udp with gso")
+try:
+    TestAccept(o, "udp(gso=1000),ipv4,localhost,", "udp(gso=1000),localhost,0",
+               do_small_test, io1_dummy_write = "A")
+except Exception as E:
+    if not str(E).endswith("Operation not supported"):
+        raise
+    print("  udp GSO is not available, skipped")
 del o
 test_shutdown()
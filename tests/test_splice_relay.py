@@ -0,0 +1,89 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Run gensiot --splice between two tcp connections and make sure data
+# gets through the relay in both directions, and that gensiot goes
+# away when one side closes.
+
+from utils import *
+import gensio
+import subprocess
+
+if is_windows():
+    sys.exit(77)
+
+gensiot = os.getenv("GENSIOT")
+if not gensiot:
+    print("GENSIOT is not set, can't find gensiot")
+    sys.exit(77)
+
+class RelayEnd:
+    def __init__(self, o, accstr, name):
+        self.o = o
+        self.name = name
+        self.io = None
+        self.waiter = gensio.waiter(o)
+        gensios_enabled.check_iostr_gensios(accstr)
+        self.acc = gensio.gensio_accepter(o, accstr, self)
+        self.acc.startup()
+        self.port = self.acc.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                                     gensio.GENSIO_CONTROL_GET,
+                                     gensio.GENSIO_ACC_CONTROL_LPORT, "0")
+
+    def wait_connection(self):
+        if (self.waiter.wait_timeout(1, 2000) == 0):
+            raise Exception("%s: Timed out waiting for the relay connection" %
+                            self.name)
+        io = self.io
+        self.io = None
+        return io
+
+    def close(self):
+        self.acc.shutdown_s()
+        self.acc = None
+
+    def new_connection(self, acc, io):
+        HandleData(self.o, None, io = io, name = self.name)
+        self.io = io
+        self.waiter.wake()
+
+    def accepter_log(self, acc, level, logstr):
+        print("***%s LOG: %s: %s" % (level, self.name, logstr))
+
+def test_relay(extra_args):
+    end1 = RelayEnd(o, "tcp,ipv4,localhost,0", "relay end 1")
+    end2 = RelayEnd(o, "tcp,ipv4,localhost,0", "relay end 2")
+    p = subprocess.Popen([gensiot] + extra_args +
+                         ["-i", "tcp,ipv4,localhost," + end1.port,
+                          "tcp,ipv4,localhost," + end2.port],
+                         stdin = subprocess.DEVNULL)
+    try:
+        io1 = end1.wait_connection()
+        io2 = end2.wait_connection()
+        do_large_test(io1, io2)
+        io_close((io1, io2))
+        try:
+            rv = p.wait(timeout = 5)
+        except subprocess.TimeoutExpired:
+            raise Exception("gensiot did not exit when the relay closed")
+        if rv != 0:
+            raise Exception("gensiot exited with %d" % rv)
+    finally:
+        if p.poll() is None:
+            p.kill()
+            p.wait()
+        end1.close()
+        end2.close()
+
+print("Test a tcp to tcp relay with splice")
+test_relay(["--splice"])
+
+print("Test a tcp to tcp relay without splice")
+test_relay([])
+
+del o
+test_shutdown()
@@ -0,0 +1,114 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Pile up a bunch of connections on a tcp accepter at once and make
+# sure they all get accepted and work.
+
+from utils import *
+import gensio
+import socket
+
+NUM_CONNS = 20
+
+class ManyAccepts:
+    def __init__(self, o, accstr):
+        self.o = o
+        self.name = accstr
+        self.accepted = {}
+        self.waiter = gensio.waiter(o)
+        gensios_enabled.check_iostr_gensios(accstr)
+        self.acc = gensio.gensio_accepter(o, accstr, self)
+        try:
+            self.acc.startup()
+        except:
+            # Break the circular reference.
+            self.acc = None
+            raise
+        self.port = self.acc.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                                     gensio.GENSIO_CONTROL_GET,
+                                     gensio.GENSIO_ACC_CONTROL_LPORT, "0")
+
+    def test(self, iostr, count):
+        # open_s() returns once the kernel has the connection, so with
+        # these opened back to back several are usually waiting on the
+        # listening socket at once.
+        ios = []
+        for i in range(0, count):
+            ios.append(alloc_io(self.o, iostr + self.port))
+        for i in range(0, count):
+            if (self.waiter.wait_timeout(1, 2000) == 0):
+                raise Exception("%s: Timed out waiting for connections,"
+                                " got %d of %d" %
+                                (self.name, len(self.accepted), count))
+
+        # Match them up by address, the accept order may not be the
+        # connect order.
+        pairs = []
+        for io1 in ios:
+            addr = io1.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                               gensio.GENSIO_CONTROL_GET,
+                               gensio.GENSIO_CONTROL_LADDR, "0")
+            if addr not in self.accepted:
+                raise Exception("%s: No connection accepted from %s" %
+                                (self.name, addr))
+            pairs.append((io1, self.accepted.pop(addr)))
+
+        for (io1, io2) in pairs:
+            test_dataxfer(io1, io2, "io1 to io2 on " + io1.handler.name)
+            test_dataxfer(io2, io1, "io2 to io1 on " + io2.handler.name)
+        for p in pairs:
+            io_close(p)
+        print("  Success!")
+
+    def close(self):
+        self.acc.shutdown_s()
+        self.acc = None
+
+    def new_connection(self, acc, io):
+        addr = io.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                          gensio.GENSIO_CONTROL_GET,
+                          gensio.GENSIO_CONTROL_RADDR, "0")
+        HandleData(self.o, None, io = io, name = "%s from %s" %
+                   (self.name, addr))
+        self.accepted[addr] = io
+        self.waiter.wake()
+
+    def accepter_log(self, acc, level, logstr):
+        print("***%s LOG: %s: %s" % (level, self.name, logstr))
+
+print("Test %d accepts on tcp with the default batch" % NUM_CONNS)
+ma = ManyAccepts(o, "tcp,ipv4,localhost,0")
+ma.test("tcp,ipv4,localhost,", NUM_CONNS)
+ma.close()
+del ma
+
+print("Test %d accepts on tcp with a small accept batch" % NUM_CONNS)
+ma = ManyAccepts(o, "tcp(acceptbatch=3),ipv4,localhost,0")
+ma.test("tcp,ipv4,localhost,", NUM_CONNS)
+ma.close()
+del ma
+
+# reuseport needs a real port, get a free one from the OS.
+s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+s.bind(("127.0.0.1", 0))
+port = s.getsockname()[1]
+s.close()
+print("Test %d accepts on tcp with 4 reuseport listeners" % NUM_CONNS)
+try:
+    ma = ManyAccepts(o, "tcp(reuseport=4),ipv4,localhost,%d" % port)
+except Exception as E:
+    if not str(E).endswith("Operation not supported"):
+        raise
+    print("  SO_REUSEPORT is not available, skipped")
+    ma = None
+if ma:
+    ma.test("tcp,ipv4,localhost,", NUM_CONNS)
+    ma.close()
+    del ma
+
+del o
+test_shutdown()
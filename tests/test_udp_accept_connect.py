@@ -11,5 +11,9 @@ import gensio
 print("Test udp accepter connect")
 TestAcceptConnect(o, "udp,localhost,0", "udp,localhost,0", "udp,localhost,",
                   do_small_test, io1_dummy_write = "A")
+
+print("Test udp accepter connect with batching")
+TestAcceptConnect(o, "udp(batch=16),localhost,0", "udp(batch=16),localhost,0",
+                  "udp,localhost,", do_small_test, io1_dummy_write = "A")
 del o
 test_shutdown()
@@ -0,0 +1,106 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Connect a lot of peers to one udp accepter, enough to grow the
+# remote address hash table a couple of times, and make sure data for
+# each peer gets to the right connection.
+
+from utils import *
+import gensio
+
+NUM_PEERS = 80
+
+class ManyPeers:
+    def __init__(self, o, accstr):
+        self.o = o
+        self.name = accstr
+        self.io2 = None
+        self.peers = []
+        self.waiter = gensio.waiter(o)
+        gensios_enabled.check_iostr_gensios(accstr)
+        self.acc = gensio.gensio_accepter(o, accstr, self)
+        self.acc.startup()
+        self.port = self.acc.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                                     gensio.GENSIO_CONTROL_GET,
+                                     gensio.GENSIO_ACC_CONTROL_LPORT, "0")
+
+    def add_peer(self, iostr):
+        n = len(self.peers)
+        io1 = alloc_io(self.o, iostr + self.port)
+        # For UDP, kick start things.
+        io1.write("A", None)
+        if (self.waiter.wait_timeout(1, 1000) == 0):
+            raise Exception("%s: Timed out waiting for peer %d connection" %
+                            (self.name, n))
+        io2 = self.io2
+        self.io2 = None
+        io2.handler.set_compare("A")
+        if (io2.handler.wait_timeout(1000) == 0):
+            raise Exception("%s: Timed out waiting for peer %d dummy read" %
+                            (self.name, n))
+        self.peers.append((io1, io2))
+
+    def xfer_all(self, to_acc, timeout = 2000):
+        """Send different data on every peer at the same time"""
+        for i, (io1, io2) in enumerate(self.peers):
+            data = ("peer %d data " % i) * 20
+            if to_acc:
+                (src, dst) = (io1, io2)
+            else:
+                (src, dst) = (io2, io1)
+            dst.handler.set_compare(data)
+            src.handler.set_write_data(data)
+        for (io1, io2) in self.peers:
+            for io in (io1, io2):
+                if (io.handler.wait_timeout(timeout) == 0):
+                    raise Exception("%s: %s: Timed out on transfer" %
+                                    (self.name, io.handler.name))
+
+    def close_peers(self, peers):
+        for p in peers:
+            self.peers.remove(p)
+            io_close(p)
+
+    def close(self):
+        self.close_peers(list(self.peers))
+        self.acc.shutdown_s()
+        self.acc = None
+
+    def new_connection(self, acc, io):
+        HandleData(self.o, None, io = io,
+                   name = "%s peer %d" % (self.name, len(self.peers)))
+        self.io2 = io
+        self.waiter.wake()
+
+    def accepter_log(self, acc, level, logstr):
+        print("***%s LOG: %s: %s" % (level, self.name, logstr))
+
+print("Test udp accepter with %d peers" % NUM_PEERS)
+mp = ManyPeers(o, "udp,ipv4,localhost,0")
+for i in range(0, NUM_PEERS):
+    mp.add_peer("udp,ipv4,localhost,")
+print("  testing peers to accepter")
+mp.xfer_all(True)
+print("  testing accepter to peers")
+mp.xfer_all(False)
+
+print("  closing every other peer")
+mp.close_peers(mp.peers[0::2])
+mp.xfer_all(True)
+mp.xfer_all(False)
+
+print("  adding new peers")
+for i in range(0, NUM_PEERS // 2):
+    mp.add_peer("udp,ipv4,localhost,")
+mp.xfer_all(True)
+mp.xfer_all(False)
+mp.close()
+del mp
+print("  Success!")
+
+del o
+test_shutdown()
@@ -0,0 +1,28 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Run udp batching without recvmmsg() and sendmmsg(), so the packet at
+# a time fallbacks get used.
+
+from utils import *
+import gensio
+
+try:
+    o.disable_mmsg()
+except Exception as E:
+    print("Can't disable mmsg on this OS handler: " + str(E))
+    sys.exit(77)
+
+print("Test accept udp with batching and no mmsg")
+TestAccept(o, "udp(batch=16),ipv4,localhost,", "udp(batch=16),localhost,0",
+           do_small_test, io1_dummy_write = "A")
+
+print("Test udp accepter connect with batching and no mmsg")
+TestAcceptConnect(o, "udp(batch=16),localhost,0", "udp(batch=16),localhost,0",
+                  "udp,localhost,", do_small_test, io1_dummy_write = "A")
+del o
+test_shutdown()
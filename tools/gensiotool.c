@@ -339,6 +339,7 @@ struct gtinfo {
     const char *ios1;
     const char *ios2;
     int escape_char;
+    bool splice;
     const char *signature;
     bool print_laddr;
     bool print_raddr;
@@ -795,8 +796,11 @@ add_io(struct gtinfo *g, struct gensio *io, bool open_finished)
     }
 
     ioinfo_set_otherioinfo(ioinfo1, ioinfo2);
+    ioinfo_set_splice(ioinfo1, g->splice);
 
-    err = str_to_gensio(g->ios1, o, parmlog_eventh, ioinfo1, &gtconn1->io);
+    /* Keep both sides on the same reactor. */
+    err = str_to_gensio(g->ios1, gensio_get_os_funcs(io), parmlog_eventh,
+			ioinfo1, &gtconn1->io);
     if (err) {
 	report_err(g, "Could not allocate %s: %s",
 		g->ios1, gensio_err_to_str(err));
@@ -981,6 +985,19 @@ help(int err)
 	   " the addresses being listened on.\n");
     printf("  -n, --extra-threads <n> - Spawn <n> extra threads to handle\n"
 	   "    gensio operations.  Useful for scalabiity with --server.\n");
+#ifndef _WIN32
+    printf("  -R, --reactors <n> - Use <n> separate reactors, each with\n"
+	   "    its own threads, and spread accepted connections across\n"
+	   "    them.  Useful for scalabiity with --server.\n");
+    printf("  --uring - Wait for I/O with io_uring polls instead of epoll,\n"
+	   "    if the kernel supports it.\n");
+#endif
+    printf("  --no-mmsg - Send and receive udp packets one at a time\n"
+	   "    instead of with sendmmsg() and recvmmsg().  For testing.\n");
+    printf("  -C, --cpus <list> - Run the threads on the given CPUs, one\n"
+	   "    CPU per thread.  The list is in the form 0-3,8,10.\n");
+    printf("  --numa-node <n> - Allocate memory from NUMA node <n> and,\n"
+	   "    if --cpus is not given, run the threads on its CPUs.\n");
     printf("  --server - When an accept happens, do not shut down the\n"
 	   "    accepter and continue to accept connections.  Do not\n"
 	   "    terminate when all the connections close.\n");
@@ -990,6 +1007,8 @@ help(int err)
 	   " the remote addresses.\n");
     printf("  -v, --verbose - Print all gensio logs\n");
     printf("  --signature <sig> - Set the RFC2217 server signature to <sig>\n");
+    printf("  --splice - Move data with splice() if both gensios are\n"
+	   "    plain fd gensios and no escape character is set.\n");
 #ifndef _WIN32
     printf("  -P, --pidfile <file> - Create a pid file.\n");
 #endif
@@ -1031,8 +1050,68 @@ gensio_loop(void *info)
 }
 
 static unsigned int num_extra_threads = 0;
+static unsigned int num_reactors = 1;
 static struct gensio_loop_info *loopinfo;
 
+#define MAX_THREAD_CPUS 1024
+static unsigned int thread_cpus[MAX_THREAD_CPUS];
+static unsigned int num_thread_cpus;
+static int thread_numa_node = -1;
+
+/* Parse a CPU list in the form "0-3,8,10" into thread_cpus. */
+static int
+parse_cpu_list(const char *str)
+{
+    unsigned long start, last;
+    char *end;
+
+    num_thread_cpus = 0;
+    while (*str) {
+	start = strtoul(str, &end, 0);
+	if (end == str)
+	    return -1;
+	last = start;
+	str = end;
+	if (*str == '-') {
+	    str++;
+	    last = strtoul(str, &end, 0);
+	    if (end == str || last < start)
+		return -1;
+	    str = end;
+	}
+	for (; start <= last; start++) {
+	    if (num_thread_cpus >= MAX_THREAD_CPUS)
+		return -1;
+	    thread_cpus[num_thread_cpus++] = start;
+	}
+	if (*str == ',')
+	    str++;
+	else if (*str)
+	    return -1;
+    }
+    return 0;
+}
+
+/*
+ * Get the placement for thread n, the main thread is 0.  Each thread
+ * gets its own CPU from the list, wrapping around if there are more
+ * threads than CPUs.
+ */
+static const struct gensio_thread_attr *
+get_thread_attr(unsigned int n, struct gensio_thread_attr *attr)
+{
+    if (!num_thread_cpus && thread_numa_node < 0)
+	return NULL;
+    attr->cpus = NULL;
+    attr->num_cpus = 0;
+    if (num_thread_cpus) {
+	attr->cpus = &thread_cpus[n % num_thread_cpus];
+	attr->num_cpus = 1;
+    }
+    attr->numa_node = thread_numa_node;
+    return attr;
+}
+
 static void
 free_threads(struct gensio_os_funcs *o)
 {
@@ -1040,11 +1119,11 @@ free_threads(struct gensio_os_funcs *o)
 
     for (i = 0; loopinfo && i < num_extra_threads; i++) {
 	if (loopinfo[i].loopth) {
-	    gensio_os_funcs_wake(o, loopinfo[i].loopwaiter);
+	    gensio_os_funcs_wake(loopinfo[i].o, loopinfo[i].loopwaiter);
 	    gensio_os_wait_thread(loopinfo[i].loopth);
 	}
 	if (loopinfo[i].loopwaiter)
-	    gensio_os_funcs_free_waiter(o, loopinfo[i].loopwaiter);
+	    gensio_os_funcs_free_waiter(loopinfo[i].o, loopinfo[i].loopwaiter);
     }
     if (loopinfo) {
 	gensio_os_funcs_zfree(o, loopinfo);
@@ -1057,6 +1136,7 @@ alloc_threads(struct gensio_os_funcs *o)
 {
     int rv = GE_NOMEM;
     unsigned int i;
+    struct gensio_thread_attr attr;
 
     if (num_extra_threads > 0) {
 	loopinfo = gensio_os_funcs_zalloc(o,
@@ -1066,15 +1146,18 @@ alloc_threads(struct gensio_os_funcs *o)
     }
 
     for (i = 0; i < num_extra_threads; i++) {
-	loopinfo[i].o = o;
-	loopinfo[i].loopwaiter = gensio_os_funcs_alloc_waiter(o);
+	/* The main thread handles reactor 0, start with the next one. */
+	loopinfo[i].o = gensio_os_funcs_get_reactor(o, i + 1);
+	loopinfo[i].loopwaiter = gensio_os_funcs_alloc_waiter(loopinfo[i].o);
 	if (!loopinfo[i].loopwaiter) {
 	    fprintf(stderr, "Could not allocate loop waiter\n");
 	    goto out_err;
 	}
 
-	rv = gensio_os_new_thread(o, gensio_loop, loopinfo + i,
-				  &loopinfo[i].loopth);
+	rv = gensio_os_new_thread_attr(loopinfo[i].o, gensio_loop,
+				       loopinfo + i,
+				       get_thread_attr(i + 1, &attr),
+				       &loopinfo[i].loopth);
 	if (rv) {
 	    fprintf(stderr, "Could not allocate loop thread: %s",
 		    gensio_err_to_str(rv));
@@ -1123,8 +1206,12 @@ main(int argc, char *argv[])
     const char *tmpstr;
     bool use_glib = false;
     bool use_tcl = false;
+    bool use_uring = false;
+    bool no_mmsg = false;
     gensio_time endwait = { 5, 0 };
     struct gensio *io = NULL;
+    struct gensio_thread_attr attr;
+    const struct gensio_thread_attr *tattr;
 
     memset(&g, 0, sizeof(g));
     g.escape_char = -1;
@@ -1165,9 +1252,17 @@ main(int argc, char *argv[])
 	    use_glib = true;
 	else if ((rv = cmparg(argc, argv, &arg, "", "--tcl", NULL)))
 	    use_tcl = true;
+#ifndef _WIN32
+	else if ((rv = cmparg(argc, argv, &arg, NULL, "--uring", NULL)))
+	    use_uring = true;
+#endif
+	else if ((rv = cmparg(argc, argv, &arg, NULL, "--no-mmsg", NULL)))
+	    no_mmsg = true;
 	else if ((rv = cmparg(argc, argv, &arg, "", "--signature",
 			      &g.signature)))
 	    ;
+	else if ((rv = cmparg(argc, argv, &arg, NULL, "--splice", NULL)))
+	    g.splice = true;
 #ifndef _WIN32
 	else if ((rv = cmparg(argc, argv, &arg, "-P", "--pidfile",
 			      &g.pid_file)))
@@ -1178,6 +1273,19 @@ main(int argc, char *argv[])
 	else if ((rv = cmparg(argc, argv, &arg, "-n", "--extra-threads",
 			      &tmpstr)))
 	    num_extra_threads = strtol(tmpstr, NULL, 0);
+#ifndef _WIN32
+	else if ((rv = cmparg(argc, argv, &arg, "-R", "--reactors",
+			      &tmpstr)))
+	    num_reactors = strtol(tmpstr, NULL, 0);
+#endif
+	else if ((rv = cmparg(argc, argv, &arg, "-C", "--cpus", &tmpstr))) {
+	    if (parse_cpu_list(tmpstr)) {
+		fprintf(stderr, "Invalid CPU list: %s\n", tmpstr);
+		help(1);
+	    }
+	} else if ((rv = cmparg(argc, argv, &arg, NULL, "--numa-node",
+				&tmpstr)))
+	    thread_numa_node = strtol(tmpstr, NULL, 0);
 	else if ((rv = cmparg(argc, argv, &arg, "-d", "--debug", NULL))) {
 	    debug++;
 	    if (debug > 1)
@@ -1237,6 +1345,15 @@ main(int argc, char *argv[])
 		    " TCL, forcing to 0\n", num_extra_threads);
 	num_extra_threads = 0;
 	rv = gensio_tcl_funcs_alloc(&g.o);
+#endif
+#ifndef _WIN32
+    } else if (num_reactors > 1) {
+	/* Every reactor needs at least one thread. */
+	if (num_extra_threads < num_reactors - 1)
+	    num_extra_threads = num_reactors - 1;
+	rv = gensio_unix_funcs_alloc_reactors(num_reactors, SIGUSR1, &g.o);
+    } else if (use_uring) {
+	rv = gensio_uring_funcs_alloc(NULL, SIGUSR1, &g.o);
 #endif
     } else {
 	rv = gensio_alloc_os_funcs(SIGUSR1, &g.o, 0);
@@ -1249,6 +1366,15 @@ main(int argc, char *argv[])
     gensio_os_funcs_set_data(g.o, &g);
     gensio_os_funcs_set_vlog(g.o, do_vlog);
 
+    if (no_mmsg) {
+	rv = g.o->control(g.o, GENSIO_CONTROL_DISABLE_MMSG, NULL, NULL);
+	if (rv) {
+	    fprintf(stderr, "Could not disable mmsg: %s\n",
+		    gensio_err_to_str(rv));
+	    goto out_err;
+	}
+    }
+
     g.waiter = gensio_os_funcs_alloc_waiter(g.o);
     if (!g.waiter) {
 	rv = GE_NOMEM;
@@ -1270,6 +1396,16 @@ main(int argc, char *argv[])
 	goto out_err;
     }
 
+    tattr = get_thread_attr(0, &attr);
+    if (tattr) {
+	rv = gensio_os_thread_set_attr(g.o, tattr);
+	if (rv) {
+	    fprintf(stderr, "Could not set thread placement: %s\n",
+		    gensio_err_to_str(rv));
+	    goto out_err;
+	}
+    }
+
     rv = alloc_threads(g.o);
     if (rv)
 	goto out_err;
@@ -1336,8 +1472,6 @@ main(int argc, char *argv[])
     if (!rv && g.err)
 	rv = g.err;
 
-    free_threads(g.o);
-
     /*
      * We wait until there are no gensios left pending.  You can get
      * into situations where there is an incoming gensio accept that
@@ -1354,6 +1488,8 @@ main(int argc, char *argv[])
 	    endwait.nsecs = 0;
 	}
     }
+    /* Other reactors may have been finishing up, too, so do this last. */
+    free_threads(g.o);
     if (g.waiter)
 	gensio_os_funcs_free_waiter(g.o, g.waiter);
     if (g.lock)
@@ -382,6 +382,7 @@ help(int err)
     printf("    for detail on how to do regex, glob, etc.\n");
     printf("  --2fa <str> - Pass the given string as 2-factor auth data.\n");
     printf("  --nointeractive - Do not do interactive login queries.\n");
+    printf("  --splice - Try to relay port forwarding data with splice().\n");
     printf("  -d, --debug - Enable debug.  Specify more than once to increase\n"
 	   "    the debug level\n");
     printf("  -L <accept addr>:<connect addr> - Listen at the <accept addr>\n"
@@ -1897,6 +1898,8 @@ main(int argc, char *argv[])
 	} else if ((err = cmparg(argc, argv, &arg, NULL, "--nomux", NULL))) {
 	    muxstr = "";
 	    use_mux = false;
+	} else if ((err = cmparg(argc, argv, &arg, NULL, "--splice", NULL))) {
+	    local_ports_set_splice(locport, true);
 	} else if ((err = cmparg(argc, argv, &arg, NULL, "--notcp", NULL))) {
 	    notcp = true;
 	} else if ((err = cmparg(argc, argv, &arg, NULL, "--nosctp", NULL))) {
@@ -29,6 +29,8 @@
 #include <errno.h>
 #include <string.h>
 
+#include <gensio/gensio_relay.h>
+
 #include "ioinfo.h"
 
 struct ioinfo {
@@ -45,6 +47,13 @@ struct ioinfo {
 
     gensiods max_write;
 
+    /*
+     * If splice is set, use a relay to move the data when both sides
+     * are ready.  relay is set on both ioinfos while it runs.
+     */
+    bool splice;
+    struct gensio_relay *relay;
+
     struct ioinfo_sub_handlers *sh;
     void *subdata;
 
@@ -413,6 +422,75 @@ init_state(struct gensio *io)
 		   GENSIO_CONTROL_SER_LINESTATE, msmstr, &msmstrlen);
 }
 
+/* Take the relay out of both ioinfos and free it, if it is running. */
+static void
+ioinfo_stop_relay(struct ioinfo *ioinfo)
+{
+    struct ioinfo *rioinfo = ioinfo->otherio;
+    struct gensio_relay *relay;
+
+    gensio_os_funcs_lock(ioinfo->o, ioinfo->lock);
+    relay = ioinfo->relay;
+    ioinfo->relay = NULL;
+    gensio_os_funcs_unlock(ioinfo->o, ioinfo->lock);
+    if (!relay)
+	return;
+    gensio_os_funcs_lock(rioinfo->o, rioinfo->lock);
+    rioinfo->relay = NULL;
+    gensio_os_funcs_unlock(rioinfo->o, rioinfo->lock);
+    gensio_relay_free(relay);
+}
+
+static void
+relay_done(struct gensio_relay *relay, int err, void *cb_data)
+{
+    struct ioinfo *ioinfo = cb_data;
+
+    ioinfo_stop_relay(ioinfo);
+    if (err == GE_REMCLOSE || err == GE_LOCALCLOSED) {
+	ioinfo->uh->shutdown(ioinfo, IOINFO_SHUTDOWN_REMCLOSE);
+    } else {
+	ioinfo_err(ioinfo, "relay error: %s", gensio_err_to_str(err));
+	ioinfo->uh->shutdown(ioinfo, IOINFO_SHUTDOWN_ERR);
+    }
+}
+
+/*
+ * If both sides are ready and neither has anything to look at in the
+ * data, hand the data movement over to a relay.  If the gensios can't
+ * do that, just keep going the normal way.
+ */
+static void
+ioinfo_start_relay(struct ioinfo *ioinfo)
+{
+    struct ioinfo *rioinfo = ioinfo->otherio;
+    struct gensio_relay *relay;
+    int rv;
+
+    if (!(ioinfo->splice || rioinfo->splice) ||
+		ioinfo->escape_char >= 0 || rioinfo->escape_char >= 0 ||
+		!ioinfo->ready || !rioinfo->ready || ioinfo->relay)
+	return;
+
+    gensio_set_read_callback_enable(ioinfo->io, false);
+    gensio_set_write_callback_enable(ioinfo->io, false);
+    gensio_set_read_callback_enable(rioinfo->io, false);
+    gensio_set_write_callback_enable(rioinfo->io, false);
+    rv = gensio_relay_alloc(ioinfo->io, rioinfo->io, relay_done, ioinfo,
+			    &relay);
+    if (rv) {
+	gensio_set_read_callback_enable(ioinfo->io, true);
+	gensio_set_read_callback_enable(rioinfo->io, true);
+	return;
+    }
+    gensio_os_funcs_lock(ioinfo->o, ioinfo->lock);
+    ioinfo->relay = relay;
+    gensio_os_funcs_unlock(ioinfo->o, ioinfo->lock);
+    gensio_os_funcs_lock(rioinfo->o, rioinfo->lock);
+    rioinfo->relay = relay;
+    gensio_os_funcs_unlock(rioinfo->o, rioinfo->lock);
+}
+
 void
 ioinfo_set_ready(struct ioinfo *ioinfo, struct gensio *io)
 {
@@ -433,11 +511,14 @@ ioinfo_set_ready(struct ioinfo *ioinfo, struct gensio *io)
     if (rioinfo->ready)
 	gensio_set_read_callback_enable(rioinfo->io, true);
     gensio_os_funcs_unlock(rioinfo->o, rioinfo->lock);
+
+    ioinfo_start_relay(ioinfo);
 }
 
 void
 ioinfo_set_not_ready(struct ioinfo *ioinfo)
 {
+    ioinfo_stop_relay(ioinfo);
     gensio_os_funcs_lock(ioinfo->o, ioinfo->lock);
     if (ioinfo->io) {
 	gensio_set_read_callback_enable(ioinfo->io, false);
@@ -447,6 +528,12 @@ ioinfo_set_not_ready(struct ioinfo *ioinfo)
     gensio_os_funcs_unlock(ioinfo->o, ioinfo->lock);
 }
 
+void
+ioinfo_set_splice(struct ioinfo *ioinfo, bool splice)
+{
+    ioinfo->splice = splice;
+}
+
 void
 ioinfo_set_otherioinfo(struct ioinfo *ioinfo, struct ioinfo *otherioinfo)
 {
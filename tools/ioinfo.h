@@ -165,6 +165,17 @@ struct ioinfo *ioinfo_otherioinfo(struct ioinfo *ioinfo);
  */
 void ioinfo_set_otherioinfo(struct ioinfo *ioinfo, struct ioinfo *otherioinfo);
 
+/*
+ * Move the data between the gensios with a gensio_relay, which uses
+ * splice() and doesn't copy the data through user space, once both
+ * sides are ready.  This is only done if escape characters are
+ * disabled on both sides and both gensios are raw fd gensios;
+ * otherwise data is handled normally.  No oob data or max write
+ * limits are handled while the relay runs.  Call before
+ * ioinfo_set_ready().
+ */
+void ioinfo_set_splice(struct ioinfo *ioinfo, bool splice);
+
 /*
  * Set the ioinfo as ready.  This sets the gensio for ioinfo, turns on
  * read for the gensio, and marks itself ready.  This means that it
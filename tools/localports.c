@@ -50,6 +50,7 @@ struct local_ports {
     struct gensio_lock *lock;
     struct local_portinfo *local_ports;
     bool started;
+    bool splice;
     struct gensio *base_io;
     struct gensio_list portcons;
     void (*localport_err)(void *cb_data, const char *format, va_list ap);
@@ -181,6 +182,8 @@ portcon_setup(struct local_ports *p, struct gensio *io, char *id_str,
     }
 
     ioinfo_set_otherioinfo(ioinfo1, ioinfo2);
+    ioinfo_set_splice(ioinfo1, p->splice);
+    ioinfo_set_splice(ioinfo2, p->splice);
 
     *rioinfo1 = ioinfo1;
     *rioinfo2 = ioinfo2;
@@ -455,3 +458,9 @@ alloc_local_ports(struct gensio_os_funcs *o,
 
     return p;
 }
+
+void
+local_ports_set_splice(struct local_ports *p, bool splice)
+{
+    p->splice = splice;
+}
@@ -27,6 +27,7 @@
 #define LOCALPORTS_H
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <gensio/gensio.h>
 
 struct local_ports;
@@ -39,6 +40,14 @@ struct local_ports *alloc_local_ports(struct gensio_os_funcs *o,
 
 void free_local_ports(struct local_ports *p);
 
+/*
+ * Try to relay the data for new connections with a splice relay, see
+ * ioinfo_set_splice().  Only connections that have an fd gensio with
+ * no filter on both sides can be relayed, others are handled
+ * normally.
+ */
+void local_ports_set_splice(struct local_ports *p, bool splice);
+
 void start_local_ports(struct local_ports *p, struct gensio *user_io);
 
 int add_local_port(struct local_ports *p,